@@ -0,0 +1,779 @@
+/*
+ * Microbenchmarks for the engine's hot paths, built with `make bench`
+ *
+ * Runs without a display: the headless game (dummy video driver, software renderer
+ * drawing into an offscreen surface) provides everything the render benchmarks need
+ *
+ * Every benchmark is calibrated first, so that a single sample takes roughly
+ * TARGET_SAMPLE_SECONDS, then warmed up and sampled DEFAULT_SAMPLES times (--samples). The
+ * per-operation times of all samples are sorted and reported as one JSON object
+ * per line on stdout, which makes two engine revisions easy to diff:
+ *
+ *   {"name": "vec2_normalize", "items": 1024, "iterations": 512, "samples": 50,
+ *    "median_ns": 2210.4, "p99_ns": 2450.1, "min_ns": 2190.0}
+ *
+ * One "operation" processes `items` elements (vectors, boxes, sprites...),
+ * divide by it to get the cost of a single one
+ *
+ * --verify runs no benchmark, it checks every SIMD path of the batch functions
+ * against the plain C one instead, along with the profiler's trace dumps
+ * (`make test`), and fails if anything is off
+ *
+ * Usage: bench [--samples N] [--filter SUBSTRING] [--verify]
+ * NOTE: Numbers from unoptimized objects are meaningless, see `make bench RELEASE=1`
+ */
+#include "engine/game.h"
+#include "engine/common.h"
+#include "engine/custom_math.h"
+#include "engine/sprite.h"
+#include "engine/interface.h"
+#include "engine/timers.h"
+#include "engine/collision.h"
+#include "engine/scheduler.h"
+#include "engine/mixer.h"
+#include "engine/adpcm.h"
+#include "engine/profiler.h"
+#include <SDL2/SDL_mixer.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WIDTH 640
+#define HEIGHT 480
+
+#define DEFAULT_SAMPLES 50
+#define WARMUP_SAMPLES 5
+#define TARGET_SAMPLE_SECONDS 0.002
+
+// Big enough to leave the L1 cache, small enough for L2
+#define VECTOR_COUNT 1024
+#define BOX_COUNT 1024
+#define COLLIDER_COUNT 512
+#define SPRITE_COUNT 256
+#define INTERVAL_COUNT 256
+#define TIMER_COUNT 1024
+#define MIXER_VOICES 16
+#define MIXER_FRAMES 1024
+// Longest batch --verify tries, odd so that every path has leftovers
+#define VERIFY_COUNT 1001
+// Where --verify dumps the profiler's trace, removed afterwards
+#define VERIFY_TRACE_PATH "verify_trace.json"
+
+// Runs the measured operation `iterations` times in a row
+typedef void (*bench_function_t) (void *data, int iterations);
+
+static ng_game_t game;
+static int sample_count = DEFAULT_SAMPLES;
+static const char *filter;
+static bool verify;
+
+// Results of a benchmark get written here, so the compiler can't drop the work
+static volatile float sink;
+
+static double elapsed_seconds(uint64_t start)
+{
+    return (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+}
+
+static double run_sample(bench_function_t function, void *data, int iterations)
+{
+    uint64_t start = SDL_GetPerformanceCounter();
+    function(data, iterations);
+    return elapsed_seconds(start);
+}
+
+static int compare_doubles(const void *first, const void *second)
+{
+    double a = *(const double*)first, b = *(const double*)second;
+    return (a > b) - (a < b);
+}
+
+static void run_benchmark(const char *name, int items, bench_function_t function, void *data)
+{
+    if (filter && !strstr(name, filter))
+        return;
+
+    // Double the iterations until a sample is long enough for the counter's resolution
+    int iterations = 1;
+    while (iterations < (1 << 24) && run_sample(function, data, iterations) < TARGET_SAMPLE_SECONDS)
+        iterations *= 2;
+
+    for (int i = 0; i < WARMUP_SAMPLES; i++)
+        run_sample(function, data, iterations);
+
+    double *times = malloc(sizeof(double) * sample_count);
+    if (!times)
+        ng_die("failed to allocate the benchmark samples");
+
+    // Nanoseconds per operation
+    for (int i = 0; i < sample_count; i++)
+        times[i] = run_sample(function, data, iterations) * 1e9 / iterations;
+
+    qsort(times, sample_count, sizeof(double), compare_doubles);
+
+    // Nearest rank, with few samples the p99 is simply the slowest one
+    int p99 = (sample_count * 99 + 99) / 100 - 1;
+
+    printf("{\"name\": \"%s\", \"items\": %d, \"iterations\": %d, \"samples\": %d, "
+           "\"median_ns\": %.1f, \"p99_ns\": %.1f, \"min_ns\": %.1f}\n",
+           name, items, iterations, sample_count,
+           times[sample_count / 2], times[p99], times[0]);
+    fflush(stdout);
+
+    free(times);
+}
+
+static float random_float(float min, float max)
+{
+    return min + (max - min) * ((float)rand() / RAND_MAX);
+}
+
+// ng_vec2 operations, one vector at a time and through the batch versions
+
+static ng_vec2 vectors[VECTOR_COUNT], velocities[VECTOR_COUNT];
+static float xs[VECTOR_COUNT], ys[VECTOR_COUNT], vxs[VECTOR_COUNT], vys[VECTOR_COUNT];
+
+static void bench_vec2_add(void *data, int iterations)
+{
+    for (int n = 0; n < iterations; n++)
+        for (int i = 0; i < VECTOR_COUNT; i++)
+            ng_vectors_add(&vectors[i], &vectors[i], &velocities[i]);
+
+    sink = vectors[0].x;
+}
+
+static void bench_vec2_normalize(void *data, int iterations)
+{
+    ng_vec2 result;
+    float total = 0.0f;
+
+    for (int n = 0; n < iterations; n++)
+        for (int i = 0; i < VECTOR_COUNT; i++)
+        {
+            ng_vector_normalize(&result, &velocities[i]);
+            total += result.x;
+        }
+
+    sink = total;
+}
+
+static void bench_batch_multiply_add(void *data, int iterations)
+{
+    for (int n = 0; n < iterations; n++)
+    {
+        ng_batch_multiply_add(xs, vxs, 1.0f / 60.0f, VECTOR_COUNT);
+        ng_batch_multiply_add(ys, vys, 1.0f / 60.0f, VECTOR_COUNT);
+    }
+
+    sink = xs[0];
+}
+
+static void bench_batch_normalize(void *data, int iterations)
+{
+    for (int n = 0; n < iterations; n++)
+        ng_batch_normalize(vxs, vys, VECTOR_COUNT);
+
+    sink = vxs[0];
+}
+
+// AABB tests like the old check_collision(), every box against a single one (the cat)
+
+static SDL_FRect boxes[BOX_COUNT];
+static float box_x[BOX_COUNT], box_y[BOX_COUNT], box_w[BOX_COUNT], box_h[BOX_COUNT];
+static uint8_t overlaps[BOX_COUNT];
+static const SDL_FRect player = {300, 380, 80, 80};
+
+static void bench_aabb_scalar(void *data, int iterations)
+{
+    int hits = 0;
+
+    for (int n = 0; n < iterations; n++)
+        for (int i = 0; i < BOX_COUNT; i++)
+            hits += SDL_HasIntersectionF(&boxes[i], &player);
+
+    sink = hits;
+}
+
+static void bench_aabb_batch(void *data, int iterations)
+{
+    int hits = 0;
+
+    for (int n = 0; n < iterations; n++)
+        hits += ng_batch_overlaps(overlaps, box_x, box_y, box_w, box_h, &player, BOX_COUNT);
+
+    sink = hits;
+}
+
+// Every box against every other through the broad-phase, all of them moving
+static int collider_type;
+
+static void bench_collision_detect(void *data, int iterations)
+{
+    ng_collision_world_t *world = data;
+    int events = 0;
+
+    for (int n = 0; n < iterations; n++)
+    {
+        ng_collision_clear(world);
+
+        for (int i = 0; i < COLLIDER_COUNT; i++)
+            ng_collision_add_moving(world, collider_type, &boxes[i], vxs[i] / 60.0f, vys[i] / 60.0f, i);
+
+        ng_collision_detect(world);
+        events += world->event_count;
+    }
+
+    sink = events;
+}
+
+// Sprite submission, straight to the renderer and through a batch
+
+typedef struct
+{
+    ng_sprite_t sprites[SPRITE_COUNT];
+    ng_sprite_batch_t batch;
+} sprite_bench_t;
+
+static void bench_sprite_render(void *data, int iterations)
+{
+    sprite_bench_t *bench = data;
+
+    for (int n = 0; n < iterations; n++)
+        for (int i = 0; i < SPRITE_COUNT; i++)
+            ng_sprite_render(&bench->sprites[i], game.renderer);
+
+    // Otherwise the software renderer just keeps queueing commands
+    SDL_RenderFlush(game.renderer);
+}
+
+static void bench_sprite_batch(void *data, int iterations)
+{
+    sprite_bench_t *bench = data;
+
+    for (int n = 0; n < iterations; n++)
+    {
+        for (int i = 0; i < SPRITE_COUNT; i++)
+            ng_sprite_batch_add(&bench->batch, &bench->sprites[i], i % 4);
+
+        ng_sprite_batch_flush(&bench->batch, game.renderer);
+    }
+
+    SDL_RenderFlush(game.renderer);
+}
+
+// Label layout, the glyph atlas is built once before the measurements
+
+static const char *label_contents[] = {
+    "Loading... 42%",
+    "Press Enter to start. Avoid the snowmen and catch the mouse!",
+    "You win! Press Enter to play again"
+};
+
+static void bench_label_set_content(void *data, int iterations)
+{
+    ng_label_t *label = data;
+    SDL_Color white = {255, 255, 255, 255};
+
+    for (int n = 0; n < iterations; n++)
+        ng_label_set_content(label, game.renderer, label_contents[n % 3], white);
+
+    sink = label->glyph_count;
+}
+
+// Timers, polled the way gameplay code used to and through the scheduler
+
+static ng_interval_t intervals[INTERVAL_COUNT];
+
+static void bench_interval_is_ready(void *data, int iterations)
+{
+    int ready = 0;
+
+    for (int n = 0; n < iterations; n++)
+        for (int i = 0; i < INTERVAL_COUNT; i++)
+            ready += ng_interval_is_ready(&intervals[i]);
+
+    sink = ready;
+}
+
+static void count_fired(void *data)
+{
+    (*(int*)data)++;
+}
+
+// One 60Hz tick with TIMER_COUNT repeating timers spread over a few seconds
+static void bench_scheduler_advance(void *data, int iterations)
+{
+    ng_scheduler_t *scheduler = data;
+
+    for (int n = 0; n < iterations; n++)
+        ng_scheduler_advance(scheduler, 1.0 / 60.0);
+}
+
+// One audio callback's worth of frames with MIXER_VOICES looping voices
+
+static int16_t mixer_buffer[MIXER_FRAMES * 2];
+
+static void bench_mixer_post_mix(void *data, int iterations)
+{
+    for (int n = 0; n < iterations; n++)
+        ng_mixer_post_mix(NULL, (Uint8*)mixer_buffer, sizeof(mixer_buffer));
+
+    sink = mixer_buffer[0];
+}
+
+// --verify, the batch functions on every length up to a few registers and a long one
+
+typedef struct
+{
+    // One more than the longest length, nothing may write past the end
+    float sum[VERIFY_COUNT + 1], moved[VERIFY_COUNT + 1], distance[VERIFY_COUNT + 1];
+    float normal_x[VERIFY_COUNT + 1], normal_y[VERIFY_COUNT + 1], mixed[VERIFY_COUNT + 1];
+    uint8_t overlaps[VERIFY_COUNT + 1];
+    int16_t samples[VERIFY_COUNT + 1];
+    int hits;
+} batch_results_t;
+
+static float verify_x[VERIFY_COUNT], verify_y[VERIFY_COUNT], verify_values[VERIFY_COUNT];
+static float verify_box_x[VERIFY_COUNT], verify_box_y[VERIFY_COUNT];
+static float verify_box_w[VERIFY_COUNT], verify_box_h[VERIFY_COUNT];
+static int16_t verify_samples[VERIFY_COUNT];
+static const SDL_FRect verify_rect = {100, 80, 120, 90};
+
+static void create_verify_data(void)
+{
+    // Boxes touching an edge or a corner of the rectangle (not overlapping),
+    // barely crossing one, empty ones inside of it, the rectangle itself and one around it
+    static const SDL_FRect edge_boxes[] = {
+        {80, 100, 20, 20}, {220, 100, 20, 20}, {150, 60, 20, 20}, {150, 170, 20, 20},
+        {80, 60, 20, 20}, {220, 170, 20, 20}, {99, 100, 2, 20}, {150, 169, 20, 2},
+        {150, 100, 0, 20}, {150, 100, 20, 0}, {150, 100, 20, -5}, {100, 80, 120, 90},
+        {0, 0, 400, 400},
+    };
+    // Out of range, halfway between two samples, and the values without a sample
+    static const float edge_values[] = {
+        32767.0f, 32767.6f, 40000.0f, -32768.0f, -32768.6f, -1e9f, 0.5f, 1.5f, -0.5f,
+        2.5f, -0.0f, NAN, INFINITY, -INFINITY,
+    };
+
+    // Same data on every run, a failure always shows up again
+    srand(1);
+
+    for (int i = 0; i < VERIFY_COUNT; i++)
+    {
+        // Zero vectors and vectors along an axis show up at every lane sooner or later
+        verify_x[i] = i % 3 == 1 ? 0.0f : random_float(-500, 500);
+        verify_y[i] = i % 3 == 1 || i % 7 == 2 ? 0.0f : random_float(-500, 500);
+
+        SDL_FRect box = {random_float(0, 320), random_float(0, 240), random_float(-8, 64), random_float(-8, 64)};
+        if (i % 2 == 0)
+            box = edge_boxes[(i / 2) % ARRAY_LENGTH(edge_boxes)];
+
+        verify_box_x[i] = box.x;
+        verify_box_y[i] = box.y;
+        verify_box_w[i] = box.w;
+        verify_box_h[i] = box.h;
+
+        verify_values[i] = i % 3 == 0 ? edge_values[(i / 3) % ARRAY_LENGTH(edge_values)]
+                                      : random_float(-40000, 40000);
+        verify_samples[i] = i % 5 == 0 ? (i % 2 ? INT16_MAX : INT16_MIN) : (int16_t)(rand() % 65536 - 32768);
+    }
+}
+
+static void run_batch_functions(batch_results_t *results, int count)
+{
+    // Same bytes everywhere nothing gets written, for both paths
+    memset(results, 0x5a, sizeof(*results));
+
+    ng_batch_add(results->sum, verify_x, verify_y, count);
+
+    memcpy(results->moved, verify_x, count * sizeof(float));
+    ng_batch_multiply_add(results->moved, verify_y, 0.37f, count);
+
+    memcpy(results->normal_x, verify_x, count * sizeof(float));
+    memcpy(results->normal_y, verify_y, count * sizeof(float));
+    ng_batch_normalize(results->normal_x, results->normal_y, count);
+
+    ng_batch_distance(results->distance, verify_x, verify_y, 12.5f, -3.25f, count);
+
+    results->hits = ng_batch_overlaps(results->overlaps, verify_box_x, verify_box_y,
+                                      verify_box_w, verify_box_h, &verify_rect, count);
+
+    memcpy(results->mixed, verify_x, count * sizeof(float));
+    ng_batch_multiply_add_samples(results->mixed, verify_samples, 0.7f, count);
+
+    ng_batch_to_samples(results->samples, verify_values, count);
+}
+
+// The plain C path against what the header promises, it's what the others are compared to
+static int check_scalar_results(const batch_results_t *results, int count)
+{
+    int failures = 0, hits = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        SDL_FRect box = {verify_box_x[i], verify_box_y[i], verify_box_w[i], verify_box_h[i]};
+        bool overlaps = SDL_HasIntersectionF(&box, &verify_rect);
+        hits += overlaps;
+
+        if (results->overlaps[i] != overlaps)
+        {
+            fprintf(stderr, "batch_overlaps: box %d (%g, %g, %g, %g) doesn't agree with SDL_HasIntersectionF()\n",
+                    i, box.x, box.y, box.w, box.h);
+            failures++;
+        }
+
+        float magnitude = sqrtf(results->normal_x[i] * results->normal_x[i] +
+                                results->normal_y[i] * results->normal_y[i]);
+        bool is_zero = verify_x[i] == 0.0f && verify_y[i] == 0.0f;
+
+        if (is_zero ? magnitude != 0.0f : fabsf(magnitude - 1.0f) > 1e-5f)
+        {
+            fprintf(stderr, "batch_normalize: vector %d (%g, %g) ended up %g long\n",
+                    i, verify_x[i], verify_y[i], magnitude);
+            failures++;
+        }
+    }
+
+    if (results->hits != hits)
+    {
+        fprintf(stderr, "batch_overlaps: returned %d hits out of %d boxes, expected %d\n",
+                results->hits, count, hits);
+        failures++;
+    }
+
+    return failures;
+}
+
+static int compare_results(const char *function, const void *result, const void *expected,
+                           size_t size, const char *level, int count)
+{
+    if (memcmp(result, expected, size) == 0)
+        return 0;
+
+    fprintf(stderr, "%s: the %s path differs from the scalar one on %d items\n", function, level, count);
+    return 1;
+}
+
+// Every SIMD path has to give exactly the same results (and leave the same bytes alone) as plain C
+static int verify_batch_functions(void)
+{
+    static const char *level_names[] = {"scalar", "sse2", "avx2"};
+    static batch_results_t expected, results;
+    ng_simd_level_t best_level = ng_batch_get_level();
+    int failures = 0, lengths = 0;
+
+    create_verify_data();
+
+    // Every length that leaves a different amount of leftovers, then a long one
+    for (int count = 0; count <= VERIFY_COUNT; count = count < 17 ? count + 1 : VERIFY_COUNT)
+    {
+        ng_batch_set_level(NG_SIMD_SCALAR);
+        run_batch_functions(&expected, count);
+        failures += check_scalar_results(&expected, count);
+
+        for (int level = NG_SIMD_SCALAR + 1; level <= (int)best_level; level++)
+        {
+            const char *name = level_names[level];
+
+            ng_batch_set_level(level);
+            run_batch_functions(&results, count);
+
+#define COMPARE(function, field) \
+            failures += compare_results(function, &results.field, &expected.field, sizeof(results.field), name, count)
+
+            COMPARE("batch_add", sum);
+            COMPARE("batch_multiply_add", moved);
+            COMPARE("batch_normalize", normal_x);
+            COMPARE("batch_normalize", normal_y);
+            COMPARE("batch_distance", distance);
+            COMPARE("batch_overlaps", overlaps);
+            COMPARE("batch_overlaps", hits);
+            COMPARE("batch_multiply_add_samples", mixed);
+            COMPARE("batch_to_samples", samples);
+#undef COMPARE
+        }
+
+        lengths++;
+        if (count == VERIFY_COUNT)
+            break;
+    }
+
+    ng_batch_set_level(best_level);
+
+    printf("batch functions: %d lengths, scalar up to %s, %d failures\n", lengths, level_names[best_level], failures);
+    return failures;
+}
+
+// More frames than the profiler keeps, every one of them has to land within the run
+// on the trace's timeline, in the order they were recorded
+static int verify_profiler_trace(void)
+{
+#ifdef NG_NO_PROFILER
+    printf("profiler: compiled out, nothing to verify\n");
+    return 0;
+#else
+    int frames = NG_PROFILER_FRAMES + NG_PROFILER_FRAMES / 2;
+    uint64_t start = SDL_GetPerformanceCounter();
+
+    for (int n = 0; n < frames; n++)
+    {
+        ng_profiler_frame_begin();
+        NG_PROFILE_BEGIN("verify");
+        ng_profiler_count(NG_COUNTER_DRAW_CALLS, 1);
+        NG_PROFILE_END();
+        ng_profiler_frame_end();
+    }
+
+    // From within a frame, the way the game dumps them (F4)
+    ng_profiler_frame_begin();
+    bool is_dumped = ng_profiler_dump_trace(VERIFY_TRACE_PATH);
+    ng_profiler_frame_end();
+
+    double run_us = elapsed_seconds(start) * 1000000.0;
+
+    if (!is_dumped)
+    {
+        fprintf(stderr, "profiler: failed to write %s\n", VERIFY_TRACE_PATH);
+        return 1;
+    }
+
+    FILE *file = fopen(VERIFY_TRACE_PATH, "r");
+    if (file == NULL)
+        ng_die("failed to read back %s", VERIFY_TRACE_PATH);
+
+    // Every event is on a line of its own
+    char line[512];
+    int failures = 0, frame_events = 0;
+    double last_frame = 0.0;
+
+    while (fgets(line, sizeof(line), file))
+    {
+        const char *ts = strstr(line, "\"ts\":");
+        if (ts == NULL)
+            continue;
+
+        // A bit of slack for the rounding to nanoseconds
+        double timestamp = strtod(ts + strlen("\"ts\":"), NULL);
+        if (timestamp < 0.0 || timestamp > run_us + 1.0)
+        {
+            fprintf(stderr, "profiler: event at %.3f us, outside of the %.3f us the frames took\n",
+                    timestamp, run_us);
+            failures++;
+        }
+
+        if (strstr(line, "\"name\":\"frame\""))
+        {
+            if (timestamp < last_frame)
+            {
+                fprintf(stderr, "profiler: frame at %.3f us comes after one at %.3f us\n",
+                        timestamp, last_frame);
+                failures++;
+            }
+
+            last_frame = timestamp;
+            frame_events++;
+        }
+    }
+
+    fclose(file);
+    remove(VERIFY_TRACE_PATH);
+
+    if (frame_events != NG_PROFILER_FRAMES)
+    {
+        fprintf(stderr, "profiler: the trace has %d frames, expected the last %d\n",
+                frame_events, NG_PROFILER_FRAMES);
+        failures++;
+    }
+
+    printf("profiler: %d frames recorded, %d in the trace, %d failures\n", frames, frame_events, failures);
+    return failures;
+#endif
+}
+
+static void parse_arguments(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc)
+            sample_count = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+            filter = argv[++i];
+        else if (strcmp(argv[i], "--verify") == 0)
+            verify = true;
+        else
+        {
+            fprintf(stderr, "usage: %s [--samples N] [--filter SUBSTRING] [--verify]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (sample_count <= 0)
+        ng_die("the benchmarks need at least one sample");
+}
+
+int main(int argc, char **argv)
+{
+    parse_arguments(argc, argv);
+
+    // Nothing to draw, the game isn't needed
+    if (verify)
+    {
+        int failures = verify_batch_functions();
+        failures += verify_profiler_trace();
+
+        return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    ng_game_create_headless(&game, WIDTH, HEIGHT);
+    // The game's loop never runs here, its simulated time would never move
+    ng_timers_set_clock(NULL);
+    // Same data on every run, so revisions are compared on the same work
+    srand(1);
+
+    for (int i = 0; i < VECTOR_COUNT; i++)
+    {
+        vectors[i] = (ng_vec2){random_float(0, WIDTH), random_float(0, HEIGHT)};
+        velocities[i] = (ng_vec2){random_float(-100, 100), random_float(-100, 100)};
+
+        xs[i] = vectors[i].x;
+        ys[i] = vectors[i].y;
+        vxs[i] = velocities[i].x;
+        vys[i] = velocities[i].y;
+    }
+
+    for (int i = 0; i < BOX_COUNT; i++)
+    {
+        boxes[i] = (SDL_FRect){random_float(0, WIDTH), random_float(0, HEIGHT),
+                               random_float(8, 64), random_float(8, 64)};
+
+        box_x[i] = boxes[i].x;
+        box_y[i] = boxes[i].y;
+        box_w[i] = boxes[i].w;
+        box_h[i] = boxes[i].h;
+    }
+
+    run_benchmark("vec2_add", VECTOR_COUNT, bench_vec2_add, NULL);
+    run_benchmark("vec2_normalize", VECTOR_COUNT, bench_vec2_normalize, NULL);
+
+    // Every SIMD path the CPU has, from the slowest up
+    static const char *level_names[] = {"scalar", "sse2", "avx2"};
+    ng_simd_level_t best_level = ng_batch_get_level();
+
+    for (int level = NG_SIMD_SCALAR; level <= (int)best_level; level++)
+    {
+        char name[64];
+        ng_batch_set_level(level);
+
+        snprintf(name, sizeof(name), "batch_multiply_add_%s", level_names[level]);
+        run_benchmark(name, VECTOR_COUNT, bench_batch_multiply_add, NULL);
+
+        snprintf(name, sizeof(name), "batch_normalize_%s", level_names[level]);
+        run_benchmark(name, VECTOR_COUNT, bench_batch_normalize, NULL);
+
+        snprintf(name, sizeof(name), "aabb_batch_%s", level_names[level]);
+        run_benchmark(name, BOX_COUNT, bench_aabb_batch, NULL);
+    }
+
+    ng_batch_set_level(best_level);
+    run_benchmark("aabb_scalar", BOX_COUNT, bench_aabb_scalar, NULL);
+
+    ng_collision_world_t world;
+    ng_collision_create(&world, 64.0f);
+    collider_type = ng_collision_register_type(&world, 1, 1, 0, 0, 0, 0);
+    run_benchmark("collision_detect", COLLIDER_COUNT, bench_collision_detect, &world);
+    ng_collision_destroy(&world);
+
+    // A plain opaque texture, the software renderer still has to blit every pixel of it
+    static sprite_bench_t sprites;
+    SDL_Texture *texture = SDL_CreateTexture(game.renderer, SDL_PIXELFORMAT_RGBA8888,
+                                             SDL_TEXTUREACCESS_STATIC, 32, 32);
+    if (!texture)
+        ng_die("failed to create the benchmark texture");
+
+    for (int i = 0; i < SPRITE_COUNT; i++)
+    {
+        ng_sprite_create(&sprites.sprites[i], texture);
+        sprites.sprites[i].transform.x = boxes[i].x;
+        sprites.sprites[i].transform.y = boxes[i].y;
+    }
+
+    ng_sprite_batch_create(&sprites.batch);
+    run_benchmark("sprite_render", SPRITE_COUNT, bench_sprite_render, &sprites);
+    run_benchmark("sprite_batch_flush", SPRITE_COUNT, bench_sprite_batch, &sprites);
+
+    // Same thing with every other sprite off screen, like the game's draw lists
+    SDL_FRect screen = {0, 0, WIDTH, HEIGHT};
+    ng_sprite_batch_set_viewport(&sprites.batch, &screen);
+
+    for (int i = 0; i < SPRITE_COUNT; i += 2)
+        sprites.sprites[i].transform.x -= WIDTH + 64;
+
+    run_benchmark("sprite_batch_flush_culled", SPRITE_COUNT, bench_sprite_batch, &sprites);
+    ng_sprite_batch_destroy(&sprites.batch);
+    SDL_DestroyTexture(texture);
+
+    // Run from the repository's root, like the game
+    TTF_Font *font = TTF_OpenFont("assets/free_mono.ttf", 20);
+    if (!font)
+        ng_die("failed to open assets/free_mono.ttf, run the benchmarks from the repository's root");
+
+    ng_label_t label;
+    ng_label_create(&label, font, WIDTH / 2);
+    run_benchmark("label_set_content", 1, bench_label_set_content, &label);
+    ng_label_destroy(&label);
+    ng_glyph_cache_drop(font);
+    TTF_CloseFont(font);
+
+    for (int i = 0; i < INTERVAL_COUNT; i++)
+        ng_interval_create(&intervals[i], 100 + i);
+
+    run_benchmark("interval_is_ready", INTERVAL_COUNT, bench_interval_is_ready, NULL);
+
+    int fired = 0;
+    ng_scheduler_t scheduler;
+    ng_scheduler_create(&scheduler);
+
+    for (int i = 0; i < TIMER_COUNT; i++)
+        ng_scheduler_every(&scheduler, 100 + (i * 7) % 4000, count_fired, &fired);
+
+    run_benchmark("scheduler_advance", TIMER_COUNT, bench_scheduler_advance, &scheduler);
+    ng_scheduler_destroy(&scheduler);
+
+#ifndef NO_AUDIO
+    // The device's callback would be mixing on the same state
+    Mix_SetPostMix(NULL, NULL);
+#endif
+
+    // Noise, with lengths that don't line up with the mixer's blocks
+    static int16_t noise[MIXER_VOICES][4000 * 2];
+    ng_mixer_init(44100, 2);
+
+    for (int i = 0; i < MIXER_VOICES; i++)
+    {
+        int frame_count = 4000 - i * 37;
+
+        for (int j = 0; j < frame_count * 2; j++)
+            noise[i][j] = (int16_t)(rand() % 8192 - 4096);
+
+        ng_mixer_play(i, 1, noise[i], frame_count, -1, 0.5f, 0);
+    }
+
+    run_benchmark("mixer_post_mix", MIXER_FRAMES, bench_mixer_post_mix, NULL);
+
+    // The same voices again, decoded from ADPCM while mixing
+    static uint8_t compressed[MIXER_VOICES][4000 * 2];
+
+    for (int i = 0; i < MIXER_VOICES; i++)
+    {
+        int frame_count = 4000 - i * 37;
+
+        ng_adpcm_encode(compressed[i], noise[i], frame_count, 2);
+        ng_mixer_play_compressed(i, 2, compressed[i], frame_count, -1, 0.5f, 0);
+    }
+
+    run_benchmark("mixer_post_mix_adpcm", MIXER_FRAMES, bench_mixer_post_mix, NULL);
+
+    ng_game_destroy(&game);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,143 @@
+#include "adpcm.h"
+#include "common.h"
+#include <string.h>
+
+// Per channel: the first sample (16 bits), the step index and a padding byte,
+// then a nibble for each of the other samples (the last one is unused)
+#define CHANNEL_HEADER_SIZE 4
+#define CHANNEL_SIZE (CHANNEL_HEADER_SIZE + NG_ADPCM_BLOCK_FRAMES / 2)
+
+// The standard IMA tables, the step grows or shrinks depending on how big the last nibble was
+static const int16_t step_table[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+    253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+    3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487,
+    12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int8_t index_table[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8,
+    -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+size_t ng_adpcm_get_block_size(int channels)
+{
+    return (size_t)CHANNEL_SIZE * channels;
+}
+
+size_t ng_adpcm_get_encoded_size(int frame_count, int channels)
+{
+    size_t block_count = (frame_count + NG_ADPCM_BLOCK_FRAMES - 1) / NG_ADPCM_BLOCK_FRAMES;
+    return block_count * ng_adpcm_get_block_size(channels);
+}
+
+// Applies a nibble to the decoder's state, the encoder runs exactly this too
+// so that both sides always agree on the predicted sample
+static int decode_nibble(int nibble, int *predictor, int *index)
+{
+    int step = step_table[*index];
+    int delta = step >> 3;
+
+    if (nibble & 4)
+        delta += step;
+    if (nibble & 2)
+        delta += step >> 1;
+    if (nibble & 1)
+        delta += step >> 2;
+
+    *predictor += (nibble & 8) ? -delta : delta;
+    *predictor = CLAMP(*predictor, -32768, 32767);
+    *index = CLAMP(*index + index_table[nibble], 0, 88);
+
+    return *predictor;
+}
+
+static int encode_nibble(int sample, int *predictor, int *index)
+{
+    int step = step_table[*index];
+    int difference = sample - *predictor;
+    int nibble = 0;
+
+    if (difference < 0)
+    {
+        nibble = 8;
+        difference = -difference;
+    }
+
+    // Three bits of the difference in units of the step, the same rounding the decoder does
+    if (difference >= step)
+    {
+        nibble |= 4;
+        difference -= step;
+    }
+
+    if (difference >= step >> 1)
+    {
+        nibble |= 2;
+        difference -= step >> 1;
+    }
+
+    if (difference >= step >> 2)
+        nibble |= 1;
+
+    decode_nibble(nibble, predictor, index);
+    return nibble;
+}
+
+void ng_adpcm_encode(uint8_t *result, const int16_t *samples, int frame_count, int channels)
+{
+    size_t block_size = ng_adpcm_get_block_size(channels);
+    int block_count = (frame_count + NG_ADPCM_BLOCK_FRAMES - 1) / NG_ADPCM_BLOCK_FRAMES;
+
+    memset(result, 0, block_size * block_count);
+
+    for (int channel = 0; channel < channels; channel++)
+    {
+        // The step size carries over from one block to the next, it has already adapted
+        int index = 0;
+
+        for (int block = 0; block < block_count; block++)
+        {
+            uint8_t *data = result + block * block_size + channel * CHANNEL_SIZE;
+            int first = block * NG_ADPCM_BLOCK_FRAMES;
+            int predictor = samples[first * channels + channel];
+
+            data[0] = (uint8_t)(predictor & 0xff);
+            data[1] = (uint8_t)((predictor >> 8) & 0xff);
+            data[2] = (uint8_t)index;
+
+            // The first sample is in the header already
+            for (int i = 1; i < NG_ADPCM_BLOCK_FRAMES; i++)
+            {
+                int frame = first + i;
+                int sample = frame < frame_count ? samples[frame * channels + channel] : 0;
+                int nibble = encode_nibble(sample, &predictor, &index);
+
+                // Low nibble first
+                data[CHANNEL_HEADER_SIZE + (i - 1) / 2] |= (uint8_t)(nibble << (((i - 1) & 1) * 4));
+            }
+        }
+    }
+}
+
+void ng_adpcm_decode_block(int16_t *result, const uint8_t *blocks, int block, int channels)
+{
+    const uint8_t *start = blocks + block * ng_adpcm_get_block_size(channels);
+
+    for (int channel = 0; channel < channels; channel++)
+    {
+        const uint8_t *data = start + channel * CHANNEL_SIZE;
+        int predictor = (int16_t)(data[0] | (data[1] << 8));
+        int index = data[2];
+
+        result[channel] = (int16_t)predictor;
+
+        for (int i = 1; i < NG_ADPCM_BLOCK_FRAMES; i++)
+        {
+            int nibble = (data[CHANNEL_HEADER_SIZE + (i - 1) / 2] >> (((i - 1) & 1) * 4)) & 0xf;
+            result[i * channels + channel] = (int16_t)decode_nibble(nibble, &predictor, &index);
+        }
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef _NG_ADPCM_H
+#define _NG_ADPCM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * IMA ADPCM, 4 bits per sample instead of 16. It's lossy, but hard to hear on
+ * sound effects, and cheap enough to decode while mixing (see mixer.c)
+ *
+ * Samples are split into blocks of NG_ADPCM_BLOCK_FRAMES frames. Each block holds,
+ * for every channel, a small header (the exact first sample and the step size)
+ * followed by the nibbles of the rest, so any block can be decoded on its own and a voice can
+ * start or loop anywhere without decoding what comes before
+ */
+#define NG_ADPCM_BLOCK_FRAMES 128
+
+// Bytes of one block, all channels included
+size_t ng_adpcm_get_block_size(int channels);
+size_t ng_adpcm_get_encoded_size(int frame_count, int channels);
+
+// Encodes interleaved 16 bit samples, result has to hold ng_adpcm_get_encoded_size() bytes
+// The last block is padded with silence
+void ng_adpcm_encode(uint8_t *result, const int16_t *samples, int frame_count, int channels);
+
+// Decodes a whole block, result has to hold NG_ADPCM_BLOCK_FRAMES interleaved frames
+void ng_adpcm_decode_block(int16_t *result, const uint8_t *blocks, int block, int channels);
+
+#endif
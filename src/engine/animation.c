@@ -0,0 +1,114 @@
+#include "animation.h"
+#include "common.h"
+
+void ng_animation_start(ng_animation_t *animation, const ng_animation_clip_t *clip,
+                        ng_animated_sprite_t *sprite)
+{
+    // A frame that never ends would make advancing spin forever
+    if (clip)
+    {
+        for (int i = 0; i < clip->frame_count; i++)
+        {
+            float duration = clip->durations ? clip->durations[i] : clip->frame_duration;
+
+            if (duration <= 0.0f)
+                ng_die("animation clip frames need to last longer than zero seconds");
+        }
+    }
+
+    animation->clip = clip;
+    animation->sprite = sprite;
+
+    ng_animation_restart(animation);
+}
+
+void ng_animation_restart(ng_animation_t *animation)
+{
+    animation->frame = 0;
+    animation->time = 0.0f;
+    animation->direction = 1;
+    animation->is_finished = false;
+
+    if (animation->sprite)
+        ng_animated_set_frame(animation->sprite, 0);
+}
+
+static float get_duration(const ng_animation_clip_t *clip, int frame)
+{
+    return clip->durations ? clip->durations[frame] : clip->frame_duration;
+}
+
+// Moves to the next frame, returns false if a NG_ANIMATION_ONCE clip just ended instead
+static bool next_frame(ng_animation_t *animation)
+{
+    const ng_animation_clip_t *clip = animation->clip;
+
+    switch (clip->mode)
+    {
+    case NG_ANIMATION_LOOP:
+        animation->frame = (animation->frame + 1) % clip->frame_count;
+        return true;
+
+    case NG_ANIMATION_ONCE:
+        if (animation->frame == clip->frame_count - 1)
+            return false;
+
+        animation->frame++;
+        return true;
+
+    case NG_ANIMATION_PING_PONG:
+        if (clip->frame_count == 1)
+            return true;
+
+        // Turn around at either end without showing the end frame twice
+        if (animation->frame + animation->direction < 0 ||
+            animation->frame + animation->direction >= clip->frame_count)
+            animation->direction = -animation->direction;
+
+        animation->frame += animation->direction;
+        return true;
+    }
+
+    return true;
+}
+
+bool ng_animation_advance(ng_animation_t *animation, float delta)
+{
+    const ng_animation_clip_t *clip = animation->clip;
+
+    if (clip == NULL || animation->is_finished)
+        return false;
+
+    animation->time += delta;
+
+    // A long step can go through several frames, so a slow tick rate
+    // doesn't slow down the animation
+    while (animation->time >= get_duration(clip, animation->frame))
+    {
+        float duration = get_duration(clip, animation->frame);
+
+        if (!next_frame(animation))
+        {
+            animation->is_finished = true;
+            animation->time = 0.0f;
+            break;
+        }
+
+        animation->time -= duration;
+    }
+
+    if (animation->sprite && animation->sprite->frame != animation->frame)
+        ng_animated_set_frame(animation->sprite, animation->frame);
+
+    return animation->is_finished;
+}
+
+int ng_animation_advance_all(ng_animation_t *animations, int count, float delta)
+{
+    int finished = 0;
+
+    for (int i = 0; i < count; i++)
+        finished += ng_animation_advance(&animations[i], delta);
+
+    return finished;
+}
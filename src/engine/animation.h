@@ -0,0 +1,57 @@
+#ifndef _NG_ANIMATION_H
+#define _NG_ANIMATION_H
+
+#include <stdbool.h>
+#include "sprite.h"
+
+typedef enum
+{
+    // Starts over after the last frame
+    NG_ANIMATION_LOOP,
+    // Stops on the last frame and reports that it finished
+    NG_ANIMATION_ONCE,
+    // Goes back and forth between the first and the last frame
+    NG_ANIMATION_PING_PONG
+} ng_animation_mode_t;
+
+// How an animation plays, shared by everything that plays it
+typedef struct
+{
+    int frame_count;
+    ng_animation_mode_t mode;
+
+    // Seconds every frame stays on screen, unless durations says otherwise
+    float frame_duration;
+    // Optional, one duration per frame
+    const float *durations;
+} ng_animation_clip_t;
+
+// One playing clip. It updates the sprite's frame by itself, or only keeps
+// track of the frame when there's no sprite (e.g. entities sharing a template)
+typedef struct
+{
+    const ng_animation_clip_t *clip;
+    ng_animated_sprite_t *sprite;
+
+    int frame;
+    // Time spent on the current frame
+    float time;
+    // 1 or -1, only ping-pong clips ever go backwards
+    int direction;
+
+    // Set once a NG_ANIMATION_ONCE clip is done, until it gets restarted
+    bool is_finished;
+} ng_animation_t;
+
+// NOTE: The sprite can be NULL, so can the clip (the animation then just stays on frame 0)
+void ng_animation_start(ng_animation_t *animation, const ng_animation_clip_t *clip,
+                        ng_animated_sprite_t *sprite);
+// Back to the first frame of the same clip
+void ng_animation_restart(ng_animation_t *animation);
+
+// Returns true when a NG_ANIMATION_ONCE clip finishes during this step
+bool ng_animation_advance(ng_animation_t *animation, float delta);
+// Same thing for a whole array in a single pass, returns how many of them finished
+int ng_animation_advance_all(ng_animation_t *animations, int count, float delta);
+
+#endif
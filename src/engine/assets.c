@@ -0,0 +1,415 @@
+#include "assets.h"
+#include "audio.h"
+#include "common.h"
+#include "interface.h"
+#include "pack.h"
+#include <SDL2/SDL_image.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_BUCKETS 64
+
+static struct
+{
+    SDL_Renderer *renderer;
+
+    ng_asset_t **buckets;
+    size_t bucket_count;
+    size_t asset_count;
+
+    size_t resident_bytes;
+
+    // Assets being decoded in the background
+    ng_asset_t **pending;
+    int pending_count, pending_capacity;
+    // Preloads requested and finished since the last time nothing was loading
+    int requested, completed;
+} registry;
+
+void ng_assets_init(SDL_Renderer *renderer)
+{
+    registry.renderer = renderer;
+    registry.bucket_count = INITIAL_BUCKETS;
+    registry.asset_count = 0;
+    registry.resident_bytes = 0;
+
+    registry.pending = NULL;
+    registry.pending_count = registry.pending_capacity = 0;
+    registry.requested = registry.completed = 0;
+
+    registry.buckets = calloc(registry.bucket_count, sizeof(ng_asset_t*));
+    if (!registry.buckets)
+        ng_die("ran out of memory while creating the asset registry");
+}
+
+// FNV-1a over the whole key
+static size_t hash_key(ng_asset_kind_t kind, const char *path, int parameter)
+{
+    uint32_t hash = 2166136261u;
+
+    for (const char *c = path; *c; c++)
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+
+    hash = (hash ^ (uint32_t)kind) * 16777619u;
+    hash = (hash ^ (uint32_t)parameter) * 16777619u;
+
+    return hash;
+}
+
+static void grow_table(void)
+{
+    size_t bucket_count = registry.bucket_count * 2;
+    ng_asset_t **buckets = calloc(bucket_count, sizeof(ng_asset_t*));
+
+    if (!buckets)
+        ng_die("ran out of memory while growing the asset registry");
+
+    for (size_t i = 0; i < registry.bucket_count; i++)
+    {
+        ng_asset_t *asset = registry.buckets[i];
+
+        while (asset)
+        {
+            ng_asset_t *next = asset->next;
+            size_t bucket = hash_key(asset->kind, asset->path, asset->parameter) % bucket_count;
+
+            asset->next = buckets[bucket];
+            buckets[bucket] = asset;
+            asset = next;
+        }
+    }
+
+    free(registry.buckets);
+    registry.buckets = buckets;
+    registry.bucket_count = bucket_count;
+}
+
+ng_asset_t* ng_assets_acquire(ng_asset_kind_t kind, const char *path, int parameter)
+{
+    if (!registry.buckets)
+        ng_die("the asset registry has to be initialized before acquiring %s", path);
+
+    size_t bucket = hash_key(kind, path, parameter) % registry.bucket_count;
+
+    for (ng_asset_t *asset = registry.buckets[bucket]; asset; asset = asset->next)
+        if (asset->kind == kind && asset->parameter == parameter && strcmp(asset->path, path) == 0)
+        {
+            asset->references++;
+            return asset;
+        }
+
+    // Keep the chains short
+    if (registry.asset_count >= registry.bucket_count)
+    {
+        grow_table();
+        bucket = hash_key(kind, path, parameter) % registry.bucket_count;
+    }
+
+    ng_asset_t *asset = calloc(1, sizeof(ng_asset_t));
+    if (!asset)
+        ng_die("ran out of memory while acquiring %s", path);
+
+    asset->kind = kind;
+    asset->path = strdup(path);
+    asset->parameter = parameter;
+    asset->references = 1;
+
+    asset->next = registry.buckets[bucket];
+    registry.buckets[bucket] = asset;
+    registry.asset_count++;
+
+    return asset;
+}
+
+static void mark_loaded(ng_asset_t *asset)
+{
+    asset->state = NG_ASSET_LOADED;
+    registry.resident_bytes += asset->bytes;
+}
+
+static void load(ng_asset_t *asset)
+{
+    switch (asset->kind)
+    {
+    case NG_ASSET_TEXTURE:
+    {
+        asset->texture = IMG_LoadTexture_RW(registry.renderer, ng_pack_open(asset->path), 1);
+        if (!asset->texture)
+            ng_die("failed to load texture %s: %s", asset->path, IMG_GetError());
+
+        int w, h;
+        SDL_QueryTexture(asset->texture, NULL, NULL, &w, &h);
+        asset->bytes = (size_t)w * h * 4;
+        break;
+    }
+    case NG_ASSET_FONT:
+    {
+        SDL_RWops *file = ng_pack_open(asset->path);
+        // Fonts keep reading glyphs from their file, so this is only an approximation
+        asset->bytes = file ? SDL_RWsize(file) : 0;
+
+        asset->font = TTF_OpenFontRW(file, 1, asset->parameter);
+        if (!asset->font)
+            ng_die("failed to load font %s: %s", asset->path, TTF_GetError());
+        break;
+    }
+    case NG_ASSET_CHUNK:
+        asset->chunk = ng_audio_load(asset->path, asset->parameter);
+#ifndef NO_AUDIO
+        asset->bytes = asset->chunk->alen;
+#endif
+        break;
+    case NG_ASSET_MUSIC:
+        asset->music = ng_music_load(asset->path);
+        break;
+    }
+
+    mark_loaded(asset);
+}
+
+void ng_assets_preload(ng_asset_t *asset)
+{
+    if (asset->state != NG_ASSET_UNLOADED)
+        return;
+
+    if (asset->kind != NG_ASSET_TEXTURE && asset->kind != NG_ASSET_CHUNK)
+    {
+        load(asset);
+        return;
+    }
+
+    if (registry.pending_count == registry.pending_capacity)
+    {
+        registry.pending_capacity = MAX(16, registry.pending_capacity * 2);
+        registry.pending = realloc(registry.pending, registry.pending_capacity * sizeof(ng_asset_t*));
+
+        if (!registry.pending)
+            ng_die("ran out of memory while preloading %s", asset->path);
+    }
+
+    asset->job = ng_loader_submit(asset->kind == NG_ASSET_TEXTURE ? NG_JOB_IMAGE : NG_JOB_CHUNK,
+                                  asset->path, asset->parameter);
+    asset->state = NG_ASSET_LOADING;
+
+    registry.pending[registry.pending_count++] = asset;
+    registry.requested++;
+}
+
+// Waits for the decoded data if needed, then finishes the asset on this thread
+static void finish(ng_asset_t *asset)
+{
+    ng_loader_wait(asset->job);
+
+    if (asset->kind == NG_ASSET_TEXTURE)
+    {
+        SDL_Surface *surface = asset->job->surface;
+        if (!surface)
+            ng_die("failed to load texture %s: %s", asset->path, asset->job->error);
+
+        asset->texture = SDL_CreateTextureFromSurface(registry.renderer, surface);
+        asset->bytes = (size_t)surface->w * surface->h * 4;
+        SDL_FreeSurface(surface);
+
+        if (!asset->texture)
+            ng_die("failed to upload texture %s: %s", asset->path, SDL_GetError());
+    }
+    else
+    {
+        asset->chunk = asset->job->chunk;
+#ifndef NO_AUDIO
+        asset->bytes = asset->chunk->alen;
+#endif
+    }
+
+    ng_loader_free_job(asset->job);
+    asset->job = NULL;
+    mark_loaded(asset);
+
+    for (int i = 0; i < registry.pending_count; i++)
+        if (registry.pending[i] == asset)
+        {
+            registry.pending[i] = registry.pending[--registry.pending_count];
+            break;
+        }
+
+    registry.completed++;
+    if (registry.pending_count == 0)
+        registry.requested = registry.completed = 0;
+}
+
+void ng_assets_pump(void)
+{
+    // Backwards, since finishing an asset swaps the last pending one into its place
+    for (int i = registry.pending_count - 1; i >= 0; i--)
+        if (ng_loader_is_done(registry.pending[i]->job))
+            finish(registry.pending[i]);
+}
+
+float ng_assets_get_progress(void)
+{
+    if (registry.requested == 0)
+        return 1.0f;
+
+    return (float)registry.completed / registry.requested;
+}
+
+bool ng_assets_is_loading(void)
+{
+    return registry.pending_count > 0;
+}
+
+void ng_assets_finish_loading(void)
+{
+    while (registry.pending_count > 0)
+        finish(registry.pending[registry.pending_count - 1]);
+}
+
+// Can't cancel a decode that's already running, waits for it and throws the result away
+static void discard(ng_asset_t *asset)
+{
+    ng_loader_wait(asset->job);
+
+    if (asset->kind == NG_ASSET_TEXTURE)
+        SDL_FreeSurface(asset->job->surface);
+#ifndef NO_AUDIO
+    else if (asset->job->chunk)
+        Mix_FreeChunk(asset->job->chunk);
+#endif
+
+    ng_loader_free_job(asset->job);
+    asset->job = NULL;
+    asset->state = NG_ASSET_UNLOADED;
+
+    for (int i = 0; i < registry.pending_count; i++)
+        if (registry.pending[i] == asset)
+        {
+            registry.pending[i] = registry.pending[--registry.pending_count];
+            break;
+        }
+
+    // It's never going to complete, the progress shouldn't wait for it
+    registry.requested--;
+    if (registry.pending_count == 0)
+        registry.requested = registry.completed = 0;
+}
+
+static void unload(ng_asset_t *asset)
+{
+    // Nobody needs it anymore, no point in uploading it
+    if (asset->state == NG_ASSET_LOADING)
+    {
+        discard(asset);
+        return;
+    }
+
+    if (asset->state != NG_ASSET_LOADED)
+        return;
+
+    switch (asset->kind)
+    {
+    case NG_ASSET_TEXTURE:
+        SDL_DestroyTexture(asset->texture);
+        break;
+    case NG_ASSET_FONT:
+        // Labels drawn with this font point into its glyph atlas
+        ng_glyph_cache_drop(asset->font);
+        TTF_CloseFont(asset->font);
+        break;
+    case NG_ASSET_CHUNK:
+#ifndef NO_AUDIO
+        // Halts the voices still playing it
+        ng_audio_drop(asset->chunk);
+        Mix_FreeChunk(asset->chunk);
+#endif
+        break;
+    case NG_ASSET_MUSIC:
+#ifndef NO_AUDIO
+        Mix_FreeMusic(asset->music);
+#endif
+        break;
+    }
+
+    registry.resident_bytes -= asset->bytes;
+    asset->bytes = 0;
+    asset->state = NG_ASSET_UNLOADED;
+}
+
+void ng_asset_release(ng_asset_t *asset)
+{
+    if (--asset->references > 0)
+        return;
+
+    size_t bucket = hash_key(asset->kind, asset->path, asset->parameter) % registry.bucket_count;
+    ng_asset_t **link = &registry.buckets[bucket];
+
+    while (*link != asset)
+        link = &(*link)->next;
+
+    *link = asset->next;
+    registry.asset_count--;
+
+    unload(asset);
+    free(asset->path);
+    free(asset);
+}
+
+static ng_asset_t* use(ng_asset_t *asset, ng_asset_kind_t kind)
+{
+    if (asset->kind != kind)
+        ng_die("%s was acquired as a different kind of asset", asset->path);
+
+    if (asset->state == NG_ASSET_LOADING)
+        finish(asset);
+    else if (asset->state == NG_ASSET_UNLOADED)
+        load(asset);
+
+    return asset;
+}
+
+SDL_Texture* ng_asset_texture(ng_asset_t *asset)
+{
+    return use(asset, NG_ASSET_TEXTURE)->texture;
+}
+
+TTF_Font* ng_asset_font(ng_asset_t *asset)
+{
+    return use(asset, NG_ASSET_FONT)->font;
+}
+
+Mix_Chunk* ng_asset_chunk(ng_asset_t *asset)
+{
+    return use(asset, NG_ASSET_CHUNK)->chunk;
+}
+
+Mix_Music* ng_asset_music(ng_asset_t *asset)
+{
+    return use(asset, NG_ASSET_MUSIC)->music;
+}
+
+size_t ng_assets_get_resident_bytes(void)
+{
+    return registry.resident_bytes;
+}
+
+void ng_assets_shutdown(void)
+{
+    for (size_t i = 0; i < registry.bucket_count; i++)
+    {
+        ng_asset_t *asset = registry.buckets[i];
+
+        while (asset)
+        {
+            ng_asset_t *next = asset->next;
+
+            unload(asset);
+            free(asset->path);
+            free(asset);
+
+            asset = next;
+        }
+    }
+
+    free(registry.buckets);
+    free(registry.pending);
+    memset(&registry, 0, sizeof(registry));
+}
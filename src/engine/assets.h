@@ -0,0 +1,91 @@
+#ifndef _NG_ASSETS_H
+#define _NG_ASSETS_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+#include <SDL2/SDL_mixer.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "loader.h"
+
+typedef enum
+{
+    NG_ASSET_TEXTURE,
+    NG_ASSET_FONT,
+    NG_ASSET_CHUNK,
+    NG_ASSET_MUSIC
+} ng_asset_kind_t;
+
+typedef enum
+{
+    NG_ASSET_UNLOADED,
+    // Being decoded in the background, see ng_assets_preload()
+    NG_ASSET_LOADING,
+    NG_ASSET_LOADED
+} ng_asset_state_t;
+
+// Handles are shared: acquiring the same thing twice returns the same asset
+typedef struct ng_asset_t
+{
+    ng_asset_kind_t kind;
+    char *path;
+    // Tells apart variants of the same file, e.g. the point size of fonts
+    // or how sound effects are stored (see ng_audio_storage_t)
+    int parameter;
+
+    int references;
+    ng_asset_state_t state;
+    // Only set while the asset is loading in the background
+    ng_load_job_t *job;
+    // Rough amount of memory the loaded asset takes
+    size_t bytes;
+
+    union
+    {
+        TTF_Font *font;
+        SDL_Texture *texture;
+        Mix_Chunk *chunk;
+        Mix_Music *music;
+    };
+
+    // Next asset in the same hash table bucket
+    struct ng_asset_t *next;
+} ng_asset_t;
+
+/*
+ * Every asset is looked up in a hash table keyed by (kind, path, parameter), so that
+ * identical textures, fonts and sounds are only ever loaded once. Acquiring only takes
+ * a reference, the actual loading happens the first time the asset is used, and
+ * releasing the last reference frees it. Only what's in use stays resident
+ */
+void ng_assets_init(SDL_Renderer *renderer);
+// Frees everything, even assets that still have references
+// ng_game_destroy() calls it, before the renderer goes away
+void ng_assets_shutdown(void);
+
+ng_asset_t* ng_assets_acquire(ng_asset_kind_t kind, const char *path, int parameter);
+void ng_asset_release(ng_asset_t *asset);
+
+// Starts decoding textures and sound effects on the loader's worker threads
+// Fonts and music are cheap to open, so they are simply loaded right away
+void ng_assets_preload(ng_asset_t *asset);
+// Turns finished background loads into usable assets (textures get uploaded here)
+// The game loop calls it every frame, it must run on the render thread
+void ng_assets_pump(void);
+
+// Progress of the background loads in [0, 1], 1 when nothing is loading
+float ng_assets_get_progress(void);
+bool ng_assets_is_loading(void);
+// Blocks until every background load has finished
+void ng_assets_finish_loading(void);
+
+// These load the asset if it isn't already (and wait for it if it's still loading)
+SDL_Texture* ng_asset_texture(ng_asset_t *asset);
+TTF_Font* ng_asset_font(ng_asset_t *asset);
+Mix_Chunk* ng_asset_chunk(ng_asset_t *asset);
+Mix_Music* ng_asset_music(ng_asset_t *asset);
+
+// Sum of the (estimated) sizes of all loaded assets
+size_t ng_assets_get_resident_bytes(void);
+
+#endif
@@ -0,0 +1,306 @@
+#include "atlas.h"
+#include "common.h"
+#include <SDL2/SDL_image.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Empty pixels between packed frames, so that filtering never bleeds into neighbours
+#define PADDING 1
+
+void ng_atlas_create(ng_atlas_t *atlas, int page_size)
+{
+    atlas->sheets = NULL;
+    atlas->sheet_count = atlas->sheet_capacity = 0;
+
+    atlas->regions = NULL;
+    atlas->region_count = 0;
+
+    atlas->pages = NULL;
+    atlas->page_count = 0;
+    atlas->page_size = page_size;
+
+    atlas->is_built = false;
+}
+
+void ng_atlas_add_strip(ng_atlas_t *atlas, const char *path, int total_frames)
+{
+    if (atlas->is_built)
+        ng_die("can't add %s to the atlas, it has already been built", path);
+
+    if (atlas->sheet_count == atlas->sheet_capacity)
+    {
+        atlas->sheet_capacity = MAX(16, atlas->sheet_capacity * 2);
+        atlas->sheets = realloc(atlas->sheets, atlas->sheet_capacity * sizeof(ng_atlas_sheet_t));
+
+        if (!atlas->sheets)
+            ng_die("ran out of memory while adding %s to the atlas", path);
+    }
+
+    ng_atlas_sheet_t *sheet = &atlas->sheets[atlas->sheet_count++];
+    sheet->path = strdup(path);
+    sheet->job = ng_loader_submit(NG_JOB_IMAGE, path, 0);
+    sheet->surface = NULL;
+    sheet->total_frames = total_frames;
+    sheet->first_region = atlas->region_count;
+
+    atlas->region_count += total_frames;
+}
+
+bool ng_atlas_is_ready(ng_atlas_t *atlas)
+{
+    for (int i = 0; i < atlas->sheet_count; i++)
+        if (atlas->sheets[i].job && !ng_loader_is_done(atlas->sheets[i].job))
+            return false;
+
+    return true;
+}
+
+float ng_atlas_get_progress(ng_atlas_t *atlas)
+{
+    if (atlas->sheet_count == 0)
+        return 1.0f;
+
+    int decoded = 0;
+    for (int i = 0; i < atlas->sheet_count; i++)
+        decoded += !atlas->sheets[i].job || ng_loader_is_done(atlas->sheets[i].job);
+
+    return (float)decoded / atlas->sheet_count;
+}
+
+static void finish_sheet(ng_atlas_sheet_t *sheet)
+{
+    ng_loader_wait(sheet->job);
+
+    SDL_Surface *loaded = sheet->job->surface;
+
+    if (!loaded)
+        ng_die("failed to load sprite sheet %s: %s", sheet->path, sheet->job->error);
+
+    ng_loader_free_job(sheet->job);
+    sheet->job = NULL;
+
+    // A known pixel format makes finding the transparent borders trivial
+    sheet->surface = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_RGBA32, 0);
+    SDL_FreeSurface(loaded);
+
+    if (!sheet->surface)
+        ng_die("failed to convert sprite sheet %s: %s", sheet->path, SDL_GetError());
+}
+
+static bool is_transparent(SDL_Surface *surface, int x, int y)
+{
+    // RGBA32 always stores the alpha in the fourth byte
+    Uint8 *pixel = (Uint8*)surface->pixels + y * surface->pitch + x * 4;
+    return pixel[3] == 0;
+}
+
+// Shrinks the frame's rectangle down to its visible pixels
+static void trim_frame(SDL_Surface *surface, SDL_Rect frame, ng_atlas_region_t *region)
+{
+    int min_x = frame.x + frame.w, min_y = frame.y + frame.h;
+    int max_x = frame.x - 1, max_y = frame.y - 1;
+
+    for (int y = frame.y; y < frame.y + frame.h; y++)
+        for (int x = frame.x; x < frame.x + frame.w; x++)
+            if (!is_transparent(surface, x, y))
+            {
+                min_x = MIN(min_x, x);
+                min_y = MIN(min_y, y);
+                max_x = MAX(max_x, x);
+                max_y = MAX(max_y, y);
+            }
+
+    region->source_w = frame.w;
+    region->source_h = frame.h;
+
+    // Fully transparent frames still keep a single pixel, so they remain valid rectangles
+    if (max_x < min_x)
+    {
+        min_x = max_x = frame.x;
+        min_y = max_y = frame.y;
+    }
+
+    region->offset_x = min_x - frame.x;
+    region->offset_y = min_y - frame.y;
+
+    // Until the frame gets packed, rect holds its trimmed position inside the sheet
+    region->rect.x = min_x;
+    region->rect.y = min_y;
+    region->rect.w = max_x - min_x + 1;
+    region->rect.h = max_y - min_y + 1;
+}
+
+// Frames are packed tallest first, which keeps the shelves tight
+static ng_atlas_region_t *sort_regions;
+
+static int compare_heights(const void *a, const void *b)
+{
+    const ng_atlas_region_t *first = &sort_regions[*(const int*)a];
+    const ng_atlas_region_t *second = &sort_regions[*(const int*)b];
+
+    if (first->rect.h != second->rect.h)
+        return second->rect.h - first->rect.h;
+
+    return second->rect.w - first->rect.w;
+}
+
+static SDL_Surface* create_page(ng_atlas_t *atlas)
+{
+    SDL_Surface *page = SDL_CreateRGBSurfaceWithFormat(0, atlas->page_size, atlas->page_size,
+                                                       32, SDL_PIXELFORMAT_RGBA32);
+    if (!page)
+        ng_die("failed to create an atlas page: %s", SDL_GetError());
+
+    SDL_FillRect(page, NULL, 0);
+    return page;
+}
+
+static void upload_page(ng_atlas_t *atlas, SDL_Renderer *renderer, SDL_Surface *page)
+{
+    SDL_Texture *texture = SDL_CreateTextureFromSurface(renderer, page);
+    if (!texture)
+        ng_die("failed to upload an atlas page: %s", SDL_GetError());
+
+    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+
+    atlas->pages = realloc(atlas->pages, (atlas->page_count + 1) * sizeof(SDL_Texture*));
+    if (!atlas->pages)
+        ng_die("ran out of memory while building the atlas");
+
+    atlas->pages[atlas->page_count++] = texture;
+    SDL_FreeSurface(page);
+}
+
+void ng_atlas_build(ng_atlas_t *atlas, SDL_Renderer *renderer)
+{
+    SDL_RendererInfo info;
+    if (SDL_GetRendererInfo(renderer, &info) == 0 && info.max_texture_width > 0)
+        atlas->page_size = MIN(atlas->page_size, MIN(info.max_texture_width, info.max_texture_height));
+
+    atlas->regions = calloc(atlas->region_count, sizeof(ng_atlas_region_t));
+    // Which sheet every region was cut from
+    int *owners = malloc(atlas->region_count * sizeof(int));
+    int *order = malloc(atlas->region_count * sizeof(int));
+    // Which page every region ends up on, their textures don't exist until the end
+    int *pages = malloc(atlas->region_count * sizeof(int));
+
+    if (!atlas->regions || !owners || !order || !pages)
+        ng_die("ran out of memory while building the atlas");
+
+    for (int i = 0; i < atlas->sheet_count; i++)
+    {
+        ng_atlas_sheet_t *sheet = &atlas->sheets[i];
+        finish_sheet(sheet);
+
+        int frame_w = sheet->surface->w / sheet->total_frames;
+
+        for (int frame = 0; frame < sheet->total_frames; frame++)
+        {
+            SDL_Rect bounds = {frame * frame_w, 0, frame_w, sheet->surface->h};
+            trim_frame(sheet->surface, bounds, &atlas->regions[sheet->first_region + frame]);
+            owners[sheet->first_region + frame] = i;
+        }
+    }
+
+    for (int i = 0; i < atlas->region_count; i++)
+        order[i] = i;
+
+    sort_regions = atlas->regions;
+    qsort(order, atlas->region_count, sizeof(int), compare_heights);
+
+    // Shelf packing: fill rows from left to right, start a new row when one is full
+    // and a new page when the rows don't fit anymore
+    SDL_Surface *page = create_page(atlas);
+    int shelf_x = PADDING, shelf_y = PADDING, shelf_h = 0;
+
+    for (int i = 0; i < atlas->region_count; i++)
+    {
+        ng_atlas_region_t *region = &atlas->regions[order[i]];
+        SDL_Surface *sheet = atlas->sheets[owners[order[i]]].surface;
+
+        if (region->rect.w + 2 * PADDING > atlas->page_size || region->rect.h + 2 * PADDING > atlas->page_size)
+            ng_die("a frame of %s doesn't fit inside a %dpx atlas page",
+                   atlas->sheets[owners[order[i]]].path, atlas->page_size);
+
+        if (shelf_x + region->rect.w + PADDING > atlas->page_size)
+        {
+            shelf_x = PADDING;
+            shelf_y += shelf_h + PADDING;
+            shelf_h = 0;
+        }
+
+        if (shelf_y + region->rect.h + PADDING > atlas->page_size)
+        {
+            upload_page(atlas, renderer, page);
+            page = create_page(atlas);
+            shelf_x = shelf_y = PADDING;
+            shelf_h = 0;
+        }
+
+        // Copy the pixels as they are, without blending them against the empty page
+        SDL_Rect target = {shelf_x, shelf_y, region->rect.w, region->rect.h};
+        SDL_SetSurfaceBlendMode(sheet, SDL_BLENDMODE_NONE);
+        SDL_BlitSurface(sheet, &region->rect, page, &target);
+
+        region->rect = target;
+        pages[order[i]] = atlas->page_count;
+
+        shelf_x += region->rect.w + PADDING;
+        shelf_h = MAX(shelf_h, region->rect.h);
+    }
+
+    upload_page(atlas, renderer, page);
+
+    for (int i = 0; i < atlas->region_count; i++)
+        atlas->regions[i].texture = atlas->pages[pages[i]];
+
+    // The pixels live on the GPU now
+    for (int i = 0; i < atlas->sheet_count; i++)
+    {
+        SDL_FreeSurface(atlas->sheets[i].surface);
+        atlas->sheets[i].surface = NULL;
+    }
+
+    free(owners);
+    free(order);
+    free(pages);
+    atlas->is_built = true;
+}
+
+const ng_atlas_region_t* ng_atlas_get_frames(ng_atlas_t *atlas, const char *path)
+{
+    if (!atlas->is_built)
+        ng_die("the atlas has to be built before looking up %s", path);
+
+    for (int i = 0; i < atlas->sheet_count; i++)
+        if (strcmp(atlas->sheets[i].path, path) == 0)
+            return &atlas->regions[atlas->sheets[i].first_region];
+
+    return NULL;
+}
+
+void ng_atlas_destroy(ng_atlas_t *atlas)
+{
+    for (int i = 0; i < atlas->sheet_count; i++)
+    {
+        // Decodes can't be cancelled, wait for them so nothing leaks
+        if (atlas->sheets[i].job)
+        {
+            ng_loader_wait(atlas->sheets[i].job);
+            SDL_FreeSurface(atlas->sheets[i].job->surface);
+            ng_loader_free_job(atlas->sheets[i].job);
+        }
+
+        free(atlas->sheets[i].path);
+        SDL_FreeSurface(atlas->sheets[i].surface);
+    }
+
+    for (int i = 0; i < atlas->page_count; i++)
+        SDL_DestroyTexture(atlas->pages[i]);
+
+    free(atlas->sheets);
+    free(atlas->regions);
+    free(atlas->pages);
+
+    ng_atlas_create(atlas, atlas->page_size);
+}
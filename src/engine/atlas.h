@@ -0,0 +1,74 @@
+#ifndef _NG_ATLAS_H
+#define _NG_ATLAS_H
+
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+#include "loader.h"
+
+// A single frame packed inside one of the atlas pages
+typedef struct
+{
+    SDL_Texture *texture;
+    // Position and size of the trimmed pixels inside the page
+    SDL_Rect rect;
+
+    // Transparent borders are trimmed away when packing, these remember
+    // where the kept pixels were inside the original, untrimmed frame
+    int offset_x, offset_y;
+    int source_w, source_h;
+} ng_atlas_region_t;
+
+// A sprite sheet waiting to be packed, only used while building
+typedef struct
+{
+    char *path;
+    // The sheet gets decoded in the background, the surface is only set while building
+    ng_load_job_t *job;
+    SDL_Surface *surface;
+    int total_frames;
+
+    // Index of its first frame inside the regions array
+    int first_region;
+} ng_atlas_sheet_t;
+
+/*
+ * Packs many sprite sheets into one or a few large textures (pages), so that
+ * most sprites share a texture. This cuts texture switches (and draw calls,
+ * since the sprite batch groups quads by texture) as well as wasted memory
+ *
+ * Usage: add every sheet, build once, then look the frames up by path
+ */
+typedef struct
+{
+    ng_atlas_sheet_t *sheets;
+    int sheet_count, sheet_capacity;
+
+    ng_atlas_region_t *regions;
+    int region_count;
+
+    SDL_Texture **pages;
+    int page_count;
+    int page_size;
+
+    bool is_built;
+} ng_atlas_t;
+
+// Pages are square, page_size pixels wide (it gets clamped to what the renderer supports)
+void ng_atlas_create(ng_atlas_t *atlas, int page_size);
+
+// Sheets are horizontal strips of total_frames equal-width frames, use 1 for plain images
+// They start decoding on the loader's threads right away
+void ng_atlas_add_strip(ng_atlas_t *atlas, const char *path, int total_frames);
+// True once every sheet has been decoded, so that building won't block
+bool ng_atlas_is_ready(ng_atlas_t *atlas);
+// Share of the sheets decoded so far in [0, 1], for loading screens
+// NOTE: These aren't part of ng_assets_get_progress(), the atlas loads on its own
+float ng_atlas_get_progress(ng_atlas_t *atlas);
+void ng_atlas_build(ng_atlas_t *atlas, SDL_Renderer *renderer);
+
+// Returns the frames of a sheet (contiguous, in order), or NULL if it wasn't added
+const ng_atlas_region_t* ng_atlas_get_frames(ng_atlas_t *atlas, const char *path);
+
+void ng_atlas_destroy(ng_atlas_t *atlas);
+
+#endif
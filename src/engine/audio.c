@@ -1,50 +1,491 @@
 #include "audio.h"
 #include "common.h"
+#include "pack.h"
+#include "mixer.h"
+#include "adpcm.h"
+#include "timers.h"
+#include <stdlib.h>
+#include <string.h>
 
-Mix_Chunk* ng_audio_load(const char *file)
+// Per chunk settings, there are only ever a handful of sounds so a list will do
+typedef struct
 {
+    Mix_Chunk *chunk;
+    int max_instances, priority;
+    uint32_t cooldown_ms;
+
+    bool has_started;
+    uint32_t last_start;
+} sound_settings_t;
+
+static sound_settings_t *sounds;
+static int sound_count, sound_capacity;
+
+#ifndef NO_AUDIO
+// What the game thread knows about every voice of the mixer
+typedef struct
+{
+    // NULL when the voice is free
+    Mix_Chunk *chunk;
+    int priority;
+
+    // Grows with every play, so it also tells which voice is the oldest
+    uint32_t generation;
+} voice_slot_t;
+
+static voice_slot_t voices[NG_MIXER_VOICES];
+// 0 is never used, that way NG_VOICE_NONE can't match a real voice
+static uint32_t next_generation = 1;
+
+// Compressed chunks keep this in front of their ADPCM blocks, in place of samples
+typedef struct
+{
+    uint32_t magic;
+    int32_t frame_count, channels;
+} compressed_header_t;
+
+#define COMPRESSED_MAGIC 0x44504e47u
+// The blocks start aligned, right after the header
+#define COMPRESSED_DATA_OFFSET 16
+
+// Chunks get loaded on the loader's worker threads, hence the atomics
+static SDL_atomic_t pcm_bytes, compressed_bytes;
+static SDL_atomic_t memory_budget = {NG_AUDIO_DEFAULT_BUDGET};
+#endif
+
+static ng_audio_stats_t stats;
+
 #ifndef NO_AUDIO
-    Mix_Chunk *audio = Mix_LoadWAV(file);
+static const compressed_header_t* get_compressed_header(Mix_Chunk *audio)
+{
+    if (audio->alen < COMPRESSED_DATA_OFFSET)
+        return NULL;
+
+    const compressed_header_t *header = (const compressed_header_t*)audio->abuf;
+    if (header->magic != COMPRESSED_MAGIC || header->channels <= 0 || header->frame_count < 0)
+        return NULL;
+
+    // Samples that just happen to start with the magic won't have the exact size too
+    size_t size = COMPRESSED_DATA_OFFSET + ng_adpcm_get_encoded_size(header->frame_count, header->channels);
+    return audio->alen == size ? header : NULL;
+}
+
+static bool should_compress(Mix_Chunk *audio, ng_audio_storage_t storage)
+{
+    if (storage != NG_AUDIO_STORE_AUTO)
+        return storage == NG_AUDIO_STORE_COMPRESSED;
+
+    double seconds = (double)audio->alen /
+                     (sizeof(int16_t) * ng_mixer_get_channels() * ng_mixer_get_frequency());
+
+    return seconds > NG_AUDIO_LONG_SOUND_SECONDS ||
+           SDL_AtomicGet(&pcm_bytes) + (int)audio->alen > SDL_AtomicGet(&memory_budget);
+}
+
+// Swaps the chunk's samples for their ADPCM version, in place
+static void compress(Mix_Chunk *audio)
+{
+    int channels = ng_mixer_get_channels();
+    int frame_count = audio->alen / (sizeof(int16_t) * channels);
+    size_t size = COMPRESSED_DATA_OFFSET + ng_adpcm_get_encoded_size(frame_count, channels);
+
+    // Allocated like SDL_mixer does, so that Mix_FreeChunk() frees it just the same
+    Uint8 *buffer = SDL_malloc(size);
+    if (!buffer)
+        ng_die("ran out of memory while compressing a sound");
+
+    compressed_header_t header = {COMPRESSED_MAGIC, frame_count, channels};
+    memset(buffer, 0, COMPRESSED_DATA_OFFSET);
+    memcpy(buffer, &header, sizeof(header));
+    ng_adpcm_encode(buffer + COMPRESSED_DATA_OFFSET, (const int16_t*)audio->abuf, frame_count, channels);
+
+    if (audio->allocated)
+        SDL_free(audio->abuf);
+
+    audio->abuf = buffer;
+    audio->alen = (Uint32)size;
+    audio->allocated = 1;
+}
+#endif
+
+Mix_Chunk* ng_audio_load(const char *file, ng_audio_storage_t storage)
+{
+#ifndef NO_AUDIO
+    // SDL_mixer converts the samples to the device's exact format (rate, channels,
+    // 16 bit) right here, once, so that playing them never converts anything
+    Mix_Chunk *audio = Mix_LoadWAV_RW(ng_pack_open(file), 1);
 
     // Making sure that the audio file was successfully loaded
     if (!audio)
         ng_die("Something went wrong, couldn't load audio file %s!", file);
 
+    if (should_compress(audio, storage))
+    {
+        compress(audio);
+        SDL_AtomicAdd(&compressed_bytes, (int)audio->alen);
+    }
+    else
+        SDL_AtomicAdd(&pcm_bytes, (int)audio->alen);
+
     return audio;
+#else
+    return NULL;
+#endif
+}
+
+void ng_audio_set_memory_budget(size_t bytes)
+{
+#ifndef NO_AUDIO
+    SDL_AtomicSet(&memory_budget, (int)MIN(bytes, (size_t)SDL_MAX_SINT32));
+#endif
+}
+
+bool ng_audio_is_compressed(Mix_Chunk *audio)
+{
+#ifndef NO_AUDIO
+    return audio && get_compressed_header(audio);
+#else
+    return false;
 #endif
 }
 
 Mix_Music* ng_music_load(const char *file)
 {
 #ifndef NO_AUDIO
-    Mix_Music *audio = Mix_LoadMUS(file);
+    // The music keeps streaming from the pack while it plays
+    Mix_Music *audio = Mix_LoadMUS_RW(ng_pack_open(file), 1);
 
     // Making sure that the audio file was successfully loaded
     if (!audio)
         ng_die("Something went wrong, couldn't load audio file %s!", file);
 
     return audio;
+#else
+    return NULL;
 #endif
 }
 
+void ng_music_play(Mix_Music *audio)
+{
+#ifndef NO_AUDIO
+    Mix_PlayMusic(audio, -1);
+#endif
+}
+
+static sound_settings_t* get_sound(Mix_Chunk *audio)
+{
+    for (int i = 0; i < sound_count; i++)
+        if (sounds[i].chunk == audio)
+            return &sounds[i];
+
+    if (sound_count == sound_capacity)
+    {
+        sound_capacity = sound_capacity ? sound_capacity * 2 : 8;
+        sounds = realloc(sounds, sizeof(sound_settings_t) * sound_capacity);
+
+        if (!sounds)
+            ng_die("failed to allocate the sound settings");
+    }
+
+    sound_settings_t *sound = &sounds[sound_count++];
+    sound->chunk = audio;
+    sound->max_instances = NG_AUDIO_DEFAULT_MAX_INSTANCES;
+    sound->priority = 0;
+    sound->cooldown_ms = 0;
+    sound->has_started = false;
+    sound->last_start = 0;
+
+    return sound;
+}
+
+void ng_audio_configure(Mix_Chunk *audio, int max_instances, int priority, uint32_t cooldown_ms)
+{
+    if (!audio)
+        return;
+
+    sound_settings_t *sound = get_sound(audio);
+    sound->max_instances = max_instances;
+    sound->priority = priority;
+    sound->cooldown_ms = cooldown_ms;
+}
 
-void ng_audio_play(Mix_Chunk *audio)
+void ng_music_set_volume(int volume)
 {
 #ifndef NO_AUDIO
-    Mix_PlayChannel(-1, audio, 0);
+    // Gameplay code tends to set it every frame, only changes are worth a command
+    static int current_volume = MIX_MAX_VOLUME;
+    if (volume == current_volume)
+        return;
+
+    current_volume = volume;
+
+    // A short glide, jumping straight to the new volume clicks
+    ng_mixer_set_music_volume((float)volume / MIX_MAX_VOLUME, ng_mixer_get_frequency() / 50);
 #endif
 }
 
-int ng_return_channel(Mix_Chunk *audio, int dur)
+#ifndef NO_AUDIO
+static int ms_to_frames(uint32_t ms)
+{
+    return (int)((uint64_t)ms * ng_mixer_get_frequency() / 1000);
+}
+
+// The mixer reports finished voices through ng_mixer_has_ended(),
+// they get noticed the next time we look at them
+static void refresh_voices(void)
+{
+    stats.active_voices = 0;
+
+    for (int i = 0; i < NG_MIXER_VOICES; i++)
+    {
+        if (voices[i].chunk && ng_mixer_has_ended(i, voices[i].generation))
+            voices[i].chunk = NULL;
+
+        if (voices[i].chunk)
+            stats.active_voices++;
+    }
+}
+
+// The slot behind a handle, NULL if that sound isn't playing anymore
+static voice_slot_t* get_voice(ng_voice_t voice)
+{
+    if (voice.index < 0 || voice.index >= NG_MIXER_VOICES)
+        return NULL;
+
+    voice_slot_t *slot = &voices[voice.index];
+    if (!slot->chunk || slot->generation != voice.generation)
+        return NULL;
+
+    if (ng_mixer_has_ended(voice.index, voice.generation))
+    {
+        slot->chunk = NULL;
+        return NULL;
+    }
+
+    return slot;
+}
+
+static ng_voice_t play(Mix_Chunk *audio, int loops, uint32_t delay_ms)
+{
+    sound_settings_t *sound = get_sound(audio);
+    // Simulated time in replays and headless games, so cooldowns play out the same there
+    uint32_t now = ng_timers_get_time();
+
+    if (sound->has_started && now - sound->last_start < sound->cooldown_ms)
+    {
+        stats.rejected_cooldown++;
+        return NG_VOICE_NONE;
+    }
+
+    refresh_voices();
+
+    // In one pass: count the copies already playing, find a free
+    // voice and the one we'd steal if there's none
+    int instances = 0, free_voice = -1, victim = -1;
+
+    for (int i = 0; i < NG_MIXER_VOICES; i++)
+    {
+        voice_slot_t *slot = &voices[i];
+
+        if (!slot->chunk)
+        {
+            if (free_voice < 0)
+                free_voice = i;
+
+            continue;
+        }
+
+        if (slot->chunk == audio)
+            instances++;
+
+        // Never steal something more important than the new sound
+        if (slot->priority > sound->priority)
+            continue;
+
+        if (victim < 0 || slot->priority < voices[victim].priority ||
+            (slot->priority == voices[victim].priority && slot->generation < voices[victim].generation))
+            victim = i;
+    }
+
+    if (sound->max_instances > 0 && instances >= sound->max_instances)
+    {
+        stats.rejected_limit++;
+        return NG_VOICE_NONE;
+    }
+
+    int index = free_voice;
+    bool is_stealing = index < 0;
+
+    if (is_stealing)
+    {
+        if (victim < 0)
+        {
+            stats.rejected_priority++;
+            return NG_VOICE_NONE;
+        }
+
+        // Playing on a busy voice replaces whatever was there
+        index = victim;
+    }
+
+    // Mix_LoadWAV() already converted the samples to the device's format
+    const compressed_header_t *compressed = get_compressed_header(audio);
+    float volume = (float)audio->volume / MIX_MAX_VOLUME;
+    bool is_queued;
+
+    if (compressed)
+        is_queued = ng_mixer_play_compressed(index, next_generation, audio->abuf + COMPRESSED_DATA_OFFSET,
+                                             compressed->frame_count, loops, volume, ms_to_frames(delay_ms));
+    else
+        is_queued = ng_mixer_play(index, next_generation, (const int16_t*)audio->abuf,
+                                  audio->alen / (sizeof(int16_t) * ng_mixer_get_channels()),
+                                  loops, volume, ms_to_frames(delay_ms));
+
+    // The queue is full, the sound is dropped rather than waiting for the audio thread
+    if (!is_queued)
+        return NG_VOICE_NONE;
+
+    voice_slot_t *slot = &voices[index];
+    slot->chunk = audio;
+    slot->priority = sound->priority;
+    slot->generation = next_generation++;
+
+    // Wrapped around, skip the value reserved for NG_VOICE_NONE
+    if (next_generation == 0)
+        next_generation = 1;
+
+    sound->has_started = true;
+    sound->last_start = now;
+
+    stats.plays++;
+    stats.stolen += is_stealing;
+    stats.active_voices += !is_stealing;
+    stats.peak_voices = MAX(stats.peak_voices, stats.active_voices);
+
+    return (ng_voice_t){index, slot->generation};
+}
+#endif
+
+ng_voice_t ng_audio_play_looped(Mix_Chunk *audio, int loops)
 {
 #ifndef NO_AUDIO
-    return Mix_PlayChannel(-1, audio, dur);
+    return play(audio, loops, 0);
+#else
+    return NG_VOICE_NONE;
 #endif
 }
 
-void ng_music_play(Mix_Music *audio)
+ng_voice_t ng_audio_play(Mix_Chunk *audio)
+{
+    return ng_audio_play_looped(audio, 0);
+}
+
+ng_voice_t ng_audio_play_delayed(Mix_Chunk *audio, uint32_t delay_ms)
 {
 #ifndef NO_AUDIO
-    Mix_PlayMusic(audio, -1);
+    return play(audio, 0, delay_ms);
+#else
+    return NG_VOICE_NONE;
+#endif
+}
+
+bool ng_audio_is_playing(ng_voice_t voice)
+{
+#ifndef NO_AUDIO
+    return get_voice(voice) != NULL;
+#else
+    return false;
 #endif
 }
+
+bool ng_audio_stop(ng_voice_t voice)
+{
+#ifndef NO_AUDIO
+    voice_slot_t *slot = get_voice(voice);
+    if (!slot || !ng_mixer_stop(voice.index, voice.generation, 0))
+        return false;
+
+    slot->chunk = NULL;
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool ng_audio_fade_out(ng_voice_t voice, int ms)
+{
+#ifndef NO_AUDIO
+    // The voice keeps its slot until the fade is over
+    if (!get_voice(voice))
+        return false;
+
+    return ng_mixer_stop(voice.index, voice.generation, ms_to_frames(ms));
+#else
+    return false;
+#endif
+}
+
+bool ng_audio_set_volume(ng_voice_t voice, int volume, int fade_ms)
+{
+#ifndef NO_AUDIO
+    if (!get_voice(voice))
+        return false;
+
+    return ng_mixer_set_volume(voice.index, voice.generation,
+                               (float)volume / MIX_MAX_VOLUME, ms_to_frames(fade_ms));
+#else
+    return false;
+#endif
+}
+
+void ng_audio_get_stats(ng_audio_stats_t *stats_out)
+{
+#ifndef NO_AUDIO
+    refresh_voices();
+#endif
+
+    stats.voice_count = NG_MIXER_VOICES;
+#ifndef NO_AUDIO
+    stats.pcm_bytes = SDL_AtomicGet(&pcm_bytes);
+    stats.compressed_bytes = SDL_AtomicGet(&compressed_bytes);
+#endif
+    *stats_out = stats;
+}
+
+void ng_audio_drop(Mix_Chunk *audio)
+{
+#ifndef NO_AUDIO
+    for (int i = 0; i < NG_MIXER_VOICES; i++)
+    {
+        if (voices[i].chunk != audio)
+            continue;
+
+        // Give the callback a chance to make room when the queue is full
+        if (!ng_mixer_stop(i, voices[i].generation, 0))
+        {
+            ng_mixer_sync();
+
+            if (!ng_mixer_stop(i, voices[i].generation, 0))
+                ng_die("couldn't stop the voices of a sound before freeing it");
+        }
+
+        voices[i].chunk = NULL;
+    }
+
+    // Stopped and replaced voices might still be mixing the samples, this is
+    // the one place where the game waits for the audio thread (only on unload)
+    ng_mixer_sync();
+
+    SDL_AtomicAdd(get_compressed_header(audio) ? &compressed_bytes : &pcm_bytes, -(int)audio->alen);
+#endif
+
+    // The next chunk allocated at the same address mustn't inherit the settings
+    for (int i = 0; i < sound_count; i++)
+    {
+        if (sounds[i].chunk != audio)
+            continue;
+
+        sounds[i] = sounds[--sound_count];
+        break;
+    }
+}
@@ -2,11 +2,98 @@
 #define _NG_AUDIO_H
 
 #include <SDL2/SDL_mixer.h>
+#include <stdbool.h>
+#include <stdint.h>
 
-Mix_Chunk* ng_audio_load(const char *file);
-void ng_audio_play(Mix_Chunk *audio);
+/*
+ * Sound effects go through a small voice manager on top of the engine's mixer
+ * (see mixer.h), so calling ng_audio_play() every frame can't fill all the voices
+ * with copies of the same sample. Every chunk can be given:
+ *
+ *   max_instances  how many copies of it may play at once, further plays are ignored
+ *   priority       when no voice is free, the lowest priority voice (the oldest among
+ *                  equals) is stolen, as long as it isn't more important than the new one
+ *   cooldown_ms    the minimum time between two starts of it
+ *
+ * None of these wait for the audio thread, they only queue up a command for it.
+ * The chunk's volume (Mix_VolumeChunk) applies, the music still plays through
+ * SDL_mixer but its volume has to be set with ng_music_set_volume()
+ */
+#define NG_AUDIO_DEFAULT_MAX_INSTANCES 4
+
+/*
+ * Sound effects stay in memory either as plain samples, or compressed with IMA
+ * ADPCM (see adpcm.h), about a quarter of the size. Compressed sounds are decoded
+ * while they're being mixed, so they start just as fast, at a small CPU cost
+ * NOTE: A compressed Mix_Chunk only plays through ng_audio_play() and friends
+ */
+typedef enum
+{
+    // Compressed when longer than NG_AUDIO_LONG_SOUND_SECONDS, or when the plain
+    // samples of every sound loaded so far would go over the memory budget
+    NG_AUDIO_STORE_AUTO,
+    NG_AUDIO_STORE_PCM,
+    NG_AUDIO_STORE_COMPRESSED
+} ng_audio_storage_t;
+
+#define NG_AUDIO_LONG_SOUND_SECONDS 3.0
+#define NG_AUDIO_DEFAULT_BUDGET (2 * 1024 * 1024)
+
+// Handle to a playing sound, stays valid (and harmless) after the sound ends
+typedef struct
+{
+    int index;
+    uint32_t generation;
+} ng_voice_t;
+
+// Returned whenever a sound didn't start
+#define NG_VOICE_NONE ((ng_voice_t){-1, 0})
+
+typedef struct
+{
+    // Right now and the most ever playing at once
+    int active_voices, peak_voices;
+    int voice_count;
+
+    unsigned int plays;
+    // Sounds that didn't start because of their cooldown, instance limit or priority
+    // (or because the mixer's queue was full, see ng_mixer_get_stats)
+    unsigned int rejected_cooldown, rejected_limit, rejected_priority;
+    unsigned int stolen;
+
+    // Memory taken by the loaded sounds, plain and compressed
+    size_t pcm_bytes, compressed_bytes;
+} ng_audio_stats_t;
+
+// Safe to call from the loader's worker threads
+Mix_Chunk* ng_audio_load(const char *file, ng_audio_storage_t storage);
+// Bytes of plain samples NG_AUDIO_STORE_AUTO sounds may take, only affects later loads
+void ng_audio_set_memory_budget(size_t bytes);
+bool ng_audio_is_compressed(Mix_Chunk *audio);
 Mix_Music* ng_music_load(const char *file);
 void ng_music_play(Mix_Music *audio);
-int ng_return_channel(Mix_Chunk *audio, int dur);
+// 0 to MIX_MAX_VOLUME, like Mix_VolumeMusic() but without taking the audio lock
+void ng_music_set_volume(int volume);
+
+// Chunks that were never configured get the default limit, priority 0 and no cooldown
+void ng_audio_configure(Mix_Chunk *audio, int max_instances, int priority, uint32_t cooldown_ms);
+
+ng_voice_t ng_audio_play(Mix_Chunk *audio);
+// Same thing, but the sound repeats `loops` more times (-1 = until stopped)
+ng_voice_t ng_audio_play_looped(Mix_Chunk *audio, int loops);
+// Starts exactly delay_ms later, down to the sample (the cooldown counts from now)
+ng_voice_t ng_audio_play_delayed(Mix_Chunk *audio, uint32_t delay_ms);
+
+bool ng_audio_is_playing(ng_voice_t voice);
+// Both return false when the sound had already ended
+bool ng_audio_stop(ng_voice_t voice);
+bool ng_audio_fade_out(ng_voice_t voice, int ms);
+// 0 to MIX_MAX_VOLUME, reached after fade_ms
+bool ng_audio_set_volume(ng_voice_t voice, int volume, int fade_ms);
+
+void ng_audio_get_stats(ng_audio_stats_t *stats);
+
+// Stops every voice of a chunk and forgets its settings, has to happen before it gets freed
+void ng_audio_drop(Mix_Chunk *audio);
 
 #endif
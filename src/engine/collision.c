@@ -0,0 +1,284 @@
+#include "collision.h"
+#include "common.h"
+#include <math.h>
+#include <stdlib.h>
+
+#define GROW(array, capacity, needed) \
+    do \
+    { \
+        if ((needed) > (capacity)) \
+        { \
+            (capacity) = MAX((needed), (capacity) * 2); \
+            (array) = realloc((array), (capacity) * sizeof(*(array))); \
+            if ((array) == NULL) \
+                ng_die("ran out of memory while growing the collision world"); \
+        } \
+    } while (0)
+
+void ng_collision_create(ng_collision_world_t *world, float cell_size)
+{
+    *world = (ng_collision_world_t){0};
+    world->cell_size = cell_size;
+}
+
+void ng_collision_destroy(ng_collision_world_t *world)
+{
+    free(world->types);
+    free(world->colliders);
+    free(world->events);
+    free(world->entries);
+    free(world->sorted);
+    free(world->bucket_starts);
+
+    *world = (ng_collision_world_t){0};
+}
+
+int ng_collision_register_type(ng_collision_world_t *world, uint32_t layer, uint32_t mask,
+                               float inset_left, float inset_top, float inset_right, float inset_bottom)
+{
+    // Types are registered once at startup, growing one at a time is fine
+    world->types = realloc(world->types, (world->type_count + 1) * sizeof(ng_collider_type_t));
+    if (world->types == NULL)
+        ng_die("ran out of memory while registering a collider type");
+
+    world->types[world->type_count] = (ng_collider_type_t){
+        layer, mask, inset_left, inset_top, inset_right, inset_bottom,
+    };
+
+    return world->type_count++;
+}
+
+void ng_collision_clear(ng_collision_world_t *world)
+{
+    world->collider_count = 0;
+    world->event_count = 0;
+}
+
+int ng_collision_add(ng_collision_world_t *world, int type, const SDL_FRect *rect, int id)
+{
+    return ng_collision_add_moving(world, type, rect, 0.0f, 0.0f, id);
+}
+
+int ng_collision_add_moving(ng_collision_world_t *world, int type, const SDL_FRect *rect,
+                            float dx, float dy, int id)
+{
+    ng_collider_type_t *collider_type = &world->types[type];
+
+    GROW(world->colliders, world->collider_capacity, world->collider_count + 1);
+
+    ng_collider_t *collider = &world->colliders[world->collider_count];
+    collider->box.x = rect->x + collider_type->inset_left;
+    collider->box.y = rect->y + collider_type->inset_top;
+    collider->box.w = rect->w - collider_type->inset_left - collider_type->inset_right;
+    collider->box.h = rect->h - collider_type->inset_top - collider_type->inset_bottom;
+    collider->dx = dx;
+    collider->dy = dy;
+    collider->type = type;
+    collider->id = id;
+
+    // The box at the start and at the end of the step, and everything in between
+    collider->bounds.x = collider->box.x - MAX(dx, 0.0f);
+    collider->bounds.y = collider->box.y - MAX(dy, 0.0f);
+    collider->bounds.w = collider->box.w + fabsf(dx);
+    collider->bounds.h = collider->box.h + fabsf(dy);
+
+    return world->collider_count++;
+}
+
+static int get_cell(ng_collision_world_t *world, float position)
+{
+    return (int)floorf(position / world->cell_size);
+}
+
+static int hash_cell(ng_collision_world_t *world, int cell_x, int cell_y)
+{
+    // bucket_count is a power of two
+    uint32_t hash = (uint32_t)cell_x * 73856093u ^ (uint32_t)cell_y * 19349663u;
+    return hash & (world->bucket_count - 1);
+}
+
+// When a moving box overlaps a range on one axis, as fractions of the movement
+static bool sweep_axis(float a_min, float a_size, float b_min, float b_size, float velocity,
+                       float *entry, float *exit)
+{
+    float a_max = a_min + a_size, b_max = b_min + b_size;
+
+    // Not moving on this axis, so they either always overlap on it or never
+    if (velocity == 0.0f)
+    {
+        *entry = -INFINITY;
+        *exit = INFINITY;
+        return a_min < b_max && b_min < a_max;
+    }
+
+    if (velocity > 0.0f)
+    {
+        *entry = (b_min - a_max) / velocity;
+        *exit = (b_max - a_min) / velocity;
+    }
+    else
+    {
+        *entry = (b_max - a_min) / velocity;
+        *exit = (b_min - a_max) / velocity;
+    }
+
+    return true;
+}
+
+bool ng_collision_sweep(const SDL_FRect *a, float a_dx, float a_dy,
+                        const SDL_FRect *b, float b_dx, float b_dy, float *time)
+{
+    if (a->w <= 0 || a->h <= 0 || b->w <= 0 || b->h <= 0)
+        return false;
+
+    // Only the movement of one relative to the other matters
+    float entry_x, exit_x, entry_y, exit_y;
+    if (!sweep_axis(a->x, a->w, b->x, b->w, a_dx - b_dx, &entry_x, &exit_x) ||
+        !sweep_axis(a->y, a->h, b->y, b->h, a_dy - b_dy, &entry_y, &exit_y))
+        return false;
+
+    // They overlap once they overlap on both axes, until they stop on either of them
+    float entry = MAX(entry_x, entry_y);
+    float exit = MIN(exit_x, exit_y);
+
+    if (entry >= exit || entry >= 1.0f || exit <= 0.0f)
+        return false;
+
+    *time = MAX(entry, 0.0f);
+    return true;
+}
+
+static void add_event(ng_collision_world_t *world, int first, int second, float time)
+{
+    GROW(world->events, world->event_capacity, world->event_count + 1);
+    world->events[world->event_count++] = (ng_collision_event_t){first, second, time};
+}
+
+static int compare_events(const void *a, const void *b)
+{
+    const ng_collision_event_t *first = a, *second = b;
+
+    if (first->time != second->time)
+        return first->time < second->time ? -1 : 1;
+
+    // Keep the order stable between runs (replays depend on it)
+    if (first->first != second->first)
+        return first->first - second->first;
+
+    return first->second - second->second;
+}
+
+static void test_pair(ng_collision_world_t *world, ng_collision_cell_entry_t *a, ng_collision_cell_entry_t *b)
+{
+    ng_collider_t *first = &world->colliders[a->collider];
+    ng_collider_t *second = &world->colliders[b->collider];
+    ng_collider_type_t *first_type = &world->types[first->type];
+    ng_collider_type_t *second_type = &world->types[second->type];
+
+    bool first_wants = (first_type->mask & second_type->layer) != 0;
+    bool second_wants = (second_type->mask & first_type->layer) != 0;
+
+    if (!first_wants && !second_wants)
+        return;
+
+    // Two colliders can share many cells, but only the cell holding the top left
+    // corner of where they could meet reports them
+    if (get_cell(world, MAX(first->bounds.x, second->bounds.x)) != a->cell_x ||
+        get_cell(world, MAX(first->bounds.y, second->bounds.y)) != a->cell_y)
+        return;
+
+    // Going back to where both of them started the step
+    SDL_FRect first_start = {first->box.x - first->dx, first->box.y - first->dy, first->box.w, first->box.h};
+    SDL_FRect second_start = {second->box.x - second->dx, second->box.y - second->dy, second->box.w, second->box.h};
+    float time;
+
+    world->tests++;
+    if (!ng_collision_sweep(&first_start, first->dx, first->dy,
+                            &second_start, second->dx, second->dy, &time))
+        return;
+
+    if (first_wants)
+        add_event(world, a->collider, b->collider, time);
+    else
+        add_event(world, b->collider, a->collider, time);
+}
+
+void ng_collision_detect(ng_collision_world_t *world)
+{
+    world->event_count = 0;
+    world->entry_count = 0;
+    world->tests = 0;
+
+    // Broad phase, one entry for every cell a collider touches
+    for (int i = 0; i < world->collider_count; i++)
+    {
+        SDL_FRect *box = &world->colliders[i].bounds;
+        if (box->w <= 0 || box->h <= 0)
+            continue;
+
+        int left = get_cell(world, box->x), right = get_cell(world, box->x + box->w);
+        int top = get_cell(world, box->y), bottom = get_cell(world, box->y + box->h);
+
+        for (int y = top; y <= bottom; y++)
+        {
+            for (int x = left; x <= right; x++)
+            {
+                GROW(world->entries, world->entry_capacity, world->entry_count + 1);
+                world->entries[world->entry_count++] = (ng_collision_cell_entry_t){x, y, i};
+            }
+        }
+    }
+
+    // Enough buckets that most of them hold a single cell
+    int bucket_count = 16;
+    while (bucket_count < world->entry_count * 2)
+        bucket_count *= 2;
+
+    GROW(world->bucket_starts, world->bucket_capacity, bucket_count + 1);
+    world->bucket_count = bucket_count;
+
+    // Counting sort by bucket, so every bucket's entries end up next to each other
+    GROW(world->sorted, world->sorted_capacity, world->entry_count);
+
+    SDL_memset(world->bucket_starts, 0, (bucket_count + 1) * sizeof(int));
+
+    for (int i = 0; i < world->entry_count; i++)
+    {
+        ng_collision_cell_entry_t *entry = &world->entries[i];
+        world->bucket_starts[hash_cell(world, entry->cell_x, entry->cell_y) + 1]++;
+    }
+
+    for (int i = 0; i < bucket_count; i++)
+        world->bucket_starts[i + 1] += world->bucket_starts[i];
+
+    for (int i = 0; i < world->entry_count; i++)
+    {
+        ng_collision_cell_entry_t *entry = &world->entries[i];
+        int bucket = hash_cell(world, entry->cell_x, entry->cell_y);
+
+        // bucket_starts[bucket] moves forward while filling, it ends up at the next bucket's start
+        world->sorted[world->bucket_starts[bucket]++] = *entry;
+    }
+
+    // Narrow phase, buckets can also hold other cells that hashed the same way
+    int start = 0;
+    for (int bucket = 0; bucket < bucket_count; bucket++)
+    {
+        int end = world->bucket_starts[bucket];
+
+        for (int i = start; i < end; i++)
+        {
+            for (int j = i + 1; j < end; j++)
+            {
+                ng_collision_cell_entry_t *a = &world->sorted[i], *b = &world->sorted[j];
+
+                if (a->cell_x == b->cell_x && a->cell_y == b->cell_y)
+                    test_pair(world, a, b);
+            }
+        }
+
+        start = end;
+    }
+
+    qsort(world->events, world->event_count, sizeof(ng_collision_event_t), compare_events);
+}
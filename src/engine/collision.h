@@ -0,0 +1,111 @@
+#ifndef _NG_COLLISION_H
+#define _NG_COLLISION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+// What a kind of collider is and what it wants to hit, both as bits of
+// game-defined layers (hazard, enemy, player attack...)
+typedef struct
+{
+    uint32_t layer;
+    uint32_t mask;
+
+    // How much smaller the hitbox is than the rectangle it gets added with,
+    // from every side (e.g. sprites with empty space above them)
+    float inset_left, inset_top, inset_right, inset_bottom;
+} ng_collider_type_t;
+
+typedef struct
+{
+    // Where it is at the end of the step and how far it moved during it
+    SDL_FRect box;
+    float dx, dy;
+
+    // Everything it touched during the step, what the broad phase works with
+    SDL_FRect bounds;
+    int type;
+
+    // Whatever the game uses to find its object again (e.g. an entity index)
+    int id;
+} ng_collider_t;
+
+// A pair of overlapping colliders (indices into the colliders array)
+// The first one is always the one interested in the second, so for a player
+// attack that hits an enemy, first is the attack and second is the enemy
+typedef struct
+{
+    int first, second;
+
+    // When they first touched, as a fraction of the step (0 if they already overlapped)
+    float time;
+} ng_collision_event_t;
+
+typedef struct
+{
+    int cell_x, cell_y;
+    int collider;
+} ng_collision_cell_entry_t;
+
+/*
+ * Colliders are added again every frame, then ng_collision_detect() finds all the
+ * overlapping pairs. Every collider is put into the cells of a uniform grid it
+ * touches (hashed into buckets, the grid has no size limit), and only colliders
+ * sharing a cell get tested against each other, so lots of objects spread over
+ * the screen don't end up testing every pair
+ */
+typedef struct
+{
+    float cell_size;
+
+    ng_collider_type_t *types;
+    int type_count;
+
+    ng_collider_t *colliders;
+    int collider_count, collider_capacity;
+
+    ng_collision_event_t *events;
+    int event_count, event_capacity;
+
+    // Everything below is reused between frames
+    ng_collision_cell_entry_t *entries;
+    int entry_count, entry_capacity;
+    int *bucket_starts;
+    int bucket_count, bucket_capacity;
+    ng_collision_cell_entry_t *sorted;
+    int sorted_capacity;
+
+    // How many pairs actually reached the narrow phase last time
+    int tests;
+} ng_collision_world_t;
+
+// The cell size should be around the size of the common colliders
+void ng_collision_create(ng_collision_world_t *world, float cell_size);
+void ng_collision_destroy(ng_collision_world_t *world);
+
+// Returns the type's index, used to add colliders of that type
+int ng_collision_register_type(ng_collision_world_t *world, uint32_t layer, uint32_t mask,
+                               float inset_left, float inset_top, float inset_right, float inset_bottom);
+
+// Removes every collider (and event), call before adding this frame's colliders
+void ng_collision_clear(ng_collision_world_t *world);
+// The rectangle shrinks by the type's insets, returns the collider's index
+int ng_collision_add(ng_collision_world_t *world, int type, const SDL_FRect *rect, int id);
+// Same thing for something that moved by (dx, dy) during the step to end up at rect
+// Moving colliders are swept, so they can't pass through each other between two steps
+// no matter how fast they are or how long the step was
+int ng_collision_add_moving(ng_collision_world_t *world, int type, const SDL_FRect *rect,
+                            float dx, float dy, int id);
+
+// Fills the events array, every pair that touched during the step is reported
+// exactly once, sorted by the time they touched
+void ng_collision_detect(ng_collision_world_t *world);
+
+// Time of impact of two boxes moving by (a_dx, a_dy) and (b_dx, b_dy) from where they are,
+// as a fraction of that movement. Returns false if they never overlap during it
+// NOTE: Touching edges don't count, just like SDL_HasIntersectionF()
+bool ng_collision_sweep(const SDL_FRect *a, float a_dx, float a_dy,
+                        const SDL_FRect *b, float b_dx, float b_dy, float *time);
+
+#endif
@@ -6,6 +6,9 @@
 // Some simple macros
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 #define MAX(a, b) ((a) < (b) ? (b) : (a))
+#define CLAMP(x, low, high) MIN(MAX(x, low), high)
+// Only for actual arrays, not pointers
+#define ARRAY_LENGTH(array) (int)(sizeof(array) / sizeof((array)[0]))
 
 // Just prints out the messages and kills the program
 void ng_die(const char *format, ...);
@@ -1,7 +1,9 @@
 #include "custom_math.h"
+#include "common.h"
 #include <math.h>
 
-#define SQUARE(x) (x * x)
+// Parenthesized, so that SQUARE(a - b) doesn't turn into a - b * a - b
+#define SQUARE(x) ((x) * (x))
 
 float ng_vector_get_magnitude(ng_vec2 *source)
 {
@@ -59,3 +61,465 @@ int ng_get_distance(int x, int y, int other_x, int other_y)
     // Basically getting the magnitude of the distance vector
     return sqrt(SQUARE(other_x - x) + SQUARE(other_y - y));
 }
+
+float ng_lerp(float start, float end, float t)
+{
+    return start + (end - start) * t;
+}
+
+// ---- Batch math ----
+
+// The x86 kernels are only built by compilers that can target single functions,
+// so the rest of the engine doesn't need any special flags
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(__EMSCRIPTEN__)
+#define NG_X86_KERNELS
+#include <immintrin.h>
+#define SSE2 __attribute__((target("sse2")))
+#define AVX2 __attribute__((target("avx2")))
+#endif
+
+typedef struct
+{
+    ng_simd_level_t level;
+
+    void (*add)(float *result, const float *first, const float *second, int count);
+    void (*multiply_add)(float *result, const float *source, float scalar, int count);
+    void (*normalize)(float *x, float *y, int count);
+    void (*distance)(float *result, const float *x, const float *y, float to_x, float to_y, int count);
+    int (*overlaps)(uint8_t *result, const float *x, const float *y,
+                    const float *w, const float *h, const SDL_FRect *rect, int count);
+    void (*multiply_add_samples)(float *result, const int16_t *source, float scalar, int count);
+    void (*to_samples)(int16_t *result, const float *source, int count);
+} kernels_t;
+
+// Scalar versions, these are also what the SIMD kernels use for the leftovers
+// that don't fill a whole register
+
+static void add_scalar(float *result, const float *first, const float *second, int count)
+{
+    for (int i = 0; i < count; i++)
+        result[i] = first[i] + second[i];
+}
+
+static void multiply_add_scalar(float *result, const float *source, float scalar, int count)
+{
+    for (int i = 0; i < count; i++)
+        result[i] += source[i] * scalar;
+}
+
+static void normalize_scalar(float *x, float *y, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        float magnitude = sqrtf(x[i] * x[i] + y[i] * y[i]);
+
+        if (magnitude > 0.0f)
+        {
+            x[i] /= magnitude;
+            y[i] /= magnitude;
+        }
+    }
+}
+
+static void distance_scalar(float *result, const float *x, const float *y,
+                            float to_x, float to_y, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        float dx = to_x - x[i], dy = to_y - y[i];
+        result[i] = sqrtf(dx * dx + dy * dy);
+    }
+}
+
+static int overlaps_scalar(uint8_t *result, const float *x, const float *y,
+                           const float *w, const float *h, const SDL_FRect *rect, int count)
+{
+    int hits = 0;
+
+    // Overlapping means the intersection isn't empty on both axes
+    for (int i = 0; i < count; i++)
+    {
+        bool overlaps = fminf(x[i] + w[i], rect->x + rect->w) > fmaxf(x[i], rect->x) &&
+                        fminf(y[i] + h[i], rect->y + rect->h) > fmaxf(y[i], rect->y);
+
+        result[i] = overlaps;
+        hits += overlaps;
+    }
+
+    return hits;
+}
+
+static void multiply_add_samples_scalar(float *result, const int16_t *source, float scalar, int count)
+{
+    for (int i = 0; i < count; i++)
+        result[i] += (float)source[i] * scalar;
+}
+
+static void to_samples_scalar(int16_t *result, const float *source, int count)
+{
+    // Same order as the SIMD versions, so NaN ends up as the lowest sample everywhere
+    for (int i = 0; i < count; i++)
+        result[i] = (int16_t)lrintf(fminf(fmaxf(source[i], -32768.0f), 32767.0f));
+}
+
+static const kernels_t scalar_kernels = {
+    NG_SIMD_SCALAR,
+    add_scalar, multiply_add_scalar, normalize_scalar, distance_scalar, overlaps_scalar,
+    multiply_add_samples_scalar, to_samples_scalar,
+};
+
+#ifdef NG_X86_KERNELS
+
+// SSE2, 4 floats at a time
+
+SSE2 static void add_sse2(float *result, const float *first, const float *second, int count)
+{
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+        _mm_storeu_ps(result + i, _mm_add_ps(_mm_loadu_ps(first + i), _mm_loadu_ps(second + i)));
+
+    add_scalar(result + i, first + i, second + i, count - i);
+}
+
+SSE2 static void multiply_add_sse2(float *result, const float *source, float scalar, int count)
+{
+    __m128 factor = _mm_set1_ps(scalar);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 scaled = _mm_mul_ps(_mm_loadu_ps(source + i), factor);
+        _mm_storeu_ps(result + i, _mm_add_ps(_mm_loadu_ps(result + i), scaled));
+    }
+
+    multiply_add_scalar(result + i, source + i, scalar, count - i);
+}
+
+SSE2 static void normalize_sse2(float *x, float *y, int count)
+{
+    __m128 zero = _mm_setzero_ps();
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 vx = _mm_loadu_ps(x + i), vy = _mm_loadu_ps(y + i);
+        __m128 magnitude = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)));
+
+        // Zero vectors keep their original (zero) components instead of turning into NaN
+        __m128 keep = _mm_cmpgt_ps(magnitude, zero);
+        __m128 nx = _mm_div_ps(vx, magnitude), ny = _mm_div_ps(vy, magnitude);
+
+        _mm_storeu_ps(x + i, _mm_or_ps(_mm_and_ps(keep, nx), _mm_andnot_ps(keep, vx)));
+        _mm_storeu_ps(y + i, _mm_or_ps(_mm_and_ps(keep, ny), _mm_andnot_ps(keep, vy)));
+    }
+
+    normalize_scalar(x + i, y + i, count - i);
+}
+
+SSE2 static void distance_sse2(float *result, const float *x, const float *y,
+                               float to_x, float to_y, int count)
+{
+    __m128 tx = _mm_set1_ps(to_x), ty = _mm_set1_ps(to_y);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 dx = _mm_sub_ps(tx, _mm_loadu_ps(x + i));
+        __m128 dy = _mm_sub_ps(ty, _mm_loadu_ps(y + i));
+        _mm_storeu_ps(result + i, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy))));
+    }
+
+    distance_scalar(result + i, x + i, y + i, to_x, to_y, count - i);
+}
+
+SSE2 static int overlaps_sse2(uint8_t *result, const float *x, const float *y,
+                              const float *w, const float *h, const SDL_FRect *rect, int count)
+{
+    __m128 left = _mm_set1_ps(rect->x), right = _mm_set1_ps(rect->x + rect->w);
+    __m128 top = _mm_set1_ps(rect->y), bottom = _mm_set1_ps(rect->y + rect->h);
+    int hits = 0;
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 bx = _mm_loadu_ps(x + i), by = _mm_loadu_ps(y + i);
+        __m128 overlap_x = _mm_cmpgt_ps(_mm_min_ps(_mm_add_ps(bx, _mm_loadu_ps(w + i)), right),
+                                        _mm_max_ps(bx, left));
+        __m128 overlap_y = _mm_cmpgt_ps(_mm_min_ps(_mm_add_ps(by, _mm_loadu_ps(h + i)), bottom),
+                                        _mm_max_ps(by, top));
+        int mask = _mm_movemask_ps(_mm_and_ps(overlap_x, overlap_y));
+
+        for (int lane = 0; lane < 4; lane++)
+        {
+            result[i + lane] = (mask >> lane) & 1;
+            hits += result[i + lane];
+        }
+    }
+
+    return hits + overlaps_scalar(result + i, x + i, y + i, w + i, h + i, rect, count - i);
+}
+
+SSE2 static void multiply_add_samples_sse2(float *result, const int16_t *source, float scalar, int count)
+{
+    __m128 factor = _mm_set1_ps(scalar);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        // Sign extension without SSE4.1: put the sample in the upper half, then shift it back down
+        __m128i packed = _mm_loadl_epi64((const __m128i*)(source + i));
+        __m128i wide = _mm_srai_epi32(_mm_unpacklo_epi16(packed, packed), 16);
+
+        __m128 scaled = _mm_mul_ps(_mm_cvtepi32_ps(wide), factor);
+        _mm_storeu_ps(result + i, _mm_add_ps(_mm_loadu_ps(result + i), scaled));
+    }
+
+    multiply_add_samples_scalar(result + i, source + i, scalar, count - i);
+}
+
+SSE2 static void to_samples_sse2(int16_t *result, const float *source, int count)
+{
+    __m128 low = _mm_set1_ps(-32768.0f), high = _mm_set1_ps(32767.0f);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128 first = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(source + i), low), high);
+        __m128 second = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(source + i + 4), low), high);
+
+        // Rounds to nearest like lrintf(), the clamping already made packing lossless
+        __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(first), _mm_cvtps_epi32(second));
+        _mm_storeu_si128((__m128i*)(result + i), packed);
+    }
+
+    to_samples_scalar(result + i, source + i, count - i);
+}
+
+static const kernels_t sse2_kernels = {
+    NG_SIMD_SSE2,
+    add_sse2, multiply_add_sse2, normalize_sse2, distance_sse2, overlaps_sse2,
+    multiply_add_samples_sse2, to_samples_sse2,
+};
+
+// AVX2, 8 floats at a time
+// NOTE: No fused multiply-add on purpose, it rounds differently than the other paths
+
+AVX2 static void add_avx2(float *result, const float *first, const float *second, int count)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+        _mm256_storeu_ps(result + i, _mm256_add_ps(_mm256_loadu_ps(first + i), _mm256_loadu_ps(second + i)));
+
+    add_sse2(result + i, first + i, second + i, count - i);
+}
+
+AVX2 static void multiply_add_avx2(float *result, const float *source, float scalar, int count)
+{
+    __m256 factor = _mm256_set1_ps(scalar);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 scaled = _mm256_mul_ps(_mm256_loadu_ps(source + i), factor);
+        _mm256_storeu_ps(result + i, _mm256_add_ps(_mm256_loadu_ps(result + i), scaled));
+    }
+
+    multiply_add_sse2(result + i, source + i, scalar, count - i);
+}
+
+AVX2 static void normalize_avx2(float *x, float *y, int count)
+{
+    __m256 zero = _mm256_setzero_ps();
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 vx = _mm256_loadu_ps(x + i), vy = _mm256_loadu_ps(y + i);
+        __m256 magnitude = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(vx, vx), _mm256_mul_ps(vy, vy)));
+        __m256 keep = _mm256_cmp_ps(magnitude, zero, _CMP_GT_OQ);
+
+        _mm256_storeu_ps(x + i, _mm256_blendv_ps(vx, _mm256_div_ps(vx, magnitude), keep));
+        _mm256_storeu_ps(y + i, _mm256_blendv_ps(vy, _mm256_div_ps(vy, magnitude), keep));
+    }
+
+    normalize_sse2(x + i, y + i, count - i);
+}
+
+AVX2 static void distance_avx2(float *result, const float *x, const float *y,
+                               float to_x, float to_y, int count)
+{
+    __m256 tx = _mm256_set1_ps(to_x), ty = _mm256_set1_ps(to_y);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 dx = _mm256_sub_ps(tx, _mm256_loadu_ps(x + i));
+        __m256 dy = _mm256_sub_ps(ty, _mm256_loadu_ps(y + i));
+        _mm256_storeu_ps(result + i, _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy))));
+    }
+
+    distance_sse2(result + i, x + i, y + i, to_x, to_y, count - i);
+}
+
+AVX2 static int overlaps_avx2(uint8_t *result, const float *x, const float *y,
+                              const float *w, const float *h, const SDL_FRect *rect, int count)
+{
+    __m256 left = _mm256_set1_ps(rect->x), right = _mm256_set1_ps(rect->x + rect->w);
+    __m256 top = _mm256_set1_ps(rect->y), bottom = _mm256_set1_ps(rect->y + rect->h);
+    int hits = 0;
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 bx = _mm256_loadu_ps(x + i), by = _mm256_loadu_ps(y + i);
+        __m256 overlap_x = _mm256_cmp_ps(_mm256_min_ps(_mm256_add_ps(bx, _mm256_loadu_ps(w + i)), right),
+                                         _mm256_max_ps(bx, left), _CMP_GT_OQ);
+        __m256 overlap_y = _mm256_cmp_ps(_mm256_min_ps(_mm256_add_ps(by, _mm256_loadu_ps(h + i)), bottom),
+                                         _mm256_max_ps(by, top), _CMP_GT_OQ);
+        int mask = _mm256_movemask_ps(_mm256_and_ps(overlap_x, overlap_y));
+
+        for (int lane = 0; lane < 8; lane++)
+        {
+            result[i + lane] = (mask >> lane) & 1;
+            hits += result[i + lane];
+        }
+    }
+
+    return hits + overlaps_sse2(result + i, x + i, y + i, w + i, h + i, rect, count - i);
+}
+
+AVX2 static void multiply_add_samples_avx2(float *result, const int16_t *source, float scalar, int count)
+{
+    __m256 factor = _mm256_set1_ps(scalar);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i wide = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(source + i)));
+        __m256 scaled = _mm256_mul_ps(_mm256_cvtepi32_ps(wide), factor);
+        _mm256_storeu_ps(result + i, _mm256_add_ps(_mm256_loadu_ps(result + i), scaled));
+    }
+
+    multiply_add_samples_sse2(result + i, source + i, scalar, count - i);
+}
+
+AVX2 static void to_samples_avx2(int16_t *result, const float *source, int count)
+{
+    __m256 low = _mm256_set1_ps(-32768.0f), high = _mm256_set1_ps(32767.0f);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 clamped = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(source + i), low), high);
+        __m256i rounded = _mm256_cvtps_epi32(clamped);
+
+        // The 256 bit pack works per 128 bit lane, packing the two halves is simpler
+        __m128i packed = _mm_packs_epi32(_mm256_castsi256_si128(rounded),
+                                         _mm256_extracti128_si256(rounded, 1));
+        _mm_storeu_si128((__m128i*)(result + i), packed);
+    }
+
+    to_samples_sse2(result + i, source + i, count - i);
+}
+
+static const kernels_t avx2_kernels = {
+    NG_SIMD_AVX2,
+    add_avx2, multiply_add_avx2, normalize_avx2, distance_avx2, overlaps_avx2,
+    multiply_add_samples_avx2, to_samples_avx2,
+};
+
+#endif
+
+// The current kernels_t, the audio callback uses them as well
+static void *kernels = NULL;
+
+static ng_simd_level_t get_supported_level(void)
+{
+#ifdef NG_X86_KERNELS
+    if (SDL_HasAVX2())
+        return NG_SIMD_AVX2;
+    if (SDL_HasSSE2())
+        return NG_SIMD_SSE2;
+#endif
+    return NG_SIMD_SCALAR;
+}
+
+void ng_batch_set_level(ng_simd_level_t requested)
+{
+    const kernels_t *chosen = &scalar_kernels;
+
+    switch (MIN(requested, get_supported_level()))
+    {
+#ifdef NG_X86_KERNELS
+    case NG_SIMD_AVX2:
+        chosen = &avx2_kernels;
+        break;
+    case NG_SIMD_SSE2:
+        chosen = &sse2_kernels;
+        break;
+#endif
+    default:
+        break;
+    }
+
+    // The table and its level go out together, a call on another thread
+    // sees either the previous kernels or these
+    SDL_AtomicSetPtr(&kernels, (void*)chosen);
+}
+
+// The game picks them while initializing, this only covers programs that don't
+// (tools, benchmarks) and call the batch functions from a single thread
+static const kernels_t *get_kernels(void)
+{
+    const kernels_t *current = SDL_AtomicGetPtr(&kernels);
+
+    if (current == NULL)
+    {
+        ng_batch_set_level(NG_SIMD_AVX2);
+        current = SDL_AtomicGetPtr(&kernels);
+    }
+
+    return current;
+}
+
+ng_simd_level_t ng_batch_get_level(void)
+{
+    return get_kernels()->level;
+}
+
+void ng_batch_add(float *result, const float *first, const float *second, int count)
+{
+    get_kernels()->add(result, first, second, count);
+}
+
+void ng_batch_multiply_add(float *result, const float *source, float scalar, int count)
+{
+    get_kernels()->multiply_add(result, source, scalar, count);
+}
+
+void ng_batch_normalize(float *x, float *y, int count)
+{
+    get_kernels()->normalize(x, y, count);
+}
+
+void ng_batch_distance(float *result, const float *x, const float *y,
+                       float to_x, float to_y, int count)
+{
+    get_kernels()->distance(result, x, y, to_x, to_y, count);
+}
+
+int ng_batch_overlaps(uint8_t *result, const float *x, const float *y,
+                      const float *w, const float *h, const SDL_FRect *rect, int count)
+{
+    return get_kernels()->overlaps(result, x, y, w, h, rect, count);
+}
+
+void ng_batch_multiply_add_samples(float *result, const int16_t *source, float scalar, int count)
+{
+    get_kernels()->multiply_add_samples(result, source, scalar, count);
+}
+
+void ng_batch_to_samples(int16_t *result, const float *source, int count)
+{
+    get_kernels()->to_samples(result, source, count);
+}
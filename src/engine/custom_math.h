@@ -21,5 +21,47 @@ void ng_vectors_divide(ng_vec2 *result, ng_vec2 *first, ng_vec2 *second);
 // Other math-related functions
 bool ng_is_point_inside(SDL_Rect *rect, int x, int y);
 int ng_get_distance(int x, int y, int other_x, int other_y);
+// Linear interpolation, t = 0 gives start and t = 1 gives end
+float ng_lerp(float start, float end, float t);
+
+/*
+ * Batch versions for whole arrays at once, meant for structure-of-arrays data
+ * (see entities.h), where the x and y components live in separate arrays.
+ * They use SSE2 or AVX2 when the CPU has them and plain C otherwise. The game
+ * picks the path while initializing, before the audio callback can run, programs
+ * without a game get it on their first call. Every path gives the same results
+ *
+ * NOTE: Results may point at one of the inputs, but not partially overlap them
+ */
+typedef enum
+{
+    NG_SIMD_SCALAR,
+    NG_SIMD_SSE2,
+    NG_SIMD_AVX2
+} ng_simd_level_t;
+
+ng_simd_level_t ng_batch_get_level(void);
+// Forces a slower path (e.g. to compare them), asking for more than the CPU has does nothing
+// Safe while other threads use them, calls already running finish on the previous path
+void ng_batch_set_level(ng_simd_level_t level);
+
+// result[i] = first[i] + second[i]
+void ng_batch_add(float *result, const float *first, const float *second, int count);
+// result[i] += source[i] * scalar, e.g. moving positions by their velocities
+void ng_batch_multiply_add(float *result, const float *source, float scalar, int count);
+// Normalizes every (x[i], y[i]) in place, zero vectors stay zero
+void ng_batch_normalize(float *x, float *y, int count);
+// result[i] = distance between (x[i], y[i]) and (to_x, to_y)
+void ng_batch_distance(float *result, const float *x, const float *y,
+                       float to_x, float to_y, int count);
+// result[i] = whether box i overlaps the rectangle, same rules as SDL_HasIntersectionF()
+// Returns how many of them do
+int ng_batch_overlaps(uint8_t *result, const float *x, const float *y,
+                      const float *w, const float *h, const SDL_FRect *rect, int count);
+
+// Same as ng_batch_multiply_add(), for 16 bit audio samples (mixing them into a float buffer)
+void ng_batch_multiply_add_samples(float *result, const int16_t *source, float scalar, int count);
+// Back to 16 bit samples, rounded to the nearest and clamped instead of wrapping around
+void ng_batch_to_samples(int16_t *result, const float *source, int count);
 
 #endif
@@ -0,0 +1,227 @@
+#include "entities.h"
+#include "common.h"
+#include <stdlib.h>
+
+// Marks the end of the free slot list
+#define NO_SLOT UINT32_MAX
+
+#define GROW(array, capacity) \
+    do \
+    { \
+        (array) = realloc((array), (capacity) * sizeof(*(array))); \
+        if ((array) == NULL) \
+            ng_die("ran out of memory while growing the entity store"); \
+    } while (0)
+
+static void reserve_components(ng_entity_store_t *store, int capacity)
+{
+    if (capacity <= store->capacity)
+        return;
+
+    GROW(store->x, capacity);
+    GROW(store->y, capacity);
+    GROW(store->w, capacity);
+    GROW(store->h, capacity);
+    GROW(store->vx, capacity);
+    GROW(store->vy, capacity);
+    GROW(store->box_x, capacity);
+    GROW(store->box_y, capacity);
+    GROW(store->box_w, capacity);
+    GROW(store->box_h, capacity);
+    GROW(store->sprite, capacity);
+    GROW(store->animation, capacity);
+    GROW(store->layer, capacity);
+    GROW(store->kind, capacity);
+    GROW(store->slots, capacity);
+
+    store->capacity = capacity;
+}
+
+static void reserve_slots(ng_entity_store_t *store, uint32_t capacity)
+{
+    if (capacity <= store->slot_capacity)
+        return;
+
+    GROW(store->sparse, capacity);
+    GROW(store->generations, capacity);
+
+    store->slot_capacity = capacity;
+}
+
+void ng_entities_create(ng_entity_store_t *store, int initial_capacity)
+{
+    *store = (ng_entity_store_t){0};
+    store->free_slot = NO_SLOT;
+
+    reserve_components(store, MAX(initial_capacity, 16));
+    reserve_slots(store, store->capacity);
+}
+
+void ng_entities_destroy(ng_entity_store_t *store)
+{
+    free(store->x);
+    free(store->y);
+    free(store->w);
+    free(store->h);
+    free(store->vx);
+    free(store->vy);
+    free(store->box_x);
+    free(store->box_y);
+    free(store->box_w);
+    free(store->box_h);
+    free(store->sprite);
+    free(store->animation);
+    free(store->layer);
+    free(store->kind);
+    free(store->slots);
+    free(store->sparse);
+    free(store->generations);
+
+    *store = (ng_entity_store_t){0};
+}
+
+ng_entity_t ng_entities_add(ng_entity_store_t *store, ng_animated_sprite_t *sprite,
+                            int kind, int layer, float x, float y)
+{
+    uint32_t slot;
+
+    // Reuse a removed slot first, its generation was already bumped on removal
+    if (store->free_slot != NO_SLOT)
+    {
+        slot = store->free_slot;
+        store->free_slot = store->sparse[slot];
+    }
+    else
+    {
+        if (store->slot_count == store->slot_capacity)
+            reserve_slots(store, store->slot_capacity * 2);
+
+        slot = store->slot_count++;
+        store->generations[slot] = 1;
+    }
+
+    if (store->count == store->capacity)
+        reserve_components(store, store->capacity * 2);
+
+    int index = store->count++;
+    store->sparse[slot] = index;
+    store->slots[index] = slot;
+
+    store->x[index] = x;
+    store->y[index] = y;
+    store->w[index] = sprite->sprite.transform.w;
+    store->h[index] = sprite->sprite.transform.h;
+    store->vx[index] = 0.0f;
+    store->vy[index] = 0.0f;
+    store->box_x[index] = 0.0f;
+    store->box_y[index] = 0.0f;
+    store->box_w[index] = store->w[index];
+    store->box_h[index] = store->h[index];
+    store->sprite[index] = sprite;
+    ng_animation_start(&store->animation[index], NULL, NULL);
+    store->layer[index] = layer;
+    store->kind[index] = kind;
+
+    return (ng_entity_t){slot, store->generations[slot]};
+}
+
+void ng_entities_remove_at(ng_entity_store_t *store, int index)
+{
+    uint32_t slot = store->slots[index];
+    int last = --store->count;
+
+    // Fill the hole with the last entity so that the arrays stay packed
+    if (index != last)
+    {
+        store->x[index] = store->x[last];
+        store->y[index] = store->y[last];
+        store->w[index] = store->w[last];
+        store->h[index] = store->h[last];
+        store->vx[index] = store->vx[last];
+        store->vy[index] = store->vy[last];
+        store->box_x[index] = store->box_x[last];
+        store->box_y[index] = store->box_y[last];
+        store->box_w[index] = store->box_w[last];
+        store->box_h[index] = store->box_h[last];
+        store->sprite[index] = store->sprite[last];
+        store->animation[index] = store->animation[last];
+        store->layer[index] = store->layer[last];
+        store->kind[index] = store->kind[last];
+
+        store->slots[index] = store->slots[last];
+        store->sparse[store->slots[index]] = index;
+    }
+
+    // Every handle to this slot is stale from now on
+    store->generations[slot]++;
+    store->sparse[slot] = store->free_slot;
+    store->free_slot = slot;
+}
+
+void ng_entities_remove(ng_entity_store_t *store, ng_entity_t entity)
+{
+    int index = ng_entities_index(store, entity);
+
+    if (index >= 0)
+        ng_entities_remove_at(store, index);
+}
+
+void ng_entities_clear(ng_entity_store_t *store)
+{
+    while (store->count > 0)
+        ng_entities_remove_at(store, store->count - 1);
+}
+
+bool ng_entities_is_alive(ng_entity_store_t *store, ng_entity_t entity)
+{
+    return entity.slot < store->slot_count && entity.generation != 0 &&
+           store->generations[entity.slot] == entity.generation;
+}
+
+int ng_entities_index(ng_entity_store_t *store, ng_entity_t entity)
+{
+    return ng_entities_is_alive(store, entity) ? (int)store->sparse[entity.slot] : -1;
+}
+
+ng_entity_t ng_entities_handle(ng_entity_store_t *store, int index)
+{
+    uint32_t slot = store->slots[index];
+    return (ng_entity_t){slot, store->generations[slot]};
+}
+
+void ng_entities_get_box(ng_entity_store_t *store, int index, SDL_FRect *result)
+{
+    result->x = store->x[index] + store->box_x[index];
+    result->y = store->y[index] + store->box_y[index];
+    result->w = store->box_w[index];
+    result->h = store->box_h[index];
+}
+
+void ng_entities_integrate(ng_entity_store_t *store, float delta)
+{
+    // Components are separate arrays, so every axis is one batch operation
+    ng_batch_multiply_add(store->x, store->vx, delta, store->count);
+    ng_batch_multiply_add(store->y, store->vy, delta, store->count);
+}
+
+void ng_entities_animate(ng_entity_store_t *store, float delta)
+{
+    ng_animation_advance_all(store->animation, store->count, delta);
+}
+
+void ng_entities_render(ng_entity_store_t *store, ng_sprite_batch_t *batch)
+{
+    for (int i = 0; i < store->count; i++)
+    {
+        ng_animated_sprite_t *anim = store->sprite[i];
+        SDL_FRect transform = {store->x[i], store->y[i], store->w[i], store->h[i]};
+
+        // The batch copies the source rectangle right away, so sharing
+        // the template between entities on different frames is fine
+        if (anim->frame != store->animation[i].frame)
+            ng_animated_set_frame(anim, store->animation[i].frame);
+
+        ng_sprite_batch_add_transformed(batch, &anim->sprite, &transform,
+                                        store->layer[i], SDL_FLIP_NONE);
+    }
+}
@@ -0,0 +1,89 @@
+#ifndef _NG_ENTITIES_H
+#define _NG_ENTITIES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sprite.h"
+#include "animation.h"
+
+/*
+ * Handles stay valid until the entity is removed. Removing bumps the slot's
+ * generation, so old handles to a reused slot are simply not alive anymore
+ * instead of silently pointing at some other entity
+ */
+typedef struct
+{
+    uint32_t slot;
+    uint32_t generation;
+} ng_entity_t;
+
+// Generations start at 1, so a zeroed handle never refers to anything
+#define NG_ENTITY_NONE ((ng_entity_t){0, 0})
+
+/*
+ * Entities are stored as a structure of arrays: every component has its own
+ * tightly packed array and entity i lives at index i in all of them. Passes that
+ * only need positions and velocities walk through contiguous floats, not through
+ * whole sprites. Removing swaps the last entity into the hole, so the arrays
+ * never have gaps (and indices change, handles don't)
+ *
+ * NOTE: Anything in 0..count-1 is alive, iterate backwards when removing
+ */
+typedef struct
+{
+    int count, capacity;
+
+    // Position of the top left corner and size on screen
+    float *x, *y;
+    float *w, *h;
+
+    // Pixels per second, applied by ng_entities_integrate()
+    float *vx, *vy;
+
+    // Collision box, relative to the position
+    float *box_x, *box_y, *box_w, *box_h;
+
+    // What it looks like, the sprite is only a template shared by every
+    // entity using it, each entity plays its own animation (without a sprite)
+    ng_animated_sprite_t **sprite;
+    ng_animation_t *animation;
+    int *layer;
+
+    // Whatever the game wants to tell entities apart with
+    int *kind;
+
+    // Which slot owns every dense index
+    uint32_t *slots;
+
+    // Slot -> dense index, or the next free slot while the slot is unused
+    uint32_t *sparse;
+    uint32_t *generations;
+    uint32_t slot_count, slot_capacity;
+    uint32_t free_slot;
+} ng_entity_store_t;
+
+void ng_entities_create(ng_entity_store_t *store, int initial_capacity);
+void ng_entities_destroy(ng_entity_store_t *store);
+
+// The entity starts at (x, y) with the sprite's size, no velocity, on the sprite's
+// first frame without any animation and with a collision box covering all of it
+ng_entity_t ng_entities_add(ng_entity_store_t *store, ng_animated_sprite_t *sprite,
+                            int kind, int layer, float x, float y);
+void ng_entities_remove(ng_entity_store_t *store, ng_entity_t entity);
+void ng_entities_remove_at(ng_entity_store_t *store, int index);
+void ng_entities_clear(ng_entity_store_t *store);
+
+bool ng_entities_is_alive(ng_entity_store_t *store, ng_entity_t entity);
+// Dense index of a live entity, -1 otherwise
+int ng_entities_index(ng_entity_store_t *store, ng_entity_t entity);
+ng_entity_t ng_entities_handle(ng_entity_store_t *store, int index);
+
+void ng_entities_get_box(ng_entity_store_t *store, int index, SDL_FRect *result);
+
+// Moves everything by its velocity
+void ng_entities_integrate(ng_entity_store_t *store, float delta);
+// Advances every entity's animation, all of them in one pass
+void ng_entities_animate(ng_entity_store_t *store, float delta);
+void ng_entities_render(ng_entity_store_t *store, ng_sprite_batch_t *batch);
+
+#endif
@@ -1,18 +1,50 @@
 #include "game.h"
 #include "common.h"
+#include "replay.h"
+#include "loader.h"
+#include "assets.h"
+#include "profiler.h"
+#include "mixer.h"
+#include "layers.h"
 #include <SDL2/SDL_image.h>
 #include <SDL2/SDL_ttf.h>
 #include <SDL2/SDL_mixer.h>
+#include <stdio.h>
+#include <string.h>
 #include <time.h>
 
 // You might want to change that!
-#define FPS 60
-#define IDEAL_MS_PER_FRAME (1000.0 / FPS)
+#define DEFAULT_FPS 60
+#define DEFAULT_TICK_RATE 60
 
-void ng_game_create(ng_game_t *game, const char *title, int width, int height)
+// After a long hitch (debugger, dragging the window...) don't try to
+// catch up on seconds of simulation, that would only make the next frame slower
+#define MAX_FRAME_DELTA 0.25
+
+// SDL_Delay() can oversleep by a millisecond or two depending on the
+// scheduler, so we wake up a little early and spin for the remainder
+#define SLEEP_MARGIN_SECONDS 0.002
+
+// Events on their way from the main thread to the simulation thread
+#define EVENT_QUEUE_SIZE 1024
+#define EVENT_QUEUE_MASK (EVENT_QUEUE_SIZE - 1)
+
+// The render thread sleeps this long at most when there's nothing new to draw,
+// so that it keeps pumping events even if the simulation is busy
+#define RENDER_WAIT_MS 4
+
+// A function the simulation thread waits on, see ng_game_call_on_render_thread()
+typedef struct
+{
+    void (*function)(void *data);
+    void *data;
+} render_call_t;
+
+static void init_subsystems(ng_game_t *game)
 {
     // Provide the randomness generator with a unique seed
-    srand(time(NULL));
+    game->seed = time(NULL);
+    srand(game->seed);
     
     // Initializing SDL components
     if (SDL_Init(SDL_INIT_VIDEO) < 0)
@@ -24,14 +56,93 @@ void ng_game_create(ng_game_t *game, const char *title, int width, int height)
     if (TTF_Init() < 0)
         ng_die("failed to initialize SDL2/SDL_ttf");
 
+    // The fastest batch kernels the CPU has, picked before the audio callback mixes with them
+    ng_batch_set_level(NG_SIMD_AVX2);
+
     // Initializing SDL_mixer with the standard settings
 #ifndef NO_AUDIO
     if (Mix_OpenAudio(44100, MIX_DEFAULT_FORMAT, 2, 2048) < 0)
         ng_die("failed to open audio device and initialize SDL_Mixer");
+
+    // Sound effects are mixed by the engine on top of the music (see mixer.h)
+    int frequency, channels;
+    Uint16 format;
+    Mix_QuerySpec(&frequency, &format, &channels);
+
+    if (format != AUDIO_S16SYS)
+        ng_die("the mixer only supports 16 bit audio");
+
+    ng_mixer_init(frequency, channels);
+    Mix_SetPostMix(ng_mixer_post_mix, NULL);
 #endif
-    
+
+    // Worker threads that decode assets in the background
+    ng_loader_init(0);
+}
+
+static void init_loop_state(ng_game_t *game, int width, int height)
+{
     game->width = width;
     game->height = height;
+
+    game->handle_update = NULL;
+    game->perf_frequency = SDL_GetPerformanceFrequency();
+    game->last_counter = SDL_GetPerformanceCounter();
+    game->tick_rate = DEFAULT_TICK_RATE;
+    game->max_fps = DEFAULT_FPS;
+    game->accumulator = 0.0;
+
+    game->max_frames = 0;
+    game->frame_count = 0;
+    game->quads_submitted = game->quads_culled = 0;
+    game->frame_ms = 0.0;
+    SDL_AtomicSet(&game->draw_us, 0);
+
+    game->time = 0.0;
+    game->replay = NULL;
+    ng_scheduler_create(&game->scheduler);
+
+    SDL_AtomicSet(&game->show_profiler, 0);
+    game->is_running = true;
+
+    // Nothing outside of the window ever reaches the renderer
+    SDL_FRect screen = {0, 0, width, height};
+
+    for (int i = 0; i < NG_GAME_DRAW_LISTS; i++)
+    {
+        ng_sprite_batch_create(&game->draw_lists[i]);
+        ng_sprite_batch_set_viewport(&game->draw_lists[i], &screen);
+    }
+
+    // The simulation starts on the first list, the render thread pretends
+    // it drew the last one and the one in between is ready but stale
+    game->writing_list = 0;
+    SDL_AtomicSet(&game->ready_list, 1);
+    game->reading_list = 2;
+    game->cached_layer_count = 0;
+
+    game->is_threaded = false;
+    game->render_thread = 0;
+    game->simulation = NULL;
+    SDL_AtomicSet(&game->simulation_done, 0);
+
+    game->events = NULL;
+    SDL_AtomicSet(&game->event_head, 0);
+    SDL_AtomicSet(&game->event_tail, 0);
+    memset(game->keys, 0, sizeof(game->keys));
+
+    game->render_signal = NULL;
+    game->render_call = NULL;
+    game->render_call_done = NULL;
+}
+
+void ng_game_create(ng_game_t *game, const char *title, int width, int height)
+{
+    init_subsystems(game);
+    init_loop_state(game, width, height);
+
+    game->is_headless = false;
+    game->surface = NULL;
     
     // Creating the window at the center of the screen with the specified properties
     game->window = SDL_CreateWindow(title, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
@@ -43,7 +154,252 @@ void ng_game_create(ng_game_t *game, const char *title, int width, int height)
     // -1: Initialize the first available rendering GPU driver
     game->renderer = SDL_CreateRenderer(game->window, -1, SDL_RENDERER_ACCELERATED);
 
-    game->is_running = true;
+    // Only worth it when the two threads can actually run at the same time
+#ifndef __EMSCRIPTEN__
+    game->is_threaded = SDL_GetCPUCount() > 1;
+#endif
+}
+
+void ng_game_create_headless(ng_game_t *game, int width, int height)
+{
+    // These have to be set before SDL initializes its subsystems
+    // The dummy audio driver still consumes samples, so audio code keeps working
+    SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+    SDL_setenv("SDL_AUDIODRIVER", "dummy", 1);
+
+    init_subsystems(game);
+    init_loop_state(game, width, height);
+
+    game->is_headless = true;
+    game->window = NULL;
+    game->max_fps = 0;
+
+    // Frames go by far faster than real time, timers have to keep up with them
+    ng_game_use_simulated_clock(game);
+
+    // Everything gets rasterized by the CPU into an offscreen surface
+    game->surface = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_ARGB8888);
+
+    if (!game->surface)
+        ng_die("failed to create the offscreen surface for headless rendering");
+
+    game->renderer = SDL_CreateSoftwareRenderer(game->surface);
+
+    if (!game->renderer)
+        ng_die("failed to create the software renderer for headless rendering");
+}
+
+void ng_game_set_max_frames(ng_game_t *game, uint64_t max_frames)
+{
+    game->max_frames = max_frames;
+}
+
+void ng_game_set_tick_rate(ng_game_t *game, unsigned int tick_rate)
+{
+    if (tick_rate == 0)
+        ng_die("the tick rate of the fixed game loop can't be zero");
+
+    game->tick_rate = tick_rate;
+}
+
+void ng_game_set_max_fps(ng_game_t *game, unsigned int max_fps)
+{
+    game->max_fps = max_fps;
+}
+
+void ng_game_set_threaded(ng_game_t *game, bool is_threaded)
+{
+    game->is_threaded = is_threaded;
+}
+
+// Seconds between two performance counter values
+static double counter_to_seconds(ng_game_t *game, uint64_t start, uint64_t end)
+{
+    return (double)(end - start) / game->perf_frequency;
+}
+
+// Don't update too fast, introduce an FPS limit!
+// This is an important performance measure, since
+// updating faster is pointless! The frequency is too fast
+// for it to ever be visible on the monitor
+static void pace_frame(ng_game_t *game, uint64_t frame_start)
+{
+#ifndef __EMSCRIPTEN__
+    // The browser already paces us through requestAnimationFrame
+    if (game->max_fps == 0)
+        return;
+
+    double frame_budget = 1.0 / game->max_fps;
+    double remaining = frame_budget - counter_to_seconds(game, frame_start, SDL_GetPerformanceCounter());
+
+    // Sleep through most of what's left, giving the CPU back to the OS...
+    if (remaining > SLEEP_MARGIN_SECONDS)
+        SDL_Delay((uint32_t)((remaining - SLEEP_MARGIN_SECONDS) * 1000.0));
+
+    // ...then spin for the last bit, which is way more precise than sleeping
+    while (counter_to_seconds(game, frame_start, SDL_GetPerformanceCounter()) < frame_budget)
+        ;
+#endif
+}
+
+static void report_throughput(ng_game_t *game)
+{
+    double elapsed = counter_to_seconds(game, game->start_counter, SDL_GetPerformanceCounter());
+
+    printf("simulated %llu frames in %.3f seconds (%.1f frames per second)\n",
+           (unsigned long long)game->frame_count, elapsed,
+           elapsed > 0.0 ? game->frame_count / elapsed : 0.0);
+
+    if (game->frame_count > 0)
+        printf("draw lists: %.1f quads submitted and %.1f culled per frame\n",
+               (double)game->quads_submitted / game->frame_count,
+               (double)game->quads_culled / game->frame_count);
+
+#ifndef NO_AUDIO
+    // The dummy audio driver still runs the mixer in real time
+    ng_mixer_stats_t audio;
+    ng_mixer_get_stats(&audio);
+
+    printf("audio: %u commands (%u dropped), trigger latency %.2f ms (max %.2f ms), "
+           "callback %.3f ms per %.1f ms buffer\n",
+           audio.commands, audio.dropped_commands,
+           audio.last_latency_us / 1000.0, audio.max_latency_us / 1000.0,
+           audio.callback_us / 1000.0, audio.buffer_us / 1000.0);
+#endif
+}
+
+// Everything that happens once the loop stops
+static void quit_game(ng_game_t *game)
+{
+    if (game->is_headless)
+        report_throughput(game);
+
+    if (game->replay)
+        ng_replay_finish(game->replay);
+
+    ng_game_destroy(game);
+
+#ifdef __EMSCRIPTEN__
+    emscripten_cancel_main_loop();
+#else
+    exit(EXIT_SUCCESS);
+#endif
+}
+
+// Calculate the amount of seconds that passed since the last frame
+static double get_frame_delta(ng_game_t *game, uint64_t frame_start)
+{
+    double delta = counter_to_seconds(game, game->last_counter, frame_start);
+    game->last_counter = frame_start;
+
+    delta = MIN(delta, MAX_FRAME_DELTA);
+
+    // Headless runs aren't tied to the wall clock, every frame is exactly one tick
+    if (game->is_headless)
+        delta = 1.0 / game->tick_rate;
+
+    return delta;
+}
+
+static void dispatch_event(ng_game_t *game, SDL_Event *event)
+{
+    // The cached layers' textures may have lost their content
+    if (event->type == SDL_RENDER_TARGETS_RESET)
+        ng_cached_layers_invalidate_all(game);
+
+    // SDL_QUIT = the window is about to close, for whatever
+    // reason (exit button, alt f4 etc)
+    if (event->type == SDL_QUIT)
+        game->is_running = false;
+    else if (!game->replay || ng_replay_capture_event(game->replay, event))
+        game->handle_event(event);
+}
+
+// Runs the updates that are due and then the render handler, which fills the current draw list
+static void simulate(ng_game_t *game, double delta)
+{
+    if (game->handle_update)
+    {
+        // Consume the elapsed time in constant steps, so that the
+        // simulation behaves the same no matter the frame rate
+        double step = 1.0 / game->tick_rate;
+        game->accumulator += delta;
+
+        while (game->accumulator >= step)
+        {
+            NG_PROFILE_BEGIN("update");
+            game->time += step;
+            ng_scheduler_advance(&game->scheduler, step);
+            game->handle_update(step);
+            game->accumulator -= step;
+            NG_PROFILE_END();
+        }
+
+        // Whatever is left over tells the renderer how far we are into the next step
+        NG_PROFILE_BEGIN("render");
+        game->handle_render(game->accumulator / step);
+        NG_PROFILE_END();
+    }
+    else
+    {
+        game->time += delta;
+        ng_scheduler_advance(&game->scheduler, delta);
+
+        NG_PROFILE_BEGIN("render");
+        game->handle_render(delta);
+        NG_PROFILE_END();
+    }
+
+    // Drawing the list empties it, along with its stats
+    ng_sprite_batch_t *list = ng_game_get_draw_list(game);
+    game->quads_submitted += list->count;
+    game->quads_culled += list->culled;
+
+    NG_PROFILE_COUNT(NG_COUNTER_QUADS_SUBMITTED, list->count);
+    NG_PROFILE_COUNT(NG_COUNTER_QUADS_CULLED, list->culled);
+}
+
+static void draw(ng_game_t *game, int list)
+{
+    // Layers that changed come first, the list only holds a quad for each of them
+    ng_cached_layers_update(game, list);
+
+    SDL_SetRenderDrawColor(game->renderer, 10, 10, 10, 255);
+    SDL_RenderClear(game->renderer);
+
+    ng_sprite_batch_flush(&game->draw_lists[list], game->renderer);
+
+    // With a render thread the simulation keeps recording frames meanwhile,
+    // at worst the newest bar shows up a frame late
+    if (SDL_AtomicGet(&game->show_profiler))
+    {
+        SDL_FRect area = {8, 8, game->width / 2.0f, game->height / 5.0f};
+        ng_profiler_draw_overlay(game->renderer, &area);
+    }
+
+    // Sends the instructions into our GPU, updates the screen
+    NG_PROFILE_BEGIN("present");
+    SDL_RenderPresent(game->renderer);
+    NG_PROFILE_END();
+}
+
+static void end_frame(ng_game_t *game, uint64_t frame_start)
+{
+    game->frame_ms = counter_to_seconds(game, frame_start, SDL_GetPerformanceCounter()) * 1000.0;
+
+    // The last draw of the render thread, whichever frame it was
+    if (game->render_thread != 0)
+        game->frame_ms = MAX(game->frame_ms, SDL_AtomicGet(&game->draw_us) / 1000.0);
+
+    NG_PROFILE_BEGIN("pace");
+    pace_frame(game, frame_start);
+    NG_PROFILE_END();
+
+    ng_profiler_frame_end();
+
+    game->frame_count++;
+    if (game->max_frames > 0 && game->frame_count >= game->max_frames)
+        game->is_running = false;
 }
 
 static void main_game_loop(void *args)
@@ -53,71 +409,349 @@ static void main_game_loop(void *args)
     ng_game_t *game = args;
 
     if (!game->is_running)
-    {
-        ng_game_destroy(game);
+        quit_game(game);
 
-    #ifdef __EMSCRIPTEN__
-        emscripten_cancel_main_loop();
-    #else
-        exit(EXIT_SUCCESS);
-    #endif
-    }
+    ng_profiler_frame_begin();
+
+    uint64_t frame_start = SDL_GetPerformanceCounter();
+    double delta = get_frame_delta(game, frame_start);
 
-    // Calculate the amount of seconds that passed since the last frame
-    uint32_t cur_time = SDL_GetTicks();
-    float delta = (cur_time - game->last_time) / 1000.0f;
-    game->last_time = cur_time;
+    // Replays overwrite the delta with the recorded one
+    if (game->replay && !ng_replay_begin_frame(game->replay, &delta))
+    {
+        ng_profiler_frame_end();
+        game->is_running = false;
+        return;
+    }
 
+    NG_PROFILE_BEGIN("events");
     static SDL_Event event;
     while (SDL_PollEvent(&event))
+        dispatch_event(game, &event);
+
+    while (game->replay && ng_replay_next_event(game->replay, &event))
+        game->handle_event(&event);
+    NG_PROFILE_END();
+
+    // Upload whatever finished decoding in the background since the last frame
+    NG_PROFILE_BEGIN("assets");
+    ng_assets_pump();
+    NG_PROFILE_END();
+
+    simulate(game, delta);
+    draw(game, game->writing_list);
+
+    if (game->replay)
+        ng_replay_end_frame(game->replay, delta,
+                            counter_to_seconds(game, frame_start, SDL_GetPerformanceCounter()));
+
+    end_frame(game, frame_start);
+}
+
+// Only the main thread pushes, only the simulation thread pops
+static bool push_event(ng_game_t *game, const SDL_Event *event)
+{
+    unsigned int head = (unsigned int)SDL_AtomicGet(&game->event_head);
+    unsigned int tail = (unsigned int)SDL_AtomicGet(&game->event_tail);
+
+    if (head - tail >= EVENT_QUEUE_SIZE)
+        return false;
+
+    game->events[head & EVENT_QUEUE_MASK] = *event;
+
+    // Publishes the event, SDL's atomics are full barriers
+    SDL_AtomicSet(&game->event_head, (int)(head + 1));
+    return true;
+}
+
+static bool pop_event(ng_game_t *game, SDL_Event *event)
+{
+    unsigned int tail = (unsigned int)SDL_AtomicGet(&game->event_tail);
+
+    if (tail == (unsigned int)SDL_AtomicGet(&game->event_head))
+        return false;
+
+    *event = game->events[tail & EVENT_QUEUE_MASK];
+    SDL_AtomicSet(&game->event_tail, (int)(tail + 1));
+    return true;
+}
+
+// Hands the finished draw list over and carries on with whichever one comes back
+static void publish_draw_list(ng_game_t *game)
+{
+    int previous = SDL_AtomicSet(&game->ready_list, game->writing_list + NG_GAME_DRAW_LISTS);
+    game->writing_list = previous % NG_GAME_DRAW_LISTS;
+
+    // Still full if the render thread never got to it, that frame is simply skipped
+    ng_sprite_batch_clear(&game->draw_lists[game->writing_list]);
+}
+
+// Swaps the newest finished draw list for the one that was drawn last, if there's a new one
+static bool take_draw_list(ng_game_t *game)
+{
+    // Only the render thread takes lists, so a new one can't go away in between
+    if (SDL_AtomicGet(&game->ready_list) < NG_GAME_DRAW_LISTS)
+        return false;
+
+    int ready = SDL_AtomicSet(&game->ready_list, game->reading_list);
+    game->reading_list = ready % NG_GAME_DRAW_LISTS;
+
+    return true;
+}
+
+static void run_render_call(ng_game_t *game)
+{
+    render_call_t *call = SDL_AtomicGetPtr(&game->render_call);
+
+    if (!call)
+        return;
+
+    ng_profiler_render_begin();
+    NG_PROFILE_BEGIN("render call");
+    call->function(call->data);
+    NG_PROFILE_END();
+    ng_profiler_render_end();
+
+    // The pending list was finished before the call, it may point at textures
+    // the call just destroyed. The simulation is about to send a new one anyways
+    if (take_draw_list(game))
+        ng_sprite_batch_clear(&game->draw_lists[game->reading_list]);
+
+    SDL_AtomicSetPtr(&game->render_call, NULL);
+    SDL_SemPost(game->render_call_done);
+}
+
+static void pump_assets(void *data)
+{
+    ng_assets_pump();
+}
+
+static int simulation_thread(void *data)
+{
+    ng_game_t *game = data;
+
+    while (game->is_running)
     {
-        // SDL_QUIT = the window is about to close, for whatever
-        // reason (exit button, alt f4 etc)
-        if (event.type == SDL_QUIT)
-            game->is_running = false;
-        else
-            game->handle_event(&event);
+        ng_profiler_frame_begin();
+
+        uint64_t frame_start = SDL_GetPerformanceCounter();
+        double delta = get_frame_delta(game, frame_start);
+
+        NG_PROFILE_BEGIN("events");
+        SDL_Event event;
+        while (pop_event(game, &event))
+        {
+            // SDL_GetKeyboardState() changes whenever the main thread pumps events,
+            // this one only changes along with the events the game has seen
+            if (event.type == SDL_KEYDOWN || event.type == SDL_KEYUP)
+                game->keys[event.key.keysym.scancode] = event.key.state == SDL_PRESSED;
+
+            dispatch_event(game, &event);
+        }
+        NG_PROFILE_END();
+
+        // Uploading needs the renderer, only bother the render thread while something is loading
+        if (ng_assets_is_loading())
+        {
+            NG_PROFILE_BEGIN("assets");
+            ng_game_call_on_render_thread(game, pump_assets, NULL);
+            NG_PROFILE_END();
+        }
+
+        simulate(game, delta);
+        publish_draw_list(game);
+        SDL_SemPost(game->render_signal);
+
+        end_frame(game, frame_start);
     }
 
-    SDL_SetRenderDrawColor(game->renderer, 10, 10, 10, 255);
-    SDL_RenderClear(game->renderer);
+    SDL_AtomicSet(&game->simulation_done, 1);
+    SDL_SemPost(game->render_signal);
 
-    game->handle_render(delta);
+    return 0;
+}
 
-    // Sends the instructions into our GPU, updates the screen
-    SDL_RenderPresent(game->renderer);
+// The main thread only pumps events and draws, see ng_game_set_threaded()
+static void run_threaded_loop(ng_game_t *game)
+{
+    game->events = malloc(EVENT_QUEUE_SIZE * sizeof(SDL_Event));
+    game->render_signal = SDL_CreateSemaphore(0);
+    game->render_call_done = SDL_CreateSemaphore(0);
 
-    // Don't update too fast, introduce an FPS limit!
-    // This is an important performance measure, since
-    // updating faster is pointless! The frequency is too fast
-    // for it to ever be visible on the monitor
-    if (delta < IDEAL_MS_PER_FRAME)
-        SDL_Delay(IDEAL_MS_PER_FRAME - delta);
+    if (!game->events || !game->render_signal || !game->render_call_done)
+        ng_die("failed to set up the render thread");
+
+    // Set before the simulation starts, it checks this right away
+    game->render_thread = SDL_ThreadID();
+    game->simulation = SDL_CreateThread(simulation_thread, "ng_simulation", game);
+    if (!game->simulation)
+        ng_die("failed to start the simulation thread: %s", SDL_GetError());
+
+    while (!SDL_AtomicGet(&game->simulation_done))
+    {
+        SDL_Event event;
+        while (SDL_PollEvent(&event))
+        {
+            // Only ever full if the simulation is stuck, it empties the queue every frame
+            while (!push_event(game, &event) && !SDL_AtomicGet(&game->simulation_done))
+            {
+                run_render_call(game);
+                SDL_Delay(1);
+            }
+        }
+
+        run_render_call(game);
+
+        if (take_draw_list(game))
+        {
+            uint64_t draw_start = SDL_GetPerformanceCounter();
+
+            ng_profiler_render_begin();
+            draw(game, game->reading_list);
+            ng_profiler_render_end();
+
+            SDL_AtomicSet(&game->draw_us,
+                          (int)(counter_to_seconds(game, draw_start, SDL_GetPerformanceCounter()) * 1000000.0));
+        }
+        else
+            SDL_SemWaitTimeout(game->render_signal, RENDER_WAIT_MS);
+    }
+
+    SDL_WaitThread(game->simulation, NULL);
+    game->simulation = NULL;
+
+    quit_game(game);
 }
 
-void ng_game_start_loop(ng_game_t *game, event_handler_t ev, render_handler_t re)
+static void run_loop(ng_game_t *game)
 {
-    game->handle_event = ev;
-    game->handle_render = re;
+    // Don't count the loading time as part of the first frame
+    game->last_counter = game->start_counter = SDL_GetPerformanceCounter();
+    game->accumulator = 0.0;
+    game->frame_count = 0;
 
 #ifdef __EMSCRIPTEN__
     // If we're running on the web, we need to wrap around emscripten
     emscripten_set_main_loop_arg(main_game_loop, game, 0, true);
 #else
+    // Replays need every frame to see exactly the input it recorded
+    if (game->is_threaded && !game->is_headless && !game->replay)
+        run_threaded_loop(game);
+
     for (;;) main_game_loop(game);
 #endif
 }
 
+void ng_game_start_loop(ng_game_t *game, event_handler_t ev, render_handler_t re)
+{
+    game->handle_event = ev;
+    game->handle_update = NULL;
+    game->handle_render = re;
+
+    run_loop(game);
+}
+
+void ng_game_start_fixed_loop(ng_game_t *game, event_handler_t ev,
+                              update_handler_t up, render_handler_t re)
+{
+    game->handle_event = ev;
+    game->handle_update = up;
+    game->handle_render = re;
+
+    run_loop(game);
+}
+
+ng_sprite_batch_t* ng_game_get_draw_list(ng_game_t *game)
+{
+    return &game->draw_lists[game->writing_list];
+}
+
+void ng_game_call_on_render_thread(ng_game_t *game, void (*function)(void *data), void *data)
+{
+    if (game->render_thread == 0 || SDL_ThreadID() == game->render_thread)
+    {
+        function(data);
+        return;
+    }
+
+    render_call_t call = {function, data};
+    SDL_AtomicSetPtr(&game->render_call, &call);
+    SDL_SemPost(game->render_signal);
+
+    SDL_SemWait(game->render_call_done);
+}
+
+const Uint8* ng_game_get_keyboard_state(ng_game_t *game)
+{
+    if (game->replay && game->replay->mode == NG_REPLAY_PLAYING)
+        return game->replay->keys;
+
+    if (game->render_thread != 0)
+        return game->keys;
+
+    return SDL_GetKeyboardState(NULL);
+}
+
+uint32_t ng_game_get_time_ms(ng_game_t *game)
+{
+    return (uint32_t)(game->time * 1000.0);
+}
+
+// Timers only take a plain function, there's a single game anyways
+static ng_game_t *clock_game;
+
+static uint32_t simulated_clock(void)
+{
+    return ng_game_get_time_ms(clock_game);
+}
+
+void ng_game_use_simulated_clock(ng_game_t *game)
+{
+    clock_game = game;
+    ng_timers_set_clock(simulated_clock);
+}
+
+double ng_game_get_frame_ms(ng_game_t *game)
+{
+    return game->frame_ms;
+}
+
 // Clearing up all SDL components
 void ng_game_destroy(ng_game_t *game)
 {
+#ifndef NO_AUDIO
+    // The post-mix callback goes first, while the device it runs on still exists,
+    // so that it can't mix anything that gets freed from here on
+    Mix_SetPostMix(NULL, NULL);
+    Mix_CloseAudio();
+    Mix_Quit();
+#endif
+
+    // Everything the registry still holds, before the renderer and the loader go away
+    ng_assets_shutdown();
+    ng_loader_shutdown();
+    ng_scheduler_destroy(&game->scheduler);
+
+    for (int i = 0; i < NG_GAME_DRAW_LISTS; i++)
+        ng_sprite_batch_destroy(&game->draw_lists[i]);
+
+    free(game->events);
+
+    if (game->render_signal)
+        SDL_DestroySemaphore(game->render_signal);
+
+    if (game->render_call_done)
+        SDL_DestroySemaphore(game->render_call_done);
+
     SDL_DestroyRenderer(game->renderer);
-    SDL_DestroyWindow(game->window);
 
-    SDL_Quit();
+    if (game->window)
+        SDL_DestroyWindow(game->window);
+
+    if (game->surface)
+        SDL_FreeSurface(game->surface);
+
     IMG_Quit();
     TTF_Quit();
-#ifndef NO_AUDIO
-    Mix_Quit();
-#endif
+    SDL_Quit();
 }
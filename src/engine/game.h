@@ -9,9 +9,22 @@
 
 #include <SDL2/SDL.h>
 #include <stdbool.h>
+#include "scheduler.h"
+#include "sprite.h"
+
+// Defined in replay.h
+struct ng_replay_t;
+// Defined in layers.h
+struct ng_cached_layer_t;
 
 typedef void (*event_handler_t) (SDL_Event*);
 typedef void (*render_handler_t) (float delta);
+// Fixed loops call this with a constant delta, tick_rate times per second
+typedef void (*update_handler_t) (float delta);
+
+// The draw lists handed from the simulation to the render thread, see ng_game_get_draw_list()
+#define NG_GAME_DRAW_LISTS 3
+#define NG_GAME_MAX_CACHED_LAYERS 8
 
 // Just a wrapper around the most basic components
 // Can be extended later on and gain more power
@@ -22,17 +35,146 @@ typedef struct
 
     // Function pointers to constructor the game loop
     event_handler_t handle_event;
+    update_handler_t handle_update;
     render_handler_t handle_render;
 
     bool is_running;
     int width, height;
-    // Last time the frame was run
-    uint32_t last_time;
+
+    // Headless games have no window, the software renderer draws into this surface instead
+    bool is_headless;
+    SDL_Surface *surface;
+
+    // The loop stops by itself after this many frames (0 = run until quit)
+    uint64_t max_frames;
+    uint64_t frame_count;
+    // Counter value when the loop started, used for throughput reports
+    uint64_t start_counter;
+    // Quads that went into the draw lists and the ones culled for being off screen, over the whole run
+    uint64_t quads_submitted, quads_culled;
+    // How long the last frame took, not counting the wait for the frame cap, see ng_game_get_frame_ms()
+    double frame_ms;
+    // Microseconds the render thread spent on its last draw
+    SDL_atomic_t draw_us;
+
+    // Seconds of simulated time, advanced by every update
+    double time;
+    // The RNG seed, kept around so that replays can reproduce it
+    uint32_t seed;
+
+    // Optional input recording or playback (NULL = live input)
+    struct ng_replay_t *replay;
+
+    // Frame pacing uses the high resolution performance counter,
+    // SDL_GetTicks() is only precise to the millisecond
+    uint64_t perf_frequency;
+    // Counter value at the start of the last frame
+    uint64_t last_counter;
+
+    // Updates per second of the fixed loop, and the render cap (0 = unlimited)
+    unsigned int tick_rate;
+    unsigned int max_fps;
+    // Simulation time (in seconds) that hasn't been consumed by an update yet
+    double accumulator;
+
+    // Timers and delayed callbacks, they run on the simulated time right before
+    // the update they become due in (see scheduler.h)
+    ng_scheduler_t scheduler;
+
+    // Draws the profiler's frame time graph on top of every frame (when nonzero)
+    // Atomic since the handlers toggle it while the render thread is drawing
+    SDL_atomic_t show_profiler;
+
+    // The render handler doesn't draw anything itself, it fills a draw list that the
+    // loop flushes afterwards. With a render thread there are three of them so that
+    // neither side ever waits: the simulation fills one, the newest finished one sits
+    // in ready_list, and the render thread draws the last one
+    ng_sprite_batch_t draw_lists[NG_GAME_DRAW_LISTS];
+    int writing_list, reading_list;
+    // Index of the newest finished list, plus NG_GAME_DRAW_LISTS until the render thread takes it
+    SDL_atomic_t ready_list;
+
+    // Parts of the screen kept in textures of their own, see layers.h
+    struct ng_cached_layer_t *cached_layers[NG_GAME_MAX_CACHED_LAYERS];
+    int cached_layer_count;
+
+    // Updates and the render handler run on their own thread, see ng_game_set_threaded()
+    bool is_threaded;
+    // The thread that owns the renderer, 0 until the simulation got a thread of its own
+    SDL_threadID render_thread;
+    SDL_Thread *simulation;
+    SDL_atomic_t simulation_done;
+
+    // Events pumped by the main thread, on their way to the simulation
+    SDL_Event *events;
+    SDL_atomic_t event_head, event_tail;
+    // The keyboard as the simulation has seen it so far, rebuilt from those events
+    Uint8 keys[SDL_NUM_SCANCODES];
+
+    // Wakes the render thread up: a new draw list, a call, or the end of the simulation
+    SDL_sem *render_signal;
+    // Function the simulation is waiting on, see ng_game_call_on_render_thread()
+    void *render_call;
+    SDL_sem *render_call_done;
 } ng_game_t;
 
 void ng_game_create(ng_game_t *game, const char *title, int width, int height);
+
+// Runs without a window or GPU (dummy video and audio drivers, software renderer)
+// Every frame simulates exactly one tick and nothing is frame limited, so the
+// game runs as fast as the CPU allows. A throughput report is printed on exit
+void ng_game_create_headless(ng_game_t *game, int width, int height);
+void ng_game_set_max_frames(ng_game_t *game, uint64_t max_frames);
+
+void ng_game_set_tick_rate(ng_game_t *game, unsigned int tick_rate);
+void ng_game_set_max_fps(ng_game_t *game, unsigned int max_fps);
+
+/*
+ * Windowed games run the simulation (events, updates and the render handler) on a
+ * thread of their own, while the main thread pumps SDL's events, draws the newest
+ * finished draw list and presents it. A slow present only delays the picture, the
+ * simulation keeps its pace, and both overlap on machines with more than one core.
+ * The renderer stays on the main thread, which is the only one most drivers allow
+ *
+ * Headless games, replays and the web build always run on a single thread
+ * Turning it off runs everything back to back on the main thread, the way it's always been
+ *
+ * NOTE: With a render thread, anything that creates or destroys textures (loading
+ * assets, building atlases, a font's first label) has to go through
+ * ng_game_call_on_render_thread()
+ */
+void ng_game_set_threaded(ng_game_t *game, bool is_threaded);
+
+// Variable timestep: the render handler receives the frame's delta in seconds
 void ng_game_start_loop(ng_game_t *game, event_handler_t ev, render_handler_t re);
 
+// Fixed timestep: the update handler always receives 1 / tick_rate seconds and may
+// run zero or more times per frame. The render handler then receives the interpolation
+// alpha in [0, 1), how far the current frame is between the last two updates
+void ng_game_start_fixed_loop(ng_game_t *game, event_handler_t ev,
+                              update_handler_t up, render_handler_t re);
+
+// Where the render handler adds everything it draws, the loop flushes it afterwards
+// Quads entirely outside of the window get culled (see ng_sprite_batch_set_viewport)
+// NOTE: Only valid during the render handler, it's a different list every frame
+ng_sprite_batch_t* ng_game_get_draw_list(ng_game_t *game);
+
+// Runs the function on the thread that owns the renderer, and waits for it
+// The simulation is paused in the meantime, so the function may touch game state too
+// Without a render thread the function simply runs right away
+void ng_game_call_on_render_thread(ng_game_t *game, void (*function)(void *data), void *data);
+
+// Gameplay code should read the keyboard through this instead of SDL_GetKeyboardState(),
+// during a replay it returns the recorded state of the current frame
+const Uint8* ng_game_get_keyboard_state(ng_game_t *game);
+uint32_t ng_game_get_time_ms(ng_game_t *game);
+// Makes timers (see timers.h) follow the game's simulated time instead of the wall clock
+// Headless games and replays do this themselves
+void ng_game_use_simulated_clock(ng_game_t *game);
+// Milliseconds of work the last frame took, whatever the frame cap made it wait on top
+// With a render thread both threads work at the same time, so it's the slower one of the two
+double ng_game_get_frame_ms(ng_game_t *game);
+
 void ng_game_destroy(ng_game_t *game);
 
 #endif
@@ -1,32 +1,257 @@
 #include "interface.h"
+#include "common.h"
+#include "profiler.h"
 #include <SDL2/SDL.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Printable ASCII, anything else is drawn as FALLBACK_GLYPH
+#define FIRST_GLYPH 32
+#define LAST_GLYPH 126
+#define GLYPH_COUNT (LAST_GLYPH - FIRST_GLYPH + 1)
+#define FALLBACK_GLYPH '?'
+
+#define GLYPH_ATLAS_WIDTH 512
+#define GLYPH_PADDING 1
+
+typedef struct ng_glyph_cache_t
+{
+    TTF_Font *font;
+    SDL_Texture *texture;
+
+    SDL_Rect rects[GLYPH_COUNT];
+    int advances[GLYPH_COUNT];
+    int line_skip;
+
+    struct ng_glyph_cache_t *next;
+} ng_glyph_cache_t;
+
+// There's only ever a handful of fonts, a list is plenty
+static ng_glyph_cache_t *caches = NULL;
 
 // Default font color
 static SDL_Color white = {255, 255, 255, 255};
 
+static int glyph_index(char c)
+{
+    unsigned char code = (unsigned char)c;
+
+    if (code < FIRST_GLYPH || code > LAST_GLYPH)
+        code = FALLBACK_GLYPH;
+
+    return code - FIRST_GLYPH;
+}
+
+static ng_glyph_cache_t *create_cache(TTF_Font *font, SDL_Renderer *renderer)
+{
+    ng_glyph_cache_t *cache = calloc(1, sizeof(ng_glyph_cache_t));
+    SDL_Surface *glyphs[GLYPH_COUNT];
+
+    if (cache == NULL)
+        ng_die("ran out of memory while creating a glyph cache");
+
+    NG_PROFILE_COUNT(NG_COUNTER_GLYPH_RASTERIZATIONS, 1);
+
+    cache->font = font;
+    cache->line_skip = TTF_FontLineSkip(font);
+
+    // Glyphs are rendered white so that labels can tint them with any color,
+    // then placed on shelves one after the other
+    int x = 0, y = 0, shelf_height = 0;
+
+    for (int i = 0; i < GLYPH_COUNT; i++)
+    {
+        glyphs[i] = TTF_RenderGlyph_Solid(font, FIRST_GLYPH + i, white);
+
+        if (TTF_GlyphMetrics(font, FIRST_GLYPH + i, NULL, NULL, NULL, NULL, &cache->advances[i]) != 0)
+            cache->advances[i] = 0;
+
+        if (glyphs[i] == NULL)
+            continue;
+
+        if (x + glyphs[i]->w > GLYPH_ATLAS_WIDTH)
+        {
+            x = 0;
+            y += shelf_height + GLYPH_PADDING;
+            shelf_height = 0;
+        }
+
+        cache->rects[i] = (SDL_Rect){x, y, glyphs[i]->w, glyphs[i]->h};
+
+        x += glyphs[i]->w + GLYPH_PADDING;
+        shelf_height = MAX(shelf_height, glyphs[i]->h);
+    }
+
+    SDL_Surface *atlas = SDL_CreateRGBSurfaceWithFormat(0, GLYPH_ATLAS_WIDTH, y + shelf_height,
+                                                        32, SDL_PIXELFORMAT_RGBA32);
+    if (atlas == NULL)
+        ng_die("failed to create a glyph atlas: %s", SDL_GetError());
+
+    for (int i = 0; i < GLYPH_COUNT; i++)
+    {
+        if (glyphs[i] == NULL)
+            continue;
+
+        // Solid glyphs are color keyed, so only the glyph itself ends up opaque
+        SDL_BlitSurface(glyphs[i], NULL, atlas, &cache->rects[i]);
+        SDL_FreeSurface(glyphs[i]);
+    }
+
+    cache->texture = SDL_CreateTextureFromSurface(renderer, atlas);
+    SDL_FreeSurface(atlas);
+
+    if (cache->texture == NULL)
+        ng_die("failed to upload a glyph atlas: %s", SDL_GetError());
+
+    SDL_SetTextureBlendMode(cache->texture, SDL_BLENDMODE_BLEND);
+
+    cache->next = caches;
+    caches = cache;
+
+    return cache;
+}
+
+static ng_glyph_cache_t *get_cache(TTF_Font *font, SDL_Renderer *renderer)
+{
+    for (ng_glyph_cache_t *cache = caches; cache != NULL; cache = cache->next)
+    {
+        if (cache->font == font)
+            return cache;
+    }
+
+    return create_cache(font, renderer);
+}
+
+void ng_glyph_cache_drop(TTF_Font *font)
+{
+    for (ng_glyph_cache_t **link = &caches; *link != NULL; link = &(*link)->next)
+    {
+        ng_glyph_cache_t *cache = *link;
+
+        if (cache->font == font)
+        {
+            *link = cache->next;
+            SDL_DestroyTexture(cache->texture);
+            free(cache);
+            return;
+        }
+    }
+}
+
 void ng_label_create(ng_label_t *label, TTF_Font *font, unsigned int wrap_length)
 {
     // Initializing to NULL so that we don't free garbage
     label->sprite.texture = NULL;
+    label->sprite.region = NULL;
+    label->sprite.transform = (SDL_FRect){0, 0, 0, 0};
 
     label->font = font;
     label->wrap_length = wrap_length;
+
+    label->cache = NULL;
+    label->color = white;
+
+    label->glyphs = NULL;
+    label->glyph_count = 0;
+    label->glyph_capacity = 0;
+}
+
+// Width of the word starting at text, up to the next space or line break
+static int word_width(ng_glyph_cache_t *cache, const char *text)
+{
+    int width = 0;
+
+    for (; *text != '\0' && *text != ' ' && *text != '\n'; text++)
+        width += cache->advances[glyph_index(*text)];
+
+    return width;
 }
 
 void ng_label_set_content(ng_label_t *label, SDL_Renderer *renderer, const char *content, SDL_Color color)
 {
-    // Avoid the memory leak
-    SDL_DestroyTexture(label->sprite.texture);
-    
-    SDL_Surface *surface = label->wrap_length > 0
-        ? TTF_RenderText_Solid_Wrapped(label->font, content, color, label->wrap_length)
-        : TTF_RenderText_Solid(label->font, content, color);
+    ng_glyph_cache_t *cache = get_cache(label->font, renderer);
 
-    ng_sprite_create(&label->sprite, SDL_CreateTextureFromSurface(renderer, surface));
-    SDL_FreeSurface(surface);
+    int length = strlen(content);
+    if (length > label->glyph_capacity)
+    {
+        label->glyph_capacity = MAX(length, label->glyph_capacity * 2);
+        label->glyphs = realloc(label->glyphs, label->glyph_capacity * sizeof(ng_label_glyph_t));
+
+        if (label->glyphs == NULL)
+            ng_die("ran out of memory while laying out a label");
+    }
+
+    label->cache = cache;
+    label->color = color;
+    label->glyph_count = 0;
+    NG_PROFILE_COUNT(NG_COUNTER_LABEL_UPDATES, 1);
+
+    // Same wrapping rules as TTF_RenderText_Solid_Wrapped(): lines break on '\n'
+    // and before any word that would cross wrap_length, unless it's the first on its line
+    int pen_x = 0, pen_y = 0, width = 0;
+
+    for (const char *c = content; *c != '\0'; c++)
+    {
+        if (*c == '\n')
+        {
+            pen_x = 0;
+            pen_y += cache->line_skip;
+            continue;
+        }
+
+        bool starts_word = c == content || c[-1] == ' ' || c[-1] == '\n';
+        if (label->wrap_length > 0 && *c != ' ' && starts_word && pen_x > 0 &&
+            pen_x + word_width(cache, c) > (int)label->wrap_length)
+        {
+            pen_x = 0;
+            pen_y += cache->line_skip;
+        }
+
+        int index = glyph_index(*c);
+        SDL_Rect *src = &cache->rects[index];
+
+        // Spaces only move the pen
+        if (*c != ' ' && src->w > 0)
+        {
+            ng_label_glyph_t *glyph = &label->glyphs[label->glyph_count++];
+
+            glyph->src = *src;
+            glyph->offset = (SDL_FRect){pen_x, pen_y, src->w, src->h};
+        }
+
+        pen_x += cache->advances[index];
+        width = MAX(width, pen_x);
+    }
+
+    label->sprite.texture = cache->texture;
+    label->sprite.src = (SDL_Rect){0, 0, 0, 0};
+    label->sprite.transform.w = width;
+    label->sprite.transform.h = pen_y + cache->line_skip;
+}
+
+void ng_label_render(ng_label_t *label, ng_sprite_batch_t *batch, int layer)
+{
+    for (int i = 0; i < label->glyph_count; i++)
+    {
+        ng_label_glyph_t *glyph = &label->glyphs[i];
+        SDL_FRect transform = {
+            label->sprite.transform.x + glyph->offset.x,
+            label->sprite.transform.y + glyph->offset.y,
+            glyph->offset.w,
+            glyph->offset.h,
+        };
+
+        ng_sprite_batch_add_ex(batch, label->cache->texture, &glyph->src, &transform,
+                               layer, SDL_FLIP_NONE, label->color);
+    }
 }
 
 void ng_label_destroy(ng_label_t *label)
 {
-    SDL_DestroyTexture(label->sprite.texture);
+    // The texture belongs to the font's glyph cache
+    free(label->glyphs);
+
+    label->glyphs = NULL;
+    label->glyph_count = 0;
+    label->glyph_capacity = 0;
 }
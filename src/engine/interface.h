@@ -4,20 +4,46 @@
 #include <stdbool.h>
 #include "sprite.h"
 
+// Every font gets its printable ASCII glyphs rasterized once into a single texture,
+// labels only point into it (see interface.c)
+struct ng_glyph_cache_t;
+
+// A single character of a label, relative to the label's position
+typedef struct
+{
+    SDL_Rect src;
+    SDL_FRect offset;
+} ng_label_glyph_t;
+
 // Labels will inherit from sprite too
+// NOTE: The sprite's texture is the whole glyph atlas of the font and its transform
+// covers the laid out text, so draw labels with ng_label_render() instead of as sprites
 typedef struct
 {
     ng_sprite_t sprite;
 
     TTF_Font *font;
     unsigned int wrap_length;
+
+    struct ng_glyph_cache_t *cache;
+    SDL_Color color;
+
+    // Only grows, changing the content every frame doesn't allocate anything
+    ng_label_glyph_t *glyphs;
+    int glyph_count, glyph_capacity;
 } ng_label_t;
 
 // NOTE: Leave wrap_length to 0 for default rendering in a single line
 // The wrap width should be provided in pixels
 void ng_label_create(ng_label_t *label, TTF_Font *font, unsigned int wrap_length);
 
+// Cheap enough for every frame, only the glyph list is rebuilt
+// (the renderer is needed just the first time a font is used)
 void ng_label_set_content(ng_label_t *label, SDL_Renderer *renderer, const char *content, SDL_Color color);
+void ng_label_render(ng_label_t *label, ng_sprite_batch_t *batch, int layer);
 void ng_label_destroy(ng_label_t *label);
 
+// Frees the glyph atlas of a font, has to happen before the font gets closed
+void ng_glyph_cache_drop(TTF_Font *font);
+
 #endif
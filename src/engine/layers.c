@@ -0,0 +1,153 @@
+#include "layers.h"
+#include "common.h"
+#include "profiler.h"
+
+// Creating and destroying the target both happen on the render thread, where the
+// simulation is paused, so the game's list of layers never changes under the renderer
+static void create_target(void *data)
+{
+    ng_cached_layer_t *cache = data;
+    ng_game_t *game = cache->game;
+
+    if (game->cached_layer_count == NG_GAME_MAX_CACHED_LAYERS)
+        ng_die("a game can't have more than %d cached layers", NG_GAME_MAX_CACHED_LAYERS);
+
+    cache->target = SDL_CreateTexture(game->renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET,
+                                      cache->area.w, cache->area.h);
+    if (!cache->target)
+        ng_die("failed to create a cached layer: %s", SDL_GetError());
+
+    SDL_SetTextureBlendMode(cache->target, cache->is_opaque ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_BLEND);
+
+    game->cached_layers[game->cached_layer_count++] = cache;
+}
+
+static void destroy_target(void *data)
+{
+    ng_cached_layer_t *cache = data;
+    ng_game_t *game = cache->game;
+
+    for (int i = 0; i < game->cached_layer_count; i++)
+        if (game->cached_layers[i] == cache)
+        {
+            game->cached_layers[i] = game->cached_layers[--game->cached_layer_count];
+            break;
+        }
+
+    SDL_DestroyTexture(cache->target);
+    cache->target = NULL;
+}
+
+void ng_cached_layer_create(ng_cached_layer_t *cache, ng_game_t *game, const SDL_Rect *area,
+                            int layer, bool is_opaque)
+{
+    cache->game = game;
+    cache->area = *area;
+    cache->layer = layer;
+    cache->is_opaque = is_opaque;
+
+    cache->version = 1;
+    SDL_AtomicSet(&cache->drawn_version, 0);
+
+    // Whatever falls outside of the layer would be lost anyways
+    SDL_FRect viewport = {area->x, area->y, area->w, area->h};
+
+    for (int i = 0; i < NG_GAME_DRAW_LISTS; i++)
+    {
+        ng_sprite_batch_create(&cache->contents[i]);
+        ng_sprite_batch_set_viewport(&cache->contents[i], &viewport);
+        cache->content_versions[i] = 0;
+    }
+
+    ng_game_call_on_render_thread(game, create_target, cache);
+}
+
+void ng_cached_layer_destroy(ng_cached_layer_t *cache)
+{
+    ng_game_call_on_render_thread(cache->game, destroy_target, cache);
+
+    for (int i = 0; i < NG_GAME_DRAW_LISTS; i++)
+        ng_sprite_batch_destroy(&cache->contents[i]);
+}
+
+void ng_cached_layer_invalidate(ng_cached_layer_t *cache)
+{
+    // 0 means "nothing new", skip it when wrapping around
+    if (++cache->version == 0)
+        cache->version = 1;
+}
+
+ng_sprite_batch_t* ng_cached_layer_draw(ng_cached_layer_t *cache)
+{
+    ng_game_t *game = cache->game;
+    SDL_Rect src = {0, 0, cache->area.w, cache->area.h};
+    SDL_FRect transform = {cache->area.x, cache->area.y, cache->area.w, cache->area.h};
+    SDL_Color white = {255, 255, 255, 255};
+
+    ng_sprite_batch_add_ex(ng_game_get_draw_list(game), cache->target, &src, &transform,
+                           cache->layer, SDL_FLIP_NONE, white);
+
+    if ((uint32_t)SDL_AtomicGet(&cache->drawn_version) == cache->version)
+        return NULL;
+
+    // The render thread might skip this draw list, so this repeats until it got drawn once
+    ng_sprite_batch_t *content = &cache->contents[game->writing_list];
+    ng_sprite_batch_clear(content);
+    cache->content_versions[game->writing_list] = cache->version;
+
+    NG_PROFILE_COUNT(NG_COUNTER_LAYER_REDRAWS, 1);
+    return content;
+}
+
+// Whether version a came after version b, versions wrap around
+static bool is_newer(uint32_t a, uint32_t b)
+{
+    return (int32_t)(a - b) > 0;
+}
+
+static void redraw(ng_cached_layer_t *cache, ng_game_t *game, ng_sprite_batch_t *content)
+{
+    // The content is in screen coordinates, the target starts at the layer's corner
+    for (int i = 0; i < content->count; i++)
+    {
+        content->quads[i].transform.x -= cache->area.x;
+        content->quads[i].transform.y -= cache->area.y;
+    }
+
+    SDL_SetRenderTarget(game->renderer, cache->target);
+
+    SDL_SetRenderDrawColor(game->renderer, 0, 0, 0, cache->is_opaque ? 255 : 0);
+    SDL_RenderClear(game->renderer);
+    ng_sprite_batch_flush(content, game->renderer);
+
+    SDL_SetRenderTarget(game->renderer, NULL);
+}
+
+void ng_cached_layers_update(ng_game_t *game, int list)
+{
+    for (int i = 0; i < game->cached_layer_count; i++)
+    {
+        ng_cached_layer_t *cache = game->cached_layers[i];
+        uint32_t version = cache->content_versions[list];
+        ng_sprite_batch_t *content = &cache->contents[list];
+
+        // A list that was skipped earlier can come back with an older content
+        if (version != 0 && is_newer(version, (uint32_t)SDL_AtomicGet(&cache->drawn_version)))
+        {
+            NG_PROFILE_BEGIN("layer redraw");
+            redraw(cache, game, content);
+            NG_PROFILE_END();
+
+            SDL_AtomicSet(&cache->drawn_version, (int)version);
+        }
+
+        ng_sprite_batch_clear(content);
+        cache->content_versions[list] = 0;
+    }
+}
+
+void ng_cached_layers_invalidate_all(ng_game_t *game)
+{
+    for (int i = 0; i < game->cached_layer_count; i++)
+        ng_cached_layer_invalidate(game->cached_layers[i]);
+}
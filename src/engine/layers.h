@@ -0,0 +1,59 @@
+#ifndef _NG_LAYERS_H
+#define _NG_LAYERS_H
+
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "game.h"
+#include "sprite.h"
+
+/*
+ * A rarely changing part of the screen (a background, a HUD) kept in a render target
+ * of its own. Its content only gets drawn again after ng_cached_layer_invalidate(),
+ * every other frame the whole layer is a single quad of the game's draw list.
+ * Opaque layers are copied without any blending, which on the software renderer
+ * is a lot cheaper than drawing their content
+ *
+ * The content goes through the draw lists like everything else (see game.h), so it
+ * works the same with a render thread: the layer keeps sending its content every
+ * frame until the render thread has drawn it once
+ */
+typedef struct ng_cached_layer_t
+{
+    ng_game_t *game;
+
+    // Where it lands on screen, the content is drawn in screen coordinates too
+    SDL_Rect area;
+    // Sort layer of the quad inside the draw list
+    int layer;
+    bool is_opaque;
+
+    SDL_Texture *target;
+
+    // Bumped by every invalidation, the render thread stores the last one it drew
+    uint32_t version;
+    SDL_atomic_t drawn_version;
+
+    // Content sent along with each draw list, and its version (0 = nothing new)
+    ng_sprite_batch_t contents[NG_GAME_DRAW_LISTS];
+    uint32_t content_versions[NG_GAME_DRAW_LISTS];
+} ng_cached_layer_t;
+
+// Starts out invalidated, the first ng_cached_layer_draw() fills it
+void ng_cached_layer_create(ng_cached_layer_t *cache, ng_game_t *game, const SDL_Rect *area,
+                            int layer, bool is_opaque);
+void ng_cached_layer_destroy(ng_cached_layer_t *cache);
+
+void ng_cached_layer_invalidate(ng_cached_layer_t *cache);
+
+// Call it from the render handler every frame, it puts the layer into the draw list
+// Returns where to draw the content when it has to be drawn again, NULL otherwise
+ng_sprite_batch_t* ng_cached_layer_draw(ng_cached_layer_t *cache);
+
+// Hooks used by the game loop, you shouldn't need to call them yourself
+// Draws the content that came along with a draw list into the layers, on the render thread
+void ng_cached_layers_update(ng_game_t *game, int list);
+// Render targets can lose what's in them (SDL_RENDER_TARGETS_RESET)
+void ng_cached_layers_invalidate_all(ng_game_t *game);
+
+#endif
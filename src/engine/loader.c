@@ -0,0 +1,192 @@
+#include "loader.h"
+#include "audio.h"
+#include "common.h"
+#include "pack.h"
+#include <SDL2/SDL_image.h>
+#include <stdlib.h>
+#include <string.h>
+
+// More threads than this only end up fighting over the disk
+#define MAX_THREADS 8
+
+static struct
+{
+    SDL_Thread *threads[MAX_THREADS];
+    int thread_count;
+
+    // Jobs waiting for a worker, first in first out
+    ng_load_job_t *first, *last;
+    SDL_mutex *lock;
+    // Signaled when a job gets queued, and when a job finishes
+    SDL_cond *job_queued, *job_done;
+
+    bool is_quitting;
+} loader;
+
+static void decode(ng_load_job_t *job)
+{
+    switch (job->kind)
+    {
+    case NG_JOB_IMAGE:
+        job->surface = IMG_Load_RW(ng_pack_open(job->path), 1);
+        if (!job->surface)
+            job->error = strdup(IMG_GetError());
+        break;
+    case NG_JOB_CHUNK:
+        job->chunk = ng_audio_load(job->path, job->parameter);
+        break;
+    }
+}
+
+static int worker(void *data)
+{
+    (void)data;
+
+    for (;;)
+    {
+        SDL_LockMutex(loader.lock);
+
+        while (!loader.first && !loader.is_quitting)
+            SDL_CondWait(loader.job_queued, loader.lock);
+
+        if (loader.is_quitting)
+        {
+            SDL_UnlockMutex(loader.lock);
+            return 0;
+        }
+
+        ng_load_job_t *job = loader.first;
+        loader.first = job->next;
+        if (!loader.first)
+            loader.last = NULL;
+
+        SDL_UnlockMutex(loader.lock);
+
+        decode(job);
+
+        // The lock makes sure nobody misses the wakeup between checking and waiting
+        SDL_LockMutex(loader.lock);
+        SDL_AtomicSet(&job->is_done, 1);
+        SDL_CondBroadcast(loader.job_done);
+        SDL_UnlockMutex(loader.lock);
+    }
+}
+
+void ng_loader_init(int thread_count)
+{
+    memset(&loader, 0, sizeof(loader));
+
+    // Leave a core for the main thread, it has textures to upload
+    if (thread_count <= 0)
+        thread_count = SDL_GetCPUCount() - 1;
+
+    thread_count = MIN(thread_count, MAX_THREADS);
+
+#ifdef __EMSCRIPTEN__
+    // Without pthreads support everything gets decoded synchronously
+    thread_count = 0;
+#endif
+
+    if (thread_count <= 0)
+        return;
+
+    loader.lock = SDL_CreateMutex();
+    loader.job_queued = SDL_CreateCond();
+    loader.job_done = SDL_CreateCond();
+
+    if (!loader.lock || !loader.job_queued || !loader.job_done)
+        ng_die("failed to create the asset loader's synchronization primitives");
+
+    for (int i = 0; i < thread_count; i++)
+    {
+        loader.threads[i] = SDL_CreateThread(worker, "ng_loader", NULL);
+
+        // Fewer threads still work, and so does zero
+        if (!loader.threads[i])
+            break;
+
+        loader.thread_count++;
+    }
+}
+
+void ng_loader_shutdown(void)
+{
+    if (loader.thread_count == 0)
+        return;
+
+    SDL_LockMutex(loader.lock);
+    loader.is_quitting = true;
+    SDL_CondBroadcast(loader.job_queued);
+    SDL_UnlockMutex(loader.lock);
+
+    for (int i = 0; i < loader.thread_count; i++)
+        SDL_WaitThread(loader.threads[i], NULL);
+
+    // Jobs that never got picked up fail, so that waiting on them (after the
+    // condition is gone) returns right away. Their owners still free them
+    for (ng_load_job_t *job = loader.first; job; job = job->next)
+    {
+        job->error = strdup("the loader shut down before decoding it");
+        SDL_AtomicSet(&job->is_done, 1);
+    }
+
+    SDL_DestroyCond(loader.job_queued);
+    SDL_DestroyCond(loader.job_done);
+    SDL_DestroyMutex(loader.lock);
+
+    memset(&loader, 0, sizeof(loader));
+}
+
+ng_load_job_t* ng_loader_submit(ng_load_job_kind_t kind, const char *path, int parameter)
+{
+    ng_load_job_t *job = calloc(1, sizeof(ng_load_job_t));
+    if (!job)
+        ng_die("ran out of memory while queuing %s", path);
+
+    job->kind = kind;
+    job->path = strdup(path);
+    job->parameter = parameter;
+
+    if (loader.thread_count == 0)
+    {
+        decode(job);
+        SDL_AtomicSet(&job->is_done, 1);
+        return job;
+    }
+
+    SDL_LockMutex(loader.lock);
+
+    if (loader.last)
+        loader.last->next = job;
+    else
+        loader.first = job;
+    loader.last = job;
+
+    SDL_CondSignal(loader.job_queued);
+    SDL_UnlockMutex(loader.lock);
+
+    return job;
+}
+
+bool ng_loader_is_done(ng_load_job_t *job)
+{
+    return SDL_AtomicGet(&job->is_done);
+}
+
+void ng_loader_wait(ng_load_job_t *job)
+{
+    if (ng_loader_is_done(job))
+        return;
+
+    SDL_LockMutex(loader.lock);
+    while (!SDL_AtomicGet(&job->is_done))
+        SDL_CondWait(loader.job_done, loader.lock);
+    SDL_UnlockMutex(loader.lock);
+}
+
+void ng_loader_free_job(ng_load_job_t *job)
+{
+    free(job->error);
+    free(job->path);
+    free(job);
+}
@@ -0,0 +1,62 @@
+#ifndef _NG_LOADER_H
+#define _NG_LOADER_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_mixer.h>
+#include <stdbool.h>
+
+typedef enum
+{
+    // Decodes an image into an SDL_Surface
+    NG_JOB_IMAGE,
+    // Decodes a sound effect into a Mix_Chunk
+    NG_JOB_CHUNK
+} ng_load_job_kind_t;
+
+typedef struct ng_load_job_t
+{
+    ng_load_job_kind_t kind;
+    char *path;
+    // How sound effects are stored (see ng_audio_storage_t), unused by images
+    int parameter;
+
+    // Set by the worker once the result (or the failure) is ready
+    SDL_atomic_t is_done;
+
+    // NULL if decoding failed
+    union
+    {
+        SDL_Surface *surface;
+        Mix_Chunk *chunk;
+    };
+    // Why it failed, SDL's error messages only reach the thread the failure happened on
+    char *error;
+
+    struct ng_load_job_t *next;
+} ng_load_job_t;
+
+/*
+ * Decodes assets on worker threads. Decoding (PNG inflating, WAV conversion...)
+ * is what makes loading slow, and it parallelizes almost perfectly. Only the
+ * results are handed back, turning surfaces into textures still has to happen
+ * on the render thread
+ *
+ * Without worker threads (thread_count = 1 CPU, or no thread support) jobs are
+ * decoded right away inside ng_loader_submit()
+ */
+
+// 0 picks a thread count based on the amount of CPU cores
+void ng_loader_init(int thread_count);
+void ng_loader_shutdown(void);
+
+// The caller owns the job and has to free it (after it's done) with ng_loader_free_job()
+ng_load_job_t* ng_loader_submit(ng_load_job_kind_t kind, const char *path, int parameter);
+
+bool ng_loader_is_done(ng_load_job_t *job);
+// Blocks until the job has been decoded
+// NOTE: Jobs still queued when the loader shuts down are done right away, as failures
+void ng_loader_wait(ng_load_job_t *job);
+// Frees the job, but not its result, which belongs to whoever waited on it
+void ng_loader_free_job(ng_load_job_t *job);
+
+#endif
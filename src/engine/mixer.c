@@ -0,0 +1,529 @@
+#include "mixer.h"
+#include "common.h"
+#include "custom_math.h"
+#include "adpcm.h"
+#include <string.h>
+
+// Has to stay a power of two, the indices wrap around with a mask
+#define QUEUE_SIZE 256
+#define QUEUE_MASK (QUEUE_SIZE - 1)
+
+// Voices get mixed in blocks of this many frames, volume ramps move once per block
+// (1.5 ms at 44.1 kHz, too short to hear the steps)
+#define BLOCK_FRAMES 64
+
+// ng_mixer_sync() stops waiting when no buffer got mixed for this long
+#define SYNC_TIMEOUT_MS 250
+
+typedef enum
+{
+    COMMAND_PLAY,
+    COMMAND_STOP,
+    COMMAND_VOLUME,
+    COMMAND_MUSIC_VOLUME
+} command_kind_t;
+
+typedef struct
+{
+    command_kind_t kind;
+    int voice;
+    uint32_t generation;
+
+    // Either plain samples or ADPCM blocks
+    const int16_t *samples;
+    const uint8_t *blocks;
+    int frame_count, loops;
+    uint32_t start_frame;
+    bool is_scheduled;
+
+    float volume;
+    int ramp_frames;
+
+    // Performance counter value when it got pushed, for the latency stats
+    uint64_t pushed_at;
+} command_t;
+
+// A volume that glides towards its target instead of jumping (which clicks)
+typedef struct
+{
+    float current, target, step;
+    int remaining;
+} ramp_t;
+
+typedef struct
+{
+    bool is_playing;
+    uint32_t generation;
+
+    const int16_t *samples;
+    int frame_count, position, loops;
+
+    // Compressed voices decode one ADPCM block at a time while they play
+    const uint8_t *blocks;
+    int decoded_block;
+    int16_t decoded[NG_ADPCM_BLOCK_FRAMES * NG_MIXER_MAX_CHANNELS];
+
+    uint32_t start_frame;
+    bool is_scheduled, has_started;
+    uint64_t pushed_at;
+
+    ramp_t volume;
+    // Ends the voice once the volume ramp is over (fading out)
+    bool stop_after_ramp;
+} voice_t;
+
+// Everything below the ring belongs to the audio thread once the mixer runs
+static struct
+{
+    int frequency, channels;
+    uint64_t perf_frequency;
+
+    // Only the game thread writes head, only the audio thread writes tail
+    command_t queue[QUEUE_SIZE];
+    SDL_atomic_t head, tail;
+
+    SDL_atomic_t clock;
+    SDL_atomic_t ended_generations[NG_MIXER_VOICES];
+
+    voice_t voices[NG_MIXER_VOICES];
+    ramp_t music_volume;
+    uint32_t mixed_frames;
+
+    float block[BLOCK_FRAMES * NG_MIXER_MAX_CHANNELS];
+
+    // Written by the audio thread, read by ng_mixer_get_stats()
+    SDL_atomic_t active_voices, late_starts;
+    SDL_atomic_t last_latency_us, max_latency_us;
+    SDL_atomic_t callback_us, buffer_us;
+
+    // Game thread only
+    unsigned int commands, dropped_commands;
+} mixer;
+
+void ng_mixer_init(int frequency, int channels)
+{
+    if (frequency <= 0 || channels <= 0 || channels > NG_MIXER_MAX_CHANNELS)
+        ng_die("the mixer doesn't support %d Hz audio with %d channels", frequency, channels);
+
+    memset(&mixer, 0, sizeof(mixer));
+
+    mixer.frequency = frequency;
+    mixer.channels = channels;
+    mixer.perf_frequency = SDL_GetPerformanceFrequency();
+    mixer.music_volume.current = mixer.music_volume.target = 1.0f;
+}
+
+int ng_mixer_get_frequency(void)
+{
+    return mixer.frequency;
+}
+
+int ng_mixer_get_channels(void)
+{
+    return mixer.channels;
+}
+
+uint32_t ng_mixer_get_clock(void)
+{
+    return (uint32_t)SDL_AtomicGet(&mixer.clock);
+}
+
+// ---- Game thread side ----
+
+static bool push_command(command_t *command)
+{
+    unsigned int head = (unsigned int)SDL_AtomicGet(&mixer.head);
+    unsigned int tail = (unsigned int)SDL_AtomicGet(&mixer.tail);
+
+    if (head - tail >= QUEUE_SIZE)
+    {
+        mixer.dropped_commands++;
+        return false;
+    }
+
+    command->pushed_at = SDL_GetPerformanceCounter();
+    mixer.queue[head & QUEUE_MASK] = *command;
+
+    // SDL_AtomicSet() is a full barrier, the command is written before it becomes visible
+    SDL_AtomicSet(&mixer.head, (int)(head + 1));
+    mixer.commands++;
+
+    return true;
+}
+
+static bool is_valid_voice(int voice)
+{
+    return voice >= 0 && voice < NG_MIXER_VOICES;
+}
+
+static bool play(int voice, uint32_t generation, const int16_t *samples, const uint8_t *blocks,
+                 int frame_count, int loops, float volume, uint32_t delay_frames)
+{
+    if (!is_valid_voice(voice))
+        return false;
+
+    command_t command = {
+        .kind = COMMAND_PLAY,
+        .voice = voice,
+        .generation = generation,
+        .samples = samples,
+        .blocks = blocks,
+        .frame_count = frame_count,
+        .loops = loops,
+        .start_frame = ng_mixer_get_clock() + delay_frames,
+        .is_scheduled = delay_frames > 0,
+        .volume = volume,
+    };
+
+    return push_command(&command);
+}
+
+bool ng_mixer_play(int voice, uint32_t generation, const int16_t *samples, int frame_count,
+                   int loops, float volume, uint32_t delay_frames)
+{
+    return play(voice, generation, samples, NULL, frame_count, loops, volume, delay_frames);
+}
+
+bool ng_mixer_play_compressed(int voice, uint32_t generation, const uint8_t *blocks, int frame_count,
+                              int loops, float volume, uint32_t delay_frames)
+{
+    return play(voice, generation, NULL, blocks, frame_count, loops, volume, delay_frames);
+}
+
+bool ng_mixer_stop(int voice, uint32_t generation, int fade_frames)
+{
+    if (!is_valid_voice(voice))
+        return false;
+
+    command_t command = {
+        .kind = COMMAND_STOP,
+        .voice = voice,
+        .generation = generation,
+        .ramp_frames = fade_frames,
+    };
+
+    return push_command(&command);
+}
+
+bool ng_mixer_set_volume(int voice, uint32_t generation, float volume, int ramp_frames)
+{
+    if (!is_valid_voice(voice))
+        return false;
+
+    command_t command = {
+        .kind = COMMAND_VOLUME,
+        .voice = voice,
+        .generation = generation,
+        .volume = volume,
+        .ramp_frames = ramp_frames,
+    };
+
+    return push_command(&command);
+}
+
+bool ng_mixer_set_music_volume(float volume, int ramp_frames)
+{
+    command_t command = {
+        .kind = COMMAND_MUSIC_VOLUME,
+        .volume = volume,
+        .ramp_frames = ramp_frames,
+    };
+
+    return push_command(&command);
+}
+
+bool ng_mixer_has_ended(int voice, uint32_t generation)
+{
+    if (!is_valid_voice(voice))
+        return true;
+
+    return (uint32_t)SDL_AtomicGet(&mixer.ended_generations[voice]) == generation;
+}
+
+void ng_mixer_get_stats(ng_mixer_stats_t *stats)
+{
+    stats->commands = mixer.commands;
+    stats->dropped_commands = mixer.dropped_commands;
+
+    stats->active_voices = SDL_AtomicGet(&mixer.active_voices);
+    stats->late_starts = SDL_AtomicGet(&mixer.late_starts);
+    stats->last_latency_us = SDL_AtomicGet(&mixer.last_latency_us);
+    stats->max_latency_us = SDL_AtomicGet(&mixer.max_latency_us);
+    stats->callback_us = SDL_AtomicGet(&mixer.callback_us);
+    stats->buffer_us = SDL_AtomicGet(&mixer.buffer_us);
+}
+
+void ng_mixer_sync(void)
+{
+    unsigned int head = (unsigned int)SDL_AtomicGet(&mixer.head);
+    uint32_t clock = ng_mixer_get_clock();
+    int idle_ms = 0;
+
+    while ((int)(head - (unsigned int)SDL_AtomicGet(&mixer.tail)) > 0)
+    {
+        SDL_Delay(1);
+
+        // The callback isn't running (paused or closed audio), so nothing is being mixed
+        // Whatever is left gets applied before the next buffer anyway
+        if (ng_mixer_get_clock() != clock)
+        {
+            clock = ng_mixer_get_clock();
+            idle_ms = 0;
+        }
+        else if (++idle_ms >= SYNC_TIMEOUT_MS)
+            return;
+    }
+}
+
+// ---- Audio thread side ----
+
+static void set_ramp(ramp_t *ramp, float target, int frames)
+{
+    ramp->target = target;
+
+    if (frames <= 0)
+    {
+        ramp->current = target;
+        ramp->remaining = 0;
+        return;
+    }
+
+    ramp->step = (target - ramp->current) / frames;
+    ramp->remaining = frames;
+}
+
+// Moves the ramp forward, returns true when it just reached its target
+static bool advance_ramp(ramp_t *ramp, int frames)
+{
+    if (ramp->remaining <= 0)
+        return false;
+
+    ramp->remaining -= frames;
+    ramp->current += ramp->step * frames;
+
+    if (ramp->remaining > 0)
+        return false;
+
+    ramp->current = ramp->target;
+    return true;
+}
+
+static void end_voice(int index)
+{
+    voice_t *voice = &mixer.voices[index];
+
+    voice->is_playing = false;
+    SDL_AtomicSet(&mixer.ended_generations[index], (int)voice->generation);
+}
+
+static void run_command(const command_t *command)
+{
+    if (command->kind == COMMAND_MUSIC_VOLUME)
+    {
+        set_ramp(&mixer.music_volume, command->volume, command->ramp_frames);
+        return;
+    }
+
+    voice_t *voice = &mixer.voices[command->voice];
+
+    if (command->kind == COMMAND_PLAY)
+    {
+        // Whatever played there before is replaced
+        if (voice->is_playing)
+            end_voice(command->voice);
+
+        voice->generation = command->generation;
+        voice->samples = command->samples;
+        voice->blocks = command->blocks;
+        voice->decoded_block = -1;
+        voice->frame_count = command->frame_count;
+        voice->position = 0;
+        voice->loops = command->loops;
+        voice->start_frame = command->start_frame;
+        voice->is_scheduled = command->is_scheduled;
+        voice->has_started = false;
+        voice->pushed_at = command->pushed_at;
+        voice->volume = (ramp_t){command->volume, command->volume, 0.0f, 0};
+        voice->stop_after_ramp = false;
+        voice->is_playing = true;
+
+        // Nothing to play, but the game still has to learn that it ended
+        if ((!voice->samples && !voice->blocks) || voice->frame_count <= 0)
+            end_voice(command->voice);
+
+        return;
+    }
+
+    // Meant for a voice that's already over
+    if (!voice->is_playing || voice->generation != command->generation)
+        return;
+
+    if (command->kind == COMMAND_STOP)
+    {
+        if (command->ramp_frames <= 0)
+        {
+            end_voice(command->voice);
+            return;
+        }
+
+        set_ramp(&voice->volume, 0.0f, command->ramp_frames);
+        voice->stop_after_ramp = true;
+    }
+    else if (command->kind == COMMAND_VOLUME && !voice->stop_after_ramp)
+        set_ramp(&voice->volume, command->volume, command->ramp_frames);
+}
+
+static void drain_commands(void)
+{
+    unsigned int tail = (unsigned int)SDL_AtomicGet(&mixer.tail);
+    unsigned int head = (unsigned int)SDL_AtomicGet(&mixer.head);
+
+    for (; tail != head; tail++)
+        run_command(&mixer.queue[tail & QUEUE_MASK]);
+
+    // Only now the game thread may overwrite those slots
+    SDL_AtomicSet(&mixer.tail, (int)tail);
+}
+
+// first_frame: where the voice's first sample lands inside the current buffer
+static void record_latency(voice_t *voice, uint64_t callback_start, int first_frame)
+{
+    double seconds = (double)(callback_start - voice->pushed_at) / mixer.perf_frequency +
+                     (double)first_frame / mixer.frequency;
+    int latency = (int)(seconds * 1e6);
+
+    SDL_AtomicSet(&mixer.last_latency_us, latency);
+    if (latency > SDL_AtomicGet(&mixer.max_latency_us))
+        SDL_AtomicSet(&mixer.max_latency_us, latency);
+}
+
+// The voice's samples from its current position on, and how many frames of them are there
+static const int16_t* get_samples(voice_t *voice, int *frame_count)
+{
+    if (!voice->blocks)
+    {
+        *frame_count = voice->frame_count - voice->position;
+        return voice->samples + voice->position * mixer.channels;
+    }
+
+    int block = voice->position / NG_ADPCM_BLOCK_FRAMES;
+    int offset = voice->position % NG_ADPCM_BLOCK_FRAMES;
+
+    if (block != voice->decoded_block)
+    {
+        ng_adpcm_decode_block(voice->decoded, voice->blocks, block, mixer.channels);
+        voice->decoded_block = block;
+    }
+
+    // Only up to the end of the block (the last one is padded)
+    *frame_count = MIN(NG_ADPCM_BLOCK_FRAMES - offset, voice->frame_count - voice->position);
+    return voice->decoded + offset * mixer.channels;
+}
+
+// Adds one voice into the block that starts at block_clock
+static void mix_voice(int index, int frames, uint32_t block_clock,
+                      uint64_t callback_start, uint32_t buffer_clock)
+{
+    voice_t *voice = &mixer.voices[index];
+    int channels = mixer.channels;
+    int frame = 0;
+
+    if (!voice->has_started)
+    {
+        // Signed distance, the clock wraps around
+        int32_t wait = (int32_t)(voice->start_frame - block_clock);
+
+        if (wait >= frames)
+            return;
+
+        if (wait > 0)
+            frame = wait;
+        else if (wait < 0 && voice->is_scheduled)
+            SDL_AtomicAdd(&mixer.late_starts, 1);
+
+        voice->has_started = true;
+        record_latency(voice, callback_start, (int)(block_clock - buffer_clock) + frame);
+    }
+
+    // The volume stays the same for the whole block
+    float gain = voice->volume.current;
+
+    while (frame < frames)
+    {
+        int count;
+        const int16_t *source = get_samples(voice, &count);
+        count = MIN(count, frames - frame);
+
+        ng_batch_multiply_add_samples(mixer.block + frame * channels, source, gain, count * channels);
+
+        voice->position += count;
+        frame += count;
+
+        if (voice->position < voice->frame_count)
+            continue;
+
+        // Reached the end of the sample, -1 loops forever
+        if (voice->loops == 0)
+        {
+            end_voice(index);
+            return;
+        }
+
+        if (voice->loops > 0)
+            voice->loops--;
+
+        voice->position = 0;
+    }
+
+    if (advance_ramp(&voice->volume, frames) && voice->stop_after_ramp)
+        end_voice(index);
+}
+
+void ng_mixer_post_mix(void *data, Uint8 *stream, int length)
+{
+    (void)data;
+
+    uint64_t callback_start = SDL_GetPerformanceCounter();
+    int channels = mixer.channels;
+
+    // Not initialized, leave SDL_mixer's output alone
+    if (channels == 0)
+        return;
+
+    int16_t *samples = (int16_t*)stream;
+    int frame_count = length / (int)(sizeof(int16_t) * channels);
+    uint32_t buffer_clock = mixer.mixed_frames;
+
+    drain_commands();
+
+    for (int offset = 0; offset < frame_count; offset += BLOCK_FRAMES)
+    {
+        int frames = MIN(BLOCK_FRAMES, frame_count - offset);
+        int16_t *output = samples + offset * channels;
+        uint32_t block_clock = buffer_clock + offset;
+
+        // SDL_mixer's output (just the music) is the starting point
+        memset(mixer.block, 0, sizeof(float) * frames * channels);
+        ng_batch_multiply_add_samples(mixer.block, output, mixer.music_volume.current, frames * channels);
+        advance_ramp(&mixer.music_volume, frames);
+
+        for (int i = 0; i < NG_MIXER_VOICES; i++)
+            if (mixer.voices[i].is_playing)
+                mix_voice(i, frames, block_clock, callback_start, buffer_clock);
+
+        ng_batch_to_samples(output, mixer.block, frames * channels);
+    }
+
+    mixer.mixed_frames += frame_count;
+    SDL_AtomicSet(&mixer.clock, (int)mixer.mixed_frames);
+
+    int active_voices = 0;
+    for (int i = 0; i < NG_MIXER_VOICES; i++)
+        active_voices += mixer.voices[i].is_playing;
+
+    SDL_AtomicSet(&mixer.active_voices, active_voices);
+
+    double elapsed = (double)(SDL_GetPerformanceCounter() - callback_start) / mixer.perf_frequency;
+    SDL_AtomicSet(&mixer.callback_us, (int)(elapsed * 1e6));
+    SDL_AtomicSet(&mixer.buffer_us, (int)((double)frame_count / mixer.frequency * 1e6));
+}
@@ -0,0 +1,79 @@
+#ifndef _NG_MIXER_H
+#define _NG_MIXER_H
+
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Sound effects are mixed by the engine itself, inside SDL_mixer's post-mix
+ * callback, on top of the music (which SDL_mixer still streams). The game thread
+ * never takes the audio lock: every request goes into a single-producer
+ * single-consumer ring that the callback drains at the start of every buffer.
+ * When the ring is full the request is dropped and the call returns false,
+ * the game never waits for the audio thread
+ *
+ * Voices are handed out by the game thread (see audio.h), the mixer only plays
+ * what it's told and reports back which voices ended. The generation passed along
+ * with every command tells a voice apart from the previous ones on the same slot,
+ * commands meant for an older one are ignored
+ *
+ * Everything works the same on SDL's dummy audio driver, which keeps
+ * calling back in real time without a sound card
+ *
+ * NOTE: Only the game thread may call the functions below, except the callback
+ * Samples have to be 16 bit, interleaved, in the device's rate and channel count
+ * (which is what Mix_LoadWAV() converts them to)
+ */
+#define NG_MIXER_VOICES 32
+#define NG_MIXER_MAX_CHANNELS 8
+
+typedef struct
+{
+    // Pushed into the ring, and how many of them didn't fit
+    unsigned int commands, dropped_commands;
+
+    int active_voices;
+    // Scheduled starts that reached the callback after their frame was already mixed
+    int late_starts;
+
+    // From pushing a play command to the moment its first sample is due, i.e. the
+    // callback that mixes it plus its offset inside that buffer
+    int last_latency_us, max_latency_us;
+    // Time spent in the last callback, compared to how much audio it produced
+    int callback_us, buffer_us;
+} ng_mixer_stats_t;
+
+void ng_mixer_init(int frequency, int channels);
+
+// Register with Mix_SetPostMix(), it can also be called directly (e.g. by benchmarks)
+void ng_mixer_post_mix(void *data, Uint8 *stream, int length);
+
+int ng_mixer_get_frequency(void);
+int ng_mixer_get_channels(void);
+// Frames mixed so far, wraps around after a day or so
+uint32_t ng_mixer_get_clock(void);
+
+// The voice starts delay_frames after the current clock (0 = with the next buffer)
+// Two plays with different delays keep their exact distance in samples
+bool ng_mixer_play(int voice, uint32_t generation, const int16_t *samples, int frame_count,
+                   int loops, float volume, uint32_t delay_frames);
+// Same thing for IMA ADPCM blocks (see adpcm.h), decoded a block at a time while mixing
+bool ng_mixer_play_compressed(int voice, uint32_t generation, const uint8_t *blocks, int frame_count,
+                              int loops, float volume, uint32_t delay_frames);
+// Fades out over fade_frames and then ends the voice (0 = stop right away)
+bool ng_mixer_stop(int voice, uint32_t generation, int fade_frames);
+bool ng_mixer_set_volume(int voice, uint32_t generation, float volume, int ramp_frames);
+// Scales whatever SDL_mixer produced before our voices got added, i.e. the music
+bool ng_mixer_set_music_volume(float volume, int ramp_frames);
+
+// Waits until the callback took every command pushed so far, e.g. before freeing
+// samples a voice might still be playing. Meant for loading screens, not every frame
+void ng_mixer_sync(void);
+
+// Whether the voice with this generation is over (stopped, finished or replaced)
+bool ng_mixer_has_ended(int voice, uint32_t generation);
+
+void ng_mixer_get_stats(ng_mixer_stats_t *stats);
+
+#endif
@@ -0,0 +1,255 @@
+#include "pack.h"
+#include "common.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+#define HAS_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef NG_PACK_LZ4
+#include <lz4.h>
+#endif
+
+// Must match tools/ng_pack.c
+#define PACK_MAGIC 0x4b50474eu
+#define PACK_VERSION 1
+#define HEADER_SIZE 16
+#define ENTRY_SIZE 32
+
+#define ENTRY_LZ4 0x1
+
+typedef struct
+{
+    uint64_t data_offset;
+    uint32_t stored_size, original_size;
+    uint32_t name_offset, name_length;
+    uint32_t flags;
+} pack_entry_t;
+
+static struct
+{
+    const uint8_t *data;
+    size_t size;
+    bool is_mapped;
+
+    uint32_t entry_count;
+
+    // LZ4 entries get decompressed on first use and stay around until unmounting
+    // Assets are decoded from worker threads too, hence the lock
+    void **decompressed;
+    SDL_mutex *lock;
+} pack;
+
+static uint32_t read_u32(const uint8_t *bytes)
+{
+    uint32_t value;
+    memcpy(&value, bytes, sizeof(value));
+    return SDL_SwapLE32(value);
+}
+
+static void read_entry(uint32_t index, pack_entry_t *entry)
+{
+    const uint8_t *bytes = pack.data + HEADER_SIZE + (size_t)index * ENTRY_SIZE;
+
+    entry->data_offset = read_u32(bytes) | (uint64_t)read_u32(bytes + 4) << 32;
+    entry->stored_size = read_u32(bytes + 8);
+    entry->original_size = read_u32(bytes + 12);
+    entry->name_offset = read_u32(bytes + 16);
+    entry->name_length = read_u32(bytes + 20);
+    entry->flags = read_u32(bytes + 24);
+}
+
+static bool map_file(const char *path)
+{
+#ifdef HAS_MMAP
+    int file = open(path, O_RDONLY);
+    if (file < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(file, &info) != 0 || info.st_size == 0)
+    {
+        close(file);
+        return false;
+    }
+
+    void *mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    // The mapping keeps the file alive by itself
+    close(file);
+
+    if (mapping == MAP_FAILED)
+        return false;
+
+    pack.data = mapping;
+    pack.size = info.st_size;
+    pack.is_mapped = true;
+#else
+    // No mmap here, a single read of the whole file is the next best thing
+    pack.data = SDL_LoadFile(path, &pack.size);
+    pack.is_mapped = false;
+
+    if (!pack.data)
+        return false;
+#endif
+
+    return true;
+}
+
+static bool is_valid(void)
+{
+    if (pack.size < HEADER_SIZE || read_u32(pack.data) != PACK_MAGIC
+        || read_u32(pack.data + 4) != PACK_VERSION)
+        return false;
+
+    pack.entry_count = read_u32(pack.data + 8);
+    if (HEADER_SIZE + (uint64_t)pack.entry_count * ENTRY_SIZE > pack.size)
+        return false;
+
+    // Make sure that no entry points outside of the file
+    for (uint32_t i = 0; i < pack.entry_count; i++)
+    {
+        pack_entry_t entry;
+        read_entry(i, &entry);
+
+        if (entry.data_offset + entry.stored_size > pack.size
+            || (uint64_t)entry.name_offset + entry.name_length > pack.size)
+            return false;
+    }
+
+    return true;
+}
+
+bool ng_pack_mount(const char *path)
+{
+    ng_pack_unmount();
+
+    if (!map_file(path))
+        return false;
+
+    if (!is_valid())
+    {
+        SDL_Log("%s is not a valid asset pack, using loose files instead", path);
+        ng_pack_unmount();
+        return false;
+    }
+
+    pack.decompressed = calloc(pack.entry_count, sizeof(void*));
+    pack.lock = SDL_CreateMutex();
+
+    if (!pack.decompressed || !pack.lock)
+        ng_die("ran out of memory while mounting %s", path);
+
+    return true;
+}
+
+void ng_pack_unmount(void)
+{
+    if (!pack.data)
+        return;
+
+    for (uint32_t i = 0; pack.decompressed && i < pack.entry_count; i++)
+        free(pack.decompressed[i]);
+
+    free(pack.decompressed);
+
+    if (pack.lock)
+        SDL_DestroyMutex(pack.lock);
+
+#ifdef HAS_MMAP
+    if (pack.is_mapped)
+        munmap((void*)pack.data, pack.size);
+    else
+#endif
+        SDL_free((void*)pack.data);
+
+    memset(&pack, 0, sizeof(pack));
+}
+
+// Same ordering as strcmp(), which is how the builder sorted the entries
+static int compare_name(const char *path, size_t path_length, pack_entry_t *entry)
+{
+    const char *name = (const char*)pack.data + entry->name_offset;
+    int result = memcmp(path, name, MIN(path_length, entry->name_length));
+
+    if (result == 0)
+        result = (path_length > entry->name_length) - (path_length < entry->name_length);
+
+    return result;
+}
+
+static bool find_entry(const char *path, uint32_t *index, pack_entry_t *entry)
+{
+    size_t path_length = strlen(path);
+    uint32_t low = 0, high = pack.entry_count;
+
+    while (low < high)
+    {
+        uint32_t middle = low + (high - low) / 2;
+        read_entry(middle, entry);
+
+        int result = compare_name(path, path_length, entry);
+        if (result == 0)
+        {
+            *index = middle;
+            return true;
+        }
+
+        if (result < 0)
+            high = middle;
+        else
+            low = middle + 1;
+    }
+
+    return false;
+}
+
+static const void* get_contents(const char *path, uint32_t index, pack_entry_t *entry)
+{
+    const uint8_t *stored = pack.data + entry->data_offset;
+
+    if (!(entry->flags & ENTRY_LZ4))
+        return stored;
+
+#ifdef NG_PACK_LZ4
+    SDL_LockMutex(pack.lock);
+
+    if (!pack.decompressed[index])
+    {
+        char *buffer = malloc(entry->original_size ? entry->original_size : 1);
+        if (!buffer)
+            ng_die("ran out of memory while decompressing %s", path);
+
+        int size = LZ4_decompress_safe((const char*)stored, buffer, entry->stored_size, entry->original_size);
+        if (size < 0 || (uint32_t)size != entry->original_size)
+            ng_die("%s is corrupted inside the asset pack", path);
+
+        pack.decompressed[index] = buffer;
+    }
+
+    const void *contents = pack.decompressed[index];
+    SDL_UnlockMutex(pack.lock);
+
+    return contents;
+#else
+    (void)index;
+    ng_die("%s is LZ4 compressed, but the game was built without LZ4 support (LZ4=1)", path);
+    return NULL;
+#endif
+}
+
+SDL_RWops* ng_pack_open(const char *path)
+{
+    uint32_t index;
+    pack_entry_t entry;
+
+    if (pack.data && find_entry(path, &index, &entry))
+        return SDL_RWFromConstMem(get_contents(path, index, &entry), entry.original_size);
+
+    return SDL_RWFromFile(path, "rb");
+}
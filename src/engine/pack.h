@@ -0,0 +1,24 @@
+#ifndef _NG_PACK_H
+#define _NG_PACK_H
+
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+
+/*
+ * Runtime side of the asset pack built by `make pack` (see tools/ng_pack.c)
+ *
+ * The whole pack is memory mapped once, and every asset opened from it is an
+ * SDL_RWops view straight into the mapping. No file opens, no reads and no copies,
+ * except for LZ4 compressed entries which get decompressed once on first use
+ */
+
+// Returns false if the pack can't be opened, assets then keep coming from loose files
+bool ng_pack_mount(const char *path);
+void ng_pack_unmount(void);
+
+// Opens an asset by its usual path (e.g. "assets/heart.png"), from the mounted pack
+// if it contains it, otherwise from disk. Returns NULL if it can't be found anywhere
+// The stream has to be closed by whoever uses it (pass freesrc = 1 to SDL's loaders)
+SDL_RWops* ng_pack_open(const char *path);
+
+#endif
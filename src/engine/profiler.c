@@ -0,0 +1,318 @@
+#include "profiler.h"
+#include "common.h"
+#include <stdio.h>
+
+#ifndef NG_NO_PROFILER
+
+// Tallest bar of the overlay
+#define OVERLAY_MAX_MS 50.0
+
+// The last NG_PROFILER_FRAMES finished frames, plus the one being recorded
+#define RING_SLOTS (NG_PROFILER_FRAMES + 1)
+
+static const char *counter_names[NG_COUNTER_COUNT] = {
+    "draw calls",
+    "texture binds",
+    "label updates",
+    "glyph rasterizations",
+    "quads submitted",
+    "quads culled",
+    "cached layer redraws",
+};
+
+// The game loop's frames and the render thread's draws are recorded apart, every
+// thread only ever writes to its own track
+typedef struct
+{
+    ng_profiler_frame_t frames[RING_SLOTS];
+    // How many frames were ever finished, the current one is at recorded % RING_SLOTS
+    // Other threads read it (overlay, trace dumps), finished frames stay as they are until
+    // the ring comes around again
+    SDL_atomic_t recorded;
+
+    // Zones that began but didn't end yet
+    int open_zones[NG_PROFILER_MAX_DEPTH];
+    int depth;
+} track_t;
+
+static track_t frame_track, render_track;
+
+// The track of the frame this thread is running, NULL outside of frames
+// Zones and counters of threads that aren't running one are ignored
+static _Thread_local track_t *thread_track;
+
+static ng_profiler_frame_t *current_frame(track_t *track)
+{
+    return &track->frames[(unsigned int)SDL_AtomicGet(&track->recorded) % RING_SLOTS];
+}
+
+static void begin_frame(track_t *track)
+{
+    ng_profiler_frame_t *frame = current_frame(track);
+
+    frame->start = SDL_GetPerformanceCounter();
+    frame->end = frame->start;
+    frame->zone_count = 0;
+    frame->dropped_zones = 0;
+    SDL_memset(frame->counters, 0, sizeof(frame->counters));
+
+    track->depth = 0;
+    thread_track = track;
+}
+
+static void end_frame(track_t *track)
+{
+    if (thread_track != track)
+        return;
+
+    // Whatever is still open ends with the frame
+    while (track->depth > 0)
+        ng_profiler_end();
+
+    current_frame(track)->end = SDL_GetPerformanceCounter();
+
+    thread_track = NULL;
+    SDL_AtomicAdd(&track->recorded, 1);
+}
+
+void ng_profiler_frame_begin(void)
+{
+    begin_frame(&frame_track);
+}
+
+void ng_profiler_frame_end(void)
+{
+    end_frame(&frame_track);
+}
+
+void ng_profiler_render_begin(void)
+{
+    begin_frame(&render_track);
+}
+
+void ng_profiler_render_end(void)
+{
+    end_frame(&render_track);
+}
+
+void ng_profiler_begin(const char *name)
+{
+    track_t *track = thread_track;
+
+    // Zones outside of frames (e.g. loading) aren't recorded
+    if (!track)
+        return;
+
+    ng_profiler_frame_t *frame = current_frame(track);
+
+    if (frame->zone_count == NG_PROFILER_MAX_ZONES || track->depth == NG_PROFILER_MAX_DEPTH)
+    {
+        frame->dropped_zones++;
+        track->open_zones[MIN(track->depth, NG_PROFILER_MAX_DEPTH - 1)] = -1;
+        track->depth = MIN(track->depth + 1, NG_PROFILER_MAX_DEPTH);
+        return;
+    }
+
+    ng_profiler_zone_t *zone = &frame->zones[frame->zone_count];
+    zone->name = name;
+    zone->depth = track->depth;
+    zone->start = SDL_GetPerformanceCounter();
+    zone->end = zone->start;
+
+    track->open_zones[track->depth++] = frame->zone_count++;
+}
+
+void ng_profiler_end(void)
+{
+    track_t *track = thread_track;
+
+    if (!track || track->depth == 0)
+        return;
+
+    int zone = track->open_zones[--track->depth];
+    if (zone >= 0)
+        current_frame(track)->zones[zone].end = SDL_GetPerformanceCounter();
+}
+
+void ng_profiler_count(ng_counter_t counter, int amount)
+{
+    if (thread_track)
+        current_frame(thread_track)->counters[counter] += amount;
+}
+
+static const ng_profiler_frame_t *get_frame(track_t *track, int frames_ago)
+{
+    unsigned int recorded = (unsigned int)SDL_AtomicGet(&track->recorded);
+
+    if (frames_ago < 0 || frames_ago >= NG_PROFILER_FRAMES || (unsigned int)frames_ago >= recorded)
+        return NULL;
+
+    // Never the current slot, that one is still being recorded
+    return &track->frames[(recorded - 1 - frames_ago) % RING_SLOTS];
+}
+
+const ng_profiler_frame_t *ng_profiler_get_frame(int frames_ago)
+{
+    return get_frame(&frame_track, frames_ago);
+}
+
+const ng_profiler_frame_t *ng_profiler_get_render_frame(int frames_ago)
+{
+    return get_frame(&render_track, frames_ago);
+}
+
+double ng_profiler_get_frame_ms(const ng_profiler_frame_t *frame)
+{
+    return (double)(frame->end - frame->start) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+void ng_profiler_draw_overlay(SDL_Renderer *renderer, const SDL_FRect *area)
+{
+    SDL_FRect bars[3][NG_PROFILER_FRAMES];
+    int bar_counts[3] = {0, 0, 0};
+    float bar_width = area->w / NG_PROFILER_FRAMES;
+    float pixels_per_ms = area->h / OVERLAY_MAX_MS;
+
+    // Oldest frame on the left
+    for (int i = 0; i < NG_PROFILER_FRAMES; i++)
+    {
+        const ng_profiler_frame_t *frame = ng_profiler_get_frame(NG_PROFILER_FRAMES - 1 - i);
+        if (frame == NULL)
+            continue;
+
+        double ms = ng_profiler_get_frame_ms(frame);
+        float height = MIN(ms, OVERLAY_MAX_MS) * pixels_per_ms;
+        int color = ms <= 1000.0 / 60.0 ? 0 : ms <= 1000.0 / 30.0 ? 1 : 2;
+
+        bars[color][bar_counts[color]++] = (SDL_FRect){
+            area->x + i * bar_width, area->y + area->h - height, MAX(bar_width - 1.0f, 1.0f), height,
+        };
+    }
+
+    SDL_BlendMode previous;
+    SDL_GetRenderDrawBlendMode(renderer, &previous);
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+
+    // A dark background, one call per bar color and the two budget lines
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 160);
+    SDL_RenderFillRectF(renderer, area);
+
+    static const SDL_Color colors[3] = {{60, 200, 60, 255}, {230, 200, 40, 255}, {230, 50, 50, 255}};
+    for (int color = 0; color < 3; color++)
+    {
+        SDL_SetRenderDrawColor(renderer, colors[color].r, colors[color].g, colors[color].b, colors[color].a);
+        SDL_RenderFillRectsF(renderer, bars[color], bar_counts[color]);
+    }
+
+    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 120);
+    for (int fps = 60; fps >= 30; fps -= 30)
+    {
+        float y = area->y + area->h - (1000.0f / fps) * pixels_per_ms;
+        SDL_RenderDrawLineF(renderer, area->x, y, area->x + area->w, y);
+    }
+
+    SDL_SetRenderDrawBlendMode(renderer, previous);
+}
+
+static int get_frame_count(track_t *track)
+{
+    return MIN(SDL_AtomicGet(&track->recorded), NG_PROFILER_FRAMES);
+}
+
+// Every recorded frame of a track as one thread of the trace, frames first and then their zones
+static void write_track(FILE *file, track_t *track, int tid, const char *thread_name, uint64_t base)
+{
+    // Trace timestamps are microseconds, starting with the oldest frame of both tracks
+    double to_us = 1000000.0 / SDL_GetPerformanceFrequency();
+
+    fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+            tid, thread_name);
+
+    for (int i = get_frame_count(track) - 1; i >= 0; i--)
+    {
+        const ng_profiler_frame_t *frame = get_frame(track, i);
+        double frame_start = (frame->start - base) * to_us;
+
+        fprintf(file, ",\n{\"name\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                tid, frame_start, (frame->end - frame->start) * to_us);
+
+        for (int z = 0; z < frame->zone_count; z++)
+        {
+            const ng_profiler_zone_t *zone = &frame->zones[z];
+
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    zone->name, tid, (zone->start - base) * to_us, (zone->end - zone->start) * to_us);
+        }
+
+        // Counters show up as graphs above the zones, one per track
+        fprintf(file, ",\n{\"name\":\"%s counters\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{",
+                thread_name, frame_start);
+        for (int c = 0; c < NG_COUNTER_COUNT; c++)
+            fprintf(file, "%s\"%s\":%d", c == 0 ? "" : ",", counter_names[c], frame->counters[c]);
+        fprintf(file, "}}");
+    }
+}
+
+bool ng_profiler_dump_trace(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+        return false;
+
+    uint64_t base = UINT64_MAX;
+    int frame_count = get_frame_count(&frame_track);
+    int render_count = get_frame_count(&render_track);
+
+    if (frame_count > 0)
+        base = MIN(base, get_frame(&frame_track, frame_count - 1)->start);
+    if (render_count > 0)
+        base = MIN(base, get_frame(&render_track, render_count - 1)->start);
+
+    // Metadata first, so that every event after it starts with a comma
+    fprintf(file, "{\"traceEvents\":[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"game\"}}");
+
+    write_track(file, &frame_track, 1, "frames", base);
+    // Only ever recorded with a render thread
+    if (render_count > 0)
+        write_track(file, &render_track, 2, "render thread", base);
+
+    fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+    return fclose(file) == 0;
+}
+
+#else
+
+// Release builds keep the functions, so that callers don't need their own #ifdefs
+
+void ng_profiler_frame_begin(void) {}
+void ng_profiler_frame_end(void) {}
+void ng_profiler_render_begin(void) {}
+void ng_profiler_render_end(void) {}
+void ng_profiler_begin(const char *name) {}
+void ng_profiler_end(void) {}
+void ng_profiler_count(ng_counter_t counter, int amount) {}
+
+const ng_profiler_frame_t *ng_profiler_get_frame(int frames_ago)
+{
+    return NULL;
+}
+
+const ng_profiler_frame_t *ng_profiler_get_render_frame(int frames_ago)
+{
+    return NULL;
+}
+
+double ng_profiler_get_frame_ms(const ng_profiler_frame_t *frame)
+{
+    return 0.0;
+}
+
+void ng_profiler_draw_overlay(SDL_Renderer *renderer, const SDL_FRect *area) {}
+
+bool ng_profiler_dump_trace(const char *path)
+{
+    return false;
+}
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef _NG_PROFILER_H
+#define _NG_PROFILER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+/*
+ * Where the time of a frame goes. Zones are timestamped with the performance
+ * counter and nest, every frame keeps its own zones and counters, and the last
+ * NG_PROFILER_FRAMES frames stay around for the overlay and trace dumps
+ *
+ * Use the macros, release builds define NG_NO_PROFILER (make RELEASE=1) and then
+ * every zone and counter compiles to nothing. The functions stay, as no-ops
+ *
+ * Zones and counters go to the frame the calling thread is running. With a render
+ * thread (see game.h) the simulation runs the game loop's frames, while the render
+ * thread records a track of its own, one frame per draw (or per call it runs for the
+ * simulation). Calls from threads that aren't running any frame are ignored
+ */
+#define NG_PROFILER_FRAMES 240
+#define NG_PROFILER_MAX_ZONES 64
+#define NG_PROFILER_MAX_DEPTH 16
+
+typedef enum
+{
+    NG_COUNTER_DRAW_CALLS,
+    NG_COUNTER_TEXTURE_BINDS,
+    // Label contents that got laid out again
+    NG_COUNTER_LABEL_UPDATES,
+    // Glyph atlases rasterized for a new font
+    NG_COUNTER_GLYPH_RASTERIZATIONS,
+    // Quads that went into the game's draw list, and the ones culled for being off screen
+    NG_COUNTER_QUADS_SUBMITTED,
+    NG_COUNTER_QUADS_CULLED,
+    // Cached layers whose content had to be drawn again (see layers.h)
+    NG_COUNTER_LAYER_REDRAWS,
+    NG_COUNTER_COUNT
+} ng_counter_t;
+
+typedef struct
+{
+    // Has to be a string literal (or live as long as the program)
+    const char *name;
+    uint64_t start, end;
+    int depth;
+} ng_profiler_zone_t;
+
+typedef struct
+{
+    uint64_t start, end;
+
+    ng_profiler_zone_t zones[NG_PROFILER_MAX_ZONES];
+    int zone_count;
+    // Zones that didn't fit
+    int dropped_zones;
+
+    int counters[NG_COUNTER_COUNT];
+} ng_profiler_frame_t;
+
+#ifndef NG_NO_PROFILER
+#define NG_PROFILE_BEGIN(name) ng_profiler_begin(name)
+#define NG_PROFILE_END() ng_profiler_end()
+#define NG_PROFILE_COUNT(counter, amount) ng_profiler_count(counter, amount)
+#else
+#define NG_PROFILE_BEGIN(name) ((void)0)
+#define NG_PROFILE_END() ((void)0)
+#define NG_PROFILE_COUNT(counter, amount) ((void)0)
+#endif
+
+// The game loop calls these around every frame
+void ng_profiler_frame_begin(void);
+void ng_profiler_frame_end(void);
+// And the render thread around its work, kept apart from the game loop's frames
+void ng_profiler_render_begin(void);
+void ng_profiler_render_end(void);
+
+void ng_profiler_begin(const char *name);
+void ng_profiler_end(void);
+void ng_profiler_count(ng_counter_t counter, int amount);
+
+// 0 is the last finished frame, NULL if there's no such frame (yet)
+const ng_profiler_frame_t *ng_profiler_get_frame(int frames_ago);
+// Same for the render thread's frames, there are none without a render thread
+const ng_profiler_frame_t *ng_profiler_get_render_frame(int frames_ago);
+double ng_profiler_get_frame_ms(const ng_profiler_frame_t *frame);
+
+// Bars of the recent frame times, green within the 60 fps budget, yellow
+// within 30 fps and red above, with lines at both budgets
+void ng_profiler_draw_overlay(SDL_Renderer *renderer, const SDL_FRect *area);
+
+// Writes every recorded frame in the Chrome trace event format, load it in
+// chrome://tracing or ui.perfetto.dev. The render thread's frames show up as a
+// second thread. Returns false if the file can't be written
+bool ng_profiler_dump_trace(const char *path);
+
+#endif
@@ -0,0 +1,313 @@
+#include "replay.h"
+#include "common.h"
+#include "timers.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// "NGRP" in little endian, followed by the version of the format
+#define REPLAY_MAGIC 0x50524750u
+#define REPLAY_VERSION 1
+
+// Frame flags
+#define FRAME_KEYS_CHANGED 0x1
+
+// The keyboard state is stored as one bit per scancode
+#define KEY_BITSET_SIZE (SDL_NUM_SCANCODES / 8)
+
+static void attach(ng_replay_t *replay, ng_game_t *game, ng_replay_mode_t mode, SDL_RWops *file)
+{
+    replay->mode = mode;
+    replay->file = file;
+
+    memset(replay->keys, 0, sizeof(replay->keys));
+
+    replay->events = NULL;
+    replay->event_count = replay->event_capacity = 0;
+    replay->next_event = 0;
+
+    replay->frame_times = NULL;
+    replay->frame_count = replay->frame_capacity = 0;
+
+    game->replay = replay;
+
+    // Timers have to follow simulated time, otherwise animations and spawns
+    // would depend on how fast the machine replaying the session is
+    ng_game_use_simulated_clock(game);
+}
+
+void ng_replay_record(ng_replay_t *replay, ng_game_t *game, const char *path)
+{
+    SDL_RWops *file = SDL_RWFromFile(path, "wb");
+
+    if (!file)
+        ng_die("couldn't create replay file %s: %s", path, SDL_GetError());
+
+    SDL_WriteLE32(file, REPLAY_MAGIC);
+    SDL_WriteLE16(file, REPLAY_VERSION);
+    SDL_WriteLE32(file, game->tick_rate);
+    SDL_WriteLE32(file, game->seed);
+
+    attach(replay, game, NG_REPLAY_RECORDING, file);
+}
+
+void ng_replay_play(ng_replay_t *replay, ng_game_t *game, const char *path)
+{
+    SDL_RWops *file = SDL_RWFromFile(path, "rb");
+
+    if (!file)
+        ng_die("couldn't open replay file %s: %s", path, SDL_GetError());
+
+    if (SDL_ReadLE32(file) != REPLAY_MAGIC || SDL_ReadLE16(file) != REPLAY_VERSION)
+        ng_die("%s is not a replay file, or it was made by another version", path);
+
+    ng_game_set_tick_rate(game, SDL_ReadLE32(file));
+
+    // Same seed, same random numbers
+    game->seed = SDL_ReadLE32(file);
+    srand(game->seed);
+
+    attach(replay, game, NG_REPLAY_PLAYING, file);
+}
+
+static bool is_recordable(SDL_Event *event)
+{
+    switch (event->type)
+    {
+    case SDL_KEYDOWN:
+    case SDL_KEYUP:
+    case SDL_MOUSEMOTION:
+    case SDL_MOUSEBUTTONDOWN:
+    case SDL_MOUSEBUTTONUP:
+    case SDL_MOUSEWHEEL:
+    case SDL_WINDOWEVENT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void push_event(ng_replay_t *replay, SDL_Event *event)
+{
+    if (replay->event_count == replay->event_capacity)
+    {
+        replay->event_capacity = MAX(16, replay->event_capacity * 2);
+        replay->events = realloc(replay->events, replay->event_capacity * sizeof(SDL_Event));
+
+        if (!replay->events)
+            ng_die("ran out of memory while buffering replay events");
+    }
+
+    replay->events[replay->event_count++] = *event;
+}
+
+static void write_double(SDL_RWops *file, double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    SDL_WriteLE64(file, bits);
+}
+
+static bool read_double(SDL_RWops *file, double *value)
+{
+    uint64_t bits;
+    if (SDL_RWread(file, &bits, sizeof(bits), 1) != 1)
+        return false;
+
+    bits = SDL_SwapLE64(bits);
+    memcpy(value, &bits, sizeof(*value));
+
+    return true;
+}
+
+static void write_event(SDL_RWops *file, SDL_Event *event)
+{
+    SDL_WriteLE32(file, event->type);
+
+    // Key events are by far the most common ones, so only the useful fields are kept
+    if (event->type == SDL_KEYDOWN || event->type == SDL_KEYUP)
+    {
+        SDL_WriteLE16(file, event->key.keysym.scancode);
+        SDL_WriteLE32(file, event->key.keysym.sym);
+        SDL_WriteLE16(file, event->key.keysym.mod);
+        SDL_WriteU8(file, event->key.state);
+        SDL_WriteU8(file, event->key.repeat);
+    }
+    else
+        SDL_RWwrite(file, event, sizeof(SDL_Event), 1);
+}
+
+static bool read_event(SDL_RWops *file, SDL_Event *event)
+{
+    uint32_t type = SDL_ReadLE32(file);
+
+    if (type == SDL_KEYDOWN || type == SDL_KEYUP)
+    {
+        memset(event, 0, sizeof(SDL_Event));
+        event->type = type;
+        event->key.keysym.scancode = SDL_ReadLE16(file);
+        event->key.keysym.sym = SDL_ReadLE32(file);
+        event->key.keysym.mod = SDL_ReadLE16(file);
+        event->key.state = SDL_ReadU8(file);
+        event->key.repeat = SDL_ReadU8(file);
+
+        return true;
+    }
+
+    return SDL_RWread(file, event, sizeof(SDL_Event), 1) == 1;
+}
+
+bool ng_replay_begin_frame(ng_replay_t *replay, double *delta)
+{
+    replay->event_count = 0;
+    replay->next_event = 0;
+
+    if (replay->mode == NG_REPLAY_RECORDING)
+        return true;
+
+    // Every frame starts with its delta, so running out of data here is the normal way to end
+    if (!read_double(replay->file, delta))
+        return false;
+
+    int event_count = SDL_ReadLE16(replay->file);
+    uint8_t flags = SDL_ReadU8(replay->file);
+
+    if (flags & FRAME_KEYS_CHANGED)
+    {
+        uint8_t bitset[KEY_BITSET_SIZE];
+        if (SDL_RWread(replay->file, bitset, sizeof(bitset), 1) != 1)
+            return false;
+
+        for (int i = 0; i < SDL_NUM_SCANCODES; i++)
+            replay->keys[i] = (bitset[i / 8] >> (i % 8)) & 1;
+    }
+
+    for (int i = 0; i < event_count; i++)
+    {
+        SDL_Event event;
+        if (!read_event(replay->file, &event))
+            return false;
+
+        push_event(replay, &event);
+    }
+
+    return true;
+}
+
+bool ng_replay_capture_event(ng_replay_t *replay, SDL_Event *event)
+{
+    // Live input would make the playback diverge from the recording
+    if (replay->mode == NG_REPLAY_PLAYING)
+        return false;
+
+    if (is_recordable(event))
+        push_event(replay, event);
+
+    return true;
+}
+
+bool ng_replay_next_event(ng_replay_t *replay, SDL_Event *event)
+{
+    if (replay->mode != NG_REPLAY_PLAYING || replay->next_event >= replay->event_count)
+        return false;
+
+    *event = replay->events[replay->next_event++];
+    return true;
+}
+
+static void record_frame(ng_replay_t *replay, double delta)
+{
+    // The keyboard state rarely changes, only store it when it does
+    const Uint8 *live_keys = SDL_GetKeyboardState(NULL);
+    bool keys_changed = memcmp(replay->keys, live_keys, sizeof(replay->keys)) != 0;
+
+    write_double(replay->file, delta);
+    SDL_WriteLE16(replay->file, replay->event_count);
+    SDL_WriteU8(replay->file, keys_changed ? FRAME_KEYS_CHANGED : 0);
+
+    if (keys_changed)
+    {
+        uint8_t bitset[KEY_BITSET_SIZE] = {0};
+
+        for (int i = 0; i < SDL_NUM_SCANCODES; i++)
+            if (live_keys[i])
+                bitset[i / 8] |= 1 << (i % 8);
+
+        SDL_RWwrite(replay->file, bitset, sizeof(bitset), 1);
+        memcpy(replay->keys, live_keys, sizeof(replay->keys));
+    }
+
+    for (int i = 0; i < replay->event_count; i++)
+        write_event(replay->file, &replay->events[i]);
+}
+
+void ng_replay_end_frame(ng_replay_t *replay, double delta, double frame_time)
+{
+    if (replay->mode == NG_REPLAY_RECORDING)
+    {
+        record_frame(replay, delta);
+        return;
+    }
+
+    if (replay->frame_count == replay->frame_capacity)
+    {
+        replay->frame_capacity = MAX(1024, replay->frame_capacity * 2);
+        replay->frame_times = realloc(replay->frame_times, replay->frame_capacity * sizeof(double));
+
+        if (!replay->frame_times)
+            ng_die("ran out of memory while collecting replay timings");
+    }
+
+    replay->frame_times[replay->frame_count++] = frame_time;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double first = *(const double*)a, second = *(const double*)b;
+    return (first > second) - (first < second);
+}
+
+static double percentile(double *sorted, size_t count, double p)
+{
+    size_t index = (size_t)(p * (count - 1) + 0.5);
+    return sorted[MIN(index, count - 1)];
+}
+
+static void print_report(ng_replay_t *replay)
+{
+    size_t count = replay->frame_count;
+
+    if (count == 0)
+    {
+        printf("replay finished without playing any frames\n");
+        return;
+    }
+
+    double total = 0.0;
+    for (size_t i = 0; i < count; i++)
+        total += replay->frame_times[i];
+
+    qsort(replay->frame_times, count, sizeof(double), compare_doubles);
+    double *sorted = replay->frame_times;
+
+    printf("replay: %zu frames, frame time in ms\n", count);
+    printf("  mean %.3f  min %.3f  median %.3f  p95 %.3f  p99 %.3f  max %.3f\n",
+           total / count * 1000.0, sorted[0] * 1000.0,
+           percentile(sorted, count, 0.50) * 1000.0, percentile(sorted, count, 0.95) * 1000.0,
+           percentile(sorted, count, 0.99) * 1000.0, sorted[count - 1] * 1000.0);
+}
+
+void ng_replay_finish(ng_replay_t *replay)
+{
+    if (replay->mode == NG_REPLAY_PLAYING)
+        print_report(replay);
+
+    SDL_RWclose(replay->file);
+
+    free(replay->events);
+    free(replay->frame_times);
+    replay->events = NULL;
+    replay->frame_times = NULL;
+
+    ng_timers_set_clock(NULL);
+}
@@ -0,0 +1,57 @@
+#ifndef _NG_REPLAY_H
+#define _NG_REPLAY_H
+
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "game.h"
+
+typedef enum
+{
+    NG_REPLAY_RECORDING,
+    NG_REPLAY_PLAYING
+} ng_replay_mode_t;
+
+/*
+ * Replays capture everything that makes a session unique: the RNG seed, the tick rate,
+ * and for every frame its delta, the events handed to handle_event and the keyboard
+ * state. Playing one back reproduces the session frame for frame, which makes it a
+ * reproducible performance workload (windowed or headless)
+ *
+ * Only keyboard, mouse and window events are recorded, the rest may hold pointers
+ */
+typedef struct ng_replay_t
+{
+    ng_replay_mode_t mode;
+    SDL_RWops *file;
+
+    // Keyboard state of the current frame, this is what the game gets to see
+    Uint8 keys[SDL_NUM_SCANCODES];
+
+    // Events of the current frame, buffered until it's written or consumed
+    SDL_Event *events;
+    int event_count, event_capacity;
+    int next_event;
+
+    // How long each played back frame took to update and render, in seconds
+    double *frame_times;
+    size_t frame_count, frame_capacity;
+} ng_replay_t;
+
+// Both of them have to be called right after creating the game, before anything random happens
+void ng_replay_record(ng_replay_t *replay, ng_game_t *game, const char *path);
+void ng_replay_play(ng_replay_t *replay, ng_game_t *game, const char *path);
+
+// Hooks used by the game loop, you shouldn't need to call them yourself
+// Returns false when a replay has run out of frames
+bool ng_replay_begin_frame(ng_replay_t *replay, double *delta);
+// Returns true if a live event should reach the game
+bool ng_replay_capture_event(ng_replay_t *replay, SDL_Event *event);
+// Hands out the recorded events of the current frame one by one
+bool ng_replay_next_event(ng_replay_t *replay, SDL_Event *event);
+void ng_replay_end_frame(ng_replay_t *replay, double delta, double frame_time);
+
+// Closes the log, playbacks also print their per-frame timing report
+void ng_replay_finish(ng_replay_t *replay);
+
+#endif
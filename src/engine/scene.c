@@ -0,0 +1,261 @@
+#include "scene.h"
+#include "common.h"
+#include "profiler.h"
+#include <stdlib.h>
+
+// Arguments of the functions that have to run on the render thread
+typedef struct
+{
+    ng_scene_stack_t *stack;
+    ng_scene_change_t change;
+    ng_scene_t *scene;
+} scene_call_t;
+
+// The first hold acquires the whole manifest and starts decoding it in the background
+static void hold(ng_scene_t *scene)
+{
+    if (!scene || scene->holds++ > 0)
+        return;
+
+    scene->assets = malloc(MAX(scene->manifest_count, 1) * sizeof(ng_asset_t*));
+    if (!scene->assets)
+        ng_die("ran out of memory while loading the %s scene", scene->name);
+
+    for (int i = 0; i < scene->manifest_count; i++)
+    {
+        const ng_scene_asset_t *entry = &scene->manifest[i];
+
+        scene->assets[i] = ng_assets_acquire(entry->kind, entry->path, entry->parameter);
+        ng_assets_preload(scene->assets[i]);
+    }
+}
+
+// The last one releases it, assets no other scene holds get unloaded (textures too,
+// which is why this only happens on the render thread)
+static void drop(ng_scene_t *scene)
+{
+    if (!scene || --scene->holds > 0)
+        return;
+
+    for (int i = 0; i < scene->manifest_count; i++)
+        ng_asset_release(scene->assets[i]);
+
+    free(scene->assets);
+    scene->assets = NULL;
+}
+
+static bool is_ready(ng_scene_t *scene)
+{
+    for (int i = 0; i < scene->manifest_count; i++)
+        if (scene->assets[i]->state != NG_ASSET_LOADED)
+            return false;
+
+    return true;
+}
+
+// Loads (or waits for) whatever the background hasn't finished yet
+static void load_now(ng_scene_t *scene)
+{
+    for (int i = 0; i < scene->manifest_count; i++)
+    {
+        ng_asset_t *asset = scene->assets[i];
+
+        switch (asset->kind)
+        {
+        case NG_ASSET_TEXTURE:
+            ng_asset_texture(asset);
+            break;
+        case NG_ASSET_FONT:
+            ng_asset_font(asset);
+            break;
+        case NG_ASSET_CHUNK:
+            ng_asset_chunk(asset);
+            break;
+        case NG_ASSET_MUSIC:
+            ng_asset_music(asset);
+            break;
+        }
+    }
+}
+
+void ng_scenes_create(ng_scene_stack_t *stack, ng_game_t *game)
+{
+    stack->game = game;
+    stack->depth = 0;
+    stack->next = NULL;
+
+    stack->change = NG_SCENE_CHANGE_NONE;
+    stack->target = NULL;
+}
+
+static void destroy_on_render_thread(void *data)
+{
+    ng_scene_stack_t *stack = data;
+
+    drop(stack->target);
+    drop(stack->next);
+
+    while (stack->depth > 0)
+    {
+        ng_scene_t *scene = stack->stack[--stack->depth];
+
+        if (scene->exit)
+            scene->exit();
+        drop(scene);
+    }
+
+    stack->change = NG_SCENE_CHANGE_NONE;
+    stack->target = stack->next = NULL;
+}
+
+void ng_scenes_destroy(ng_scene_stack_t *stack)
+{
+    ng_game_call_on_render_thread(stack->game, destroy_on_render_thread, stack);
+}
+
+static void request_on_render_thread(void *data)
+{
+    scene_call_t *call = data;
+    ng_scene_stack_t *stack = call->stack;
+
+    // Held before the previous target gets dropped, so that whatever both
+    // share isn't unloaded and loaded again right away
+    hold(call->scene);
+    drop(stack->target);
+
+    stack->change = call->change;
+    stack->target = call->scene;
+}
+
+static void request(ng_scene_stack_t *stack, ng_scene_change_t change, ng_scene_t *scene)
+{
+    // Scenes usually keep asking for the same change until it happens
+    if (stack->change == change && stack->target == scene)
+        return;
+
+    scene_call_t call = {stack, change, scene};
+    ng_game_call_on_render_thread(stack->game, request_on_render_thread, &call);
+}
+
+void ng_scenes_push(ng_scene_stack_t *stack, ng_scene_t *scene)
+{
+    request(stack, NG_SCENE_CHANGE_PUSH, scene);
+}
+
+void ng_scenes_pop(ng_scene_stack_t *stack)
+{
+    request(stack, NG_SCENE_CHANGE_POP, NULL);
+}
+
+void ng_scenes_switch(ng_scene_stack_t *stack, ng_scene_t *scene)
+{
+    request(stack, NG_SCENE_CHANGE_SWITCH, scene);
+}
+
+static void preload_on_render_thread(void *data)
+{
+    scene_call_t *call = data;
+    ng_scene_stack_t *stack = call->stack;
+
+    // Same order as requests, shared assets stay loaded
+    hold(call->scene);
+    drop(stack->next);
+
+    stack->next = call->scene;
+}
+
+void ng_scenes_preload(ng_scene_stack_t *stack, ng_scene_t *scene)
+{
+    if (stack->next == scene)
+        return;
+
+    scene_call_t call = {stack, NG_SCENE_CHANGE_NONE, scene};
+    ng_game_call_on_render_thread(stack->game, preload_on_render_thread, &call);
+}
+
+ng_scene_t* ng_scenes_get_active(ng_scene_stack_t *stack)
+{
+    return stack->depth > 0 ? stack->stack[stack->depth - 1] : NULL;
+}
+
+static void change_on_render_thread(void *data)
+{
+    ng_scene_stack_t *stack = data;
+    ng_scene_change_t change = stack->change;
+    ng_scene_t *scene = stack->target;
+
+    stack->change = NG_SCENE_CHANGE_NONE;
+    stack->target = NULL;
+
+    if (scene)
+        load_now(scene);
+
+    if (change == NG_SCENE_CHANGE_POP && stack->depth == 0)
+        ng_die("there's no scene left to pop");
+
+    // Popped or switched out, its assets go away unless the new scene holds them too
+    if (change != NG_SCENE_CHANGE_PUSH && stack->depth > 0)
+    {
+        ng_scene_t *previous = stack->stack[--stack->depth];
+
+        if (previous->exit)
+            previous->exit();
+        drop(previous);
+    }
+
+    if (change == NG_SCENE_CHANGE_POP)
+        return;
+
+    if (stack->depth == NG_SCENE_STACK_SIZE)
+        ng_die("can't push the %s scene, the stack is full", scene->name);
+
+    // The request's hold now belongs to the stack
+    stack->stack[stack->depth++] = scene;
+
+    // It's here now, no need to keep it around as the next scene as well
+    if (stack->next == scene)
+    {
+        drop(scene);
+        stack->next = NULL;
+    }
+
+    if (scene->enter)
+        scene->enter();
+}
+
+static void apply_change(ng_scene_stack_t *stack)
+{
+    if (stack->change == NG_SCENE_CHANGE_NONE)
+        return;
+
+    // Only these have to behave the same no matter how fast loading goes
+    bool must_wait = stack->game->is_headless || stack->game->replay;
+
+    if (!must_wait && stack->target && !is_ready(stack->target))
+        return;
+
+    NG_PROFILE_BEGIN("scene change");
+    ng_game_call_on_render_thread(stack->game, change_on_render_thread, stack);
+    NG_PROFILE_END();
+}
+
+void ng_scenes_update(ng_scene_stack_t *stack, float delta)
+{
+    // A change that was still loading the last time
+    apply_change(stack);
+
+    ng_scene_t *scene = ng_scenes_get_active(stack);
+    if (scene && scene->update)
+        scene->update(delta);
+
+    // One this very update asked for, so that it already shows up this frame
+    apply_change(stack);
+}
+
+void ng_scenes_render(ng_scene_stack_t *stack, float alpha)
+{
+    ng_scene_t *scene = ng_scenes_get_active(stack);
+
+    if (scene && scene->render)
+        scene->render(alpha);
+}
@@ -0,0 +1,104 @@
+#ifndef _NG_SCENE_H
+#define _NG_SCENE_H
+
+#include <stdbool.h>
+#include "assets.h"
+#include "game.h"
+
+// One entry of a scene's manifest, the same key ng_assets_acquire() takes
+typedef struct
+{
+    ng_asset_kind_t kind;
+    const char *path;
+    int parameter;
+} ng_scene_asset_t;
+
+/*
+ * A screen of the game (a menu, the gameplay, a game over screen...) along with
+ * every asset it needs. Only the scenes on the stack and the one coming next keep
+ * their assets acquired, everything else gets released, so what's resident follows
+ * the scenes actually in use instead of adding up all of them
+ *
+ * Every hook is optional. enter and exit run on the render thread (see
+ * ng_game_call_on_render_thread), so they may create labels and textures, and every
+ * asset of the manifest is loaded by the time enter runs
+ */
+typedef struct ng_scene_t
+{
+    const char *name;
+
+    const ng_scene_asset_t *manifest;
+    int manifest_count;
+
+    // Called when the scene gets pushed or switched in, and when it gets popped or switched out
+    // NOTE: A scene covered by another one stays entered, it just stops updating and rendering
+    void (*enter)(void);
+    void (*exit)(void);
+    // Same as the game loop's handlers, only the scene on top gets them
+    update_handler_t update;
+    render_handler_t render;
+
+    // The manifest's assets in the same order, only set while the scene is held
+    ng_asset_t **assets;
+    // Held once for every place it's in: the stack, the next scene, a pending change
+    int holds;
+} ng_scene_t;
+
+typedef enum
+{
+    NG_SCENE_CHANGE_NONE,
+    NG_SCENE_CHANGE_PUSH,
+    NG_SCENE_CHANGE_POP,
+    NG_SCENE_CHANGE_SWITCH
+} ng_scene_change_t;
+
+#define NG_SCENE_STACK_SIZE 8
+
+/*
+ * Scene changes never load anything on the spot. Asking for one starts decoding
+ * the scene's manifest in the background, and the change only happens once all of
+ * it is ready, the current scene keeps running meanwhile. Announcing the likely next
+ * scene with ng_scenes_preload() ahead of time usually makes the change immediate
+ *
+ * Headless games and replays can't depend on how fast loading goes, their changes
+ * always happen right away and wait for whatever is still loading
+ */
+typedef struct
+{
+    ng_game_t *game;
+
+    ng_scene_t *stack[NG_SCENE_STACK_SIZE];
+    int depth;
+
+    // Loading in the background ahead of time, see ng_scenes_preload()
+    ng_scene_t *next;
+
+    // The change waiting for its scene to finish loading (only one, the last request wins)
+    ng_scene_change_t change;
+    ng_scene_t *target;
+} ng_scene_stack_t;
+
+// NOTE: The asset registry has to be initialized first
+void ng_scenes_create(ng_scene_stack_t *stack, ng_game_t *game);
+// Exits every scene on the stack and releases everything they were holding
+void ng_scenes_destroy(ng_scene_stack_t *stack);
+
+// These only request the change, it happens during a later ng_scenes_update()
+void ng_scenes_push(ng_scene_stack_t *stack, ng_scene_t *scene);
+void ng_scenes_pop(ng_scene_stack_t *stack);
+// Replaces the scene on top, assets both scenes share stay loaded
+void ng_scenes_switch(ng_scene_stack_t *stack, ng_scene_t *scene);
+
+// Starts loading the scene that will most likely come next, whatever was preloaded
+// before gets released (NULL only releases it). Cheap when nothing changes
+void ng_scenes_preload(ng_scene_stack_t *stack, ng_scene_t *scene);
+
+// The scene on top, NULL before the first change happened
+ng_scene_t* ng_scenes_get_active(ng_scene_stack_t *stack);
+
+// Call them from the game's update and render handlers
+// Updating also carries out the pending change, once its scene is ready
+void ng_scenes_update(ng_scene_stack_t *stack, float delta);
+void ng_scenes_render(ng_scene_stack_t *stack, float alpha);
+
+#endif
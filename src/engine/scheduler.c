@@ -0,0 +1,298 @@
+#include "scheduler.h"
+#include "common.h"
+#include <math.h>
+#include <stdlib.h>
+
+#define NONE -1
+#define SLOT_MASK (NG_WHEEL_SLOTS - 1)
+
+// Where timers are while they're in the firing list
+#define FIRING_LEVEL NG_WHEEL_LEVELS
+
+// Anything further away waits in the last level and gets another look when it comes up
+#define MAX_DELTA ((1ull << (NG_WHEEL_LEVELS * NG_WHEEL_SLOT_BITS)) - 1)
+
+void ng_scheduler_create(ng_scheduler_t *scheduler)
+{
+    for (int level = 0; level < NG_WHEEL_LEVELS; level++)
+    {
+        for (int slot = 0; slot < NG_WHEEL_SLOTS; slot++)
+            scheduler->wheel[level][slot] = (ng_timer_list_t){NONE, NONE};
+    }
+    scheduler->firing = (ng_timer_list_t){NONE, NONE};
+
+    scheduler->timers = NULL;
+    scheduler->capacity = 0;
+    scheduler->free_timer = NONE;
+    scheduler->active_count = 0;
+
+    scheduler->now = 0;
+    scheduler->remainder = 0.0;
+
+    scheduler->is_paused = false;
+    scheduler->time_scale = 1.0f;
+}
+
+void ng_scheduler_destroy(ng_scheduler_t *scheduler)
+{
+    free(scheduler->timers);
+    scheduler->timers = NULL;
+    scheduler->capacity = 0;
+}
+
+static ng_timer_list_t *get_list(ng_scheduler_t *scheduler, ng_scheduled_timer_t *timer)
+{
+    if (timer->level == FIRING_LEVEL)
+        return &scheduler->firing;
+
+    return &scheduler->wheel[timer->level][timer->slot];
+}
+
+static void unlink_timer(ng_scheduler_t *scheduler, int32_t index)
+{
+    ng_scheduled_timer_t *timer = &scheduler->timers[index];
+    ng_timer_list_t *list = get_list(scheduler, timer);
+
+    if (timer->prev != NONE)
+        scheduler->timers[timer->prev].next = timer->next;
+    else
+        list->head = timer->next;
+
+    if (timer->next != NONE)
+        scheduler->timers[timer->next].prev = timer->prev;
+    else
+        list->tail = timer->prev;
+}
+
+// Puts the timer at the end of the slot it expires in, relative to the current time
+static void link_timer(ng_scheduler_t *scheduler, int32_t index)
+{
+    ng_scheduled_timer_t *timer = &scheduler->timers[index];
+
+    // Late timers (e.g. a repeating timer catching up) go in the very next slot
+    uint64_t expires = MAX(timer->expires, scheduler->now);
+    uint64_t delta = MIN(expires - scheduler->now, MAX_DELTA);
+    expires = scheduler->now + delta;
+
+    int level = 0;
+    while (level < NG_WHEEL_LEVELS - 1 && delta >= (1ull << ((level + 1) * NG_WHEEL_SLOT_BITS)))
+        level++;
+
+    timer->level = level;
+    timer->slot = (expires >> (level * NG_WHEEL_SLOT_BITS)) & SLOT_MASK;
+
+    // Appending keeps timers due at the same time in the order they were added
+    ng_timer_list_t *list = get_list(scheduler, timer);
+    timer->prev = list->tail;
+    timer->next = NONE;
+
+    if (list->tail != NONE)
+        scheduler->timers[list->tail].next = index;
+    else
+        list->head = index;
+
+    list->tail = index;
+}
+
+static int32_t allocate_timer(ng_scheduler_t *scheduler)
+{
+    if (scheduler->free_timer == NONE)
+    {
+        int32_t capacity = MAX(64, scheduler->capacity * 2);
+        scheduler->timers = realloc(scheduler->timers, capacity * sizeof(ng_scheduled_timer_t));
+
+        if (scheduler->timers == NULL)
+            ng_die("ran out of memory while growing the scheduler");
+
+        // Chain the new timers into the free list, lowest index first
+        for (int32_t i = capacity - 1; i >= scheduler->capacity; i--)
+        {
+            scheduler->timers[i].generation = 0;
+            scheduler->timers[i].is_active = false;
+            scheduler->timers[i].next = scheduler->free_timer;
+            scheduler->free_timer = i;
+        }
+
+        scheduler->capacity = capacity;
+    }
+
+    int32_t index = scheduler->free_timer;
+    scheduler->free_timer = scheduler->timers[index].next;
+
+    return index;
+}
+
+static void release_timer(ng_scheduler_t *scheduler, int32_t index)
+{
+    ng_scheduled_timer_t *timer = &scheduler->timers[index];
+
+    // Old handles don't match anymore
+    timer->generation++;
+    timer->is_active = false;
+    timer->next = scheduler->free_timer;
+    scheduler->free_timer = index;
+    scheduler->active_count--;
+}
+
+static ng_timer_handle_t schedule(ng_scheduler_t *scheduler, uint32_t delay_ms, uint32_t period_ms,
+                                  ng_timer_callback_t callback, void *data)
+{
+    int32_t index = allocate_timer(scheduler);
+    ng_scheduled_timer_t *timer = &scheduler->timers[index];
+
+    timer->expires = scheduler->now + MAX(delay_ms, 1u);
+    timer->period = period_ms;
+    timer->callback = callback;
+    timer->data = data;
+    timer->is_active = true;
+
+    link_timer(scheduler, index);
+    scheduler->active_count++;
+
+    return (ng_timer_handle_t){index, timer->generation};
+}
+
+ng_timer_handle_t ng_scheduler_after(ng_scheduler_t *scheduler, uint32_t delay_ms,
+                                     ng_timer_callback_t callback, void *data)
+{
+    return schedule(scheduler, delay_ms, 0, callback, data);
+}
+
+ng_timer_handle_t ng_scheduler_every(ng_scheduler_t *scheduler, uint32_t period_ms,
+                                     ng_timer_callback_t callback, void *data)
+{
+    period_ms = MAX(period_ms, 1u);
+    return schedule(scheduler, period_ms, period_ms, callback, data);
+}
+
+bool ng_scheduler_cancel(ng_scheduler_t *scheduler, ng_timer_handle_t handle)
+{
+    if (handle.index >= (uint32_t)scheduler->capacity)
+        return false;
+
+    ng_scheduled_timer_t *timer = &scheduler->timers[handle.index];
+    if (!timer->is_active || timer->generation != handle.generation)
+        return false;
+
+    unlink_timer(scheduler, handle.index);
+    release_timer(scheduler, handle.index);
+
+    return true;
+}
+
+void ng_scheduler_cancel_all(ng_scheduler_t *scheduler)
+{
+    for (int32_t i = 0; i < scheduler->capacity; i++)
+    {
+        if (scheduler->timers[i].is_active)
+        {
+            unlink_timer(scheduler, i);
+            release_timer(scheduler, i);
+        }
+    }
+}
+
+// Moves every timer of a higher level slot down to where it belongs now
+// Returns the slot, which is 0 when the level above has to cascade as well
+static int cascade(ng_scheduler_t *scheduler, int level)
+{
+    int slot = (scheduler->now >> (level * NG_WHEEL_SLOT_BITS)) & SLOT_MASK;
+    ng_timer_list_t *list = &scheduler->wheel[level][slot];
+    int32_t index = list->head;
+
+    *list = (ng_timer_list_t){NONE, NONE};
+
+    while (index != NONE)
+    {
+        int32_t next = scheduler->timers[index].next;
+        link_timer(scheduler, index);
+        index = next;
+    }
+
+    return slot;
+}
+
+static void run_tick(ng_scheduler_t *scheduler)
+{
+    int slot = scheduler->now & SLOT_MASK;
+
+    // Every time the first level wraps around, the next slot of the level above comes in
+    if (slot == 0)
+    {
+        for (int level = 1; level < NG_WHEEL_LEVELS && cascade(scheduler, level) == 0; level++)
+            ;
+    }
+
+    // Taking the whole slot out first, repeating timers with short periods
+    // could end up in the same slot again
+    ng_timer_list_t *list = &scheduler->firing;
+    *list = scheduler->wheel[0][slot];
+    scheduler->wheel[0][slot] = (ng_timer_list_t){NONE, NONE};
+
+    for (int32_t index = list->head; index != NONE; index = scheduler->timers[index].next)
+        scheduler->timers[index].level = FIRING_LEVEL;
+
+    scheduler->now++;
+
+    // Callbacks may cancel the following timers, so always take the current head
+    while (list->head != NONE)
+    {
+        int32_t index = list->head;
+        ng_scheduled_timer_t *timer = &scheduler->timers[index];
+        ng_timer_callback_t callback = timer->callback;
+        void *data = timer->data;
+
+        unlink_timer(scheduler, index);
+
+        // Repeating timers are due again one period after they were due, not after
+        // now, so missed periods are caught up on instead of dropped
+        if (timer->period > 0)
+        {
+            timer->expires += timer->period;
+            link_timer(scheduler, index);
+        }
+        else
+            release_timer(scheduler, index);
+
+        // NOTE: timer may point at freed memory from here on, the callback can grow the pool
+        callback(data);
+    }
+}
+
+void ng_scheduler_advance(ng_scheduler_t *scheduler, double seconds)
+{
+    if (scheduler->is_paused)
+        return;
+
+    scheduler->remainder += seconds * 1000.0 * scheduler->time_scale;
+
+    double milliseconds = floor(scheduler->remainder);
+    scheduler->remainder -= milliseconds;
+
+    uint64_t target = scheduler->now + (uint64_t)milliseconds;
+
+    // Nothing to fire, skipping the wheel entirely is safe
+    if (scheduler->active_count == 0)
+    {
+        scheduler->now = target;
+        return;
+    }
+
+    while (scheduler->now < target)
+        run_tick(scheduler);
+}
+
+void ng_scheduler_set_paused(ng_scheduler_t *scheduler, bool is_paused)
+{
+    scheduler->is_paused = is_paused;
+}
+
+void ng_scheduler_set_time_scale(ng_scheduler_t *scheduler, float time_scale)
+{
+    scheduler->time_scale = MAX(time_scale, 0.0f);
+}
+
+uint64_t ng_scheduler_get_time_ms(ng_scheduler_t *scheduler)
+{
+    return scheduler->now;
+}
@@ -0,0 +1,100 @@
+#ifndef _NG_SCHEDULER_H
+#define _NG_SCHEDULER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef void (*ng_timer_callback_t) (void *data);
+
+// Stays valid until the timer is cancelled or a one-shot timer fires,
+// after that it's just ignored, even if the timer's memory gets reused
+typedef struct
+{
+    uint32_t index;
+    uint32_t generation;
+} ng_timer_handle_t;
+
+#define NG_WHEEL_LEVELS 4
+#define NG_WHEEL_SLOT_BITS 6
+#define NG_WHEEL_SLOTS (1 << NG_WHEEL_SLOT_BITS)
+
+typedef struct
+{
+    uint64_t expires;
+    // 0 for one-shot timers
+    uint32_t period;
+
+    ng_timer_callback_t callback;
+    void *data;
+
+    uint32_t generation;
+    bool is_active;
+
+    // Neighbours inside the slot's list (or the free list), as indices into the pool
+    int32_t prev, next;
+    // Which list it's in, so that cancelling doesn't need to search for it
+    int16_t level, slot;
+} ng_scheduled_timer_t;
+
+typedef struct
+{
+    int32_t head, tail;
+} ng_timer_list_t;
+
+/*
+ * Timers live in a hierarchical timing wheel with millisecond resolution. The
+ * first level has a slot for every one of the next 64 milliseconds, every level
+ * above covers 64 times more time per slot, and timers move down a level when
+ * their slot comes up. Adding and cancelling are O(1) and advancing only ever
+ * looks at the slots that are due, no matter how many timers there are
+ *
+ * The game advances its scheduler with the simulated time of every tick, so
+ * timers are as deterministic as the rest of the simulation. When a lot of time
+ * passes at once, repeating timers fire once for every period they missed, in
+ * the same order they would have fired otherwise
+ */
+typedef struct
+{
+    ng_timer_list_t wheel[NG_WHEEL_LEVELS][NG_WHEEL_SLOTS];
+    // Timers that are due right now and waiting for their callback
+    ng_timer_list_t firing;
+
+    ng_scheduled_timer_t *timers;
+    int32_t capacity;
+    int32_t free_timer;
+    int active_count;
+
+    // Milliseconds processed so far
+    uint64_t now;
+    // Time that wasn't a whole millisecond yet
+    double remainder;
+
+    bool is_paused;
+    float time_scale;
+} ng_scheduler_t;
+
+void ng_scheduler_create(ng_scheduler_t *scheduler);
+void ng_scheduler_destroy(ng_scheduler_t *scheduler);
+
+// NOTE: Delays and periods are at least one millisecond, callbacks never run
+// right away and are free to add or cancel timers (including their own)
+ng_timer_handle_t ng_scheduler_after(ng_scheduler_t *scheduler, uint32_t delay_ms,
+                                     ng_timer_callback_t callback, void *data);
+// Fires every period_ms, the first time period_ms from now
+ng_timer_handle_t ng_scheduler_every(ng_scheduler_t *scheduler, uint32_t period_ms,
+                                     ng_timer_callback_t callback, void *data);
+// Returns false if the timer already fired or was cancelled before
+bool ng_scheduler_cancel(ng_scheduler_t *scheduler, ng_timer_handle_t handle);
+void ng_scheduler_cancel_all(ng_scheduler_t *scheduler);
+
+// Fires everything that becomes due during the next few seconds of game time
+void ng_scheduler_advance(ng_scheduler_t *scheduler, double seconds);
+
+void ng_scheduler_set_paused(ng_scheduler_t *scheduler, bool is_paused);
+// 2 runs every timer twice as fast, 0.5 half as fast
+void ng_scheduler_set_time_scale(ng_scheduler_t *scheduler, float time_scale);
+
+// Scaled milliseconds since the scheduler was created
+uint64_t ng_scheduler_get_time_ms(ng_scheduler_t *scheduler);
+
+#endif
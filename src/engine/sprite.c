@@ -1,5 +1,7 @@
 #include "sprite.h"
 #include "common.h"
+#include "profiler.h"
+#include <stdlib.h>
 
 void ng_sprite_create(ng_sprite_t *sprite, SDL_Texture *texture)
 {
@@ -7,6 +9,7 @@ void ng_sprite_create(ng_sprite_t *sprite, SDL_Texture *texture)
         ng_die("failed to create sprite, an invalid texture was provided");
     
     sprite->texture = texture;
+    sprite->region = NULL;
     sprite->src.x = sprite->src.y = 0;
 
     // Fetching the texture's dimensions and saving them in the sprite's source rect 
@@ -16,17 +19,65 @@ void ng_sprite_create(ng_sprite_t *sprite, SDL_Texture *texture)
     ng_sprite_set_scale(sprite, 1.0f);
 }
 
+void ng_sprite_create_from_region(ng_sprite_t *sprite, const ng_atlas_region_t *region)
+{
+    if (!region)
+        ng_die("failed to create sprite, an invalid atlas region was provided");
+
+    sprite->texture = region->texture;
+    sprite->region = region;
+    sprite->src = region->rect;
+
+    sprite->transform.x = sprite->transform.y = 0;
+    ng_sprite_set_scale(sprite, 1.0f);
+}
+
 void ng_sprite_set_scale(ng_sprite_t *sprite, float scale)
 {
+    // Atlas frames are scaled by their original size, not the trimmed one
+    int base_w = sprite->region ? sprite->region->source_w : sprite->src.w;
+    int base_h = sprite->region ? sprite->region->source_h : sprite->src.h;
+
     // They can only appear as multiples of the base size,
     // because otherwise the sprite will appear stretched and ugly
-    sprite->transform.w = sprite->src.w * scale;
-    sprite->transform.h = sprite->src.h * scale;
+    sprite->transform.w = base_w * scale;
+    sprite->transform.h = base_h * scale;
+}
+
+void ng_sprite_get_draw_rect(ng_sprite_t *sprite, const SDL_FRect *transform,
+                             SDL_RendererFlip flip, SDL_FRect *result)
+{
+    const ng_atlas_region_t *region = sprite->region;
+
+    if (!region)
+    {
+        *result = *transform;
+        return;
+    }
+
+    float scale_x = transform->w / region->source_w;
+    float scale_y = transform->h / region->source_h;
+
+    // Flipping mirrors the trimmed borders too
+    int offset_x = (flip & SDL_FLIP_HORIZONTAL)
+        ? region->source_w - region->offset_x - region->rect.w : region->offset_x;
+    int offset_y = (flip & SDL_FLIP_VERTICAL)
+        ? region->source_h - region->offset_y - region->rect.h : region->offset_y;
+
+    result->x = transform->x + offset_x * scale_x;
+    result->y = transform->y + offset_y * scale_y;
+    result->w = region->rect.w * scale_x;
+    result->h = region->rect.h * scale_y;
 }
 
 void ng_sprite_render(ng_sprite_t *sprite, SDL_Renderer *renderer)
 {
-    SDL_RenderCopyF(renderer, sprite->texture, &sprite->src, &sprite->transform);
+    SDL_FRect target;
+    ng_sprite_get_draw_rect(sprite, &sprite->transform, SDL_FLIP_NONE, &target);
+
+    SDL_RenderCopyF(renderer, sprite->texture, &sprite->src, &target);
+    NG_PROFILE_COUNT(NG_COUNTER_DRAW_CALLS, 1);
+    NG_PROFILE_COUNT(NG_COUNTER_TEXTURE_BINDS, 1);
 }
 
 void ng_animated_create(ng_animated_sprite_t *anim, SDL_Texture *texture,
@@ -36,14 +87,338 @@ void ng_animated_create(ng_animated_sprite_t *anim, SDL_Texture *texture,
 
     anim->total_frames = total_frames = total_frames;
     anim->frame = 0;
+    anim->frames = NULL;
 
     // Adjust source size, we are only interested in a single frame
     anim->sprite.src.w /= total_frames;
     anim->sprite.transform.w = anim->sprite.src.w;
 }
 
+void ng_animated_create_from_atlas(ng_animated_sprite_t *anim, const ng_atlas_region_t *frames,
+                                   unsigned int total_frames)
+{
+    // Every frame keeps the same untrimmed size, so the first one sets the transform
+    ng_sprite_create_from_region(&anim->sprite, frames);
+
+    anim->total_frames = total_frames;
+    anim->frame = 0;
+    anim->frames = frames;
+}
+
 void ng_animated_set_frame(ng_animated_sprite_t *anim, int frame_index)
 {
     anim->frame = frame_index;
-    anim->sprite.src.x = frame_index * anim->sprite.src.w;
+
+    if (anim->frames)
+    {
+        // Frames may even live on different atlas pages
+        const ng_atlas_region_t *region = &anim->frames[frame_index];
+
+        anim->sprite.region = region;
+        anim->sprite.texture = region->texture;
+        anim->sprite.src = region->rect;
+    }
+    else
+        anim->sprite.src.x = frame_index * anim->sprite.src.w;
+}
+
+// Untinted quads keep the texture's own colors
+static SDL_Color no_tint = {255, 255, 255, 255};
+
+void ng_sprite_batch_create(ng_sprite_batch_t *batch)
+{
+    batch->quads = NULL;
+    batch->count = batch->capacity = 0;
+
+    batch->keys = NULL;
+    batch->sorted = batch->scratch = NULL;
+
+    batch->textures = NULL;
+    batch->texture_count = batch->texture_capacity = 0;
+
+    batch->vertices = NULL;
+    batch->indices = NULL;
+    batch->geometry_capacity = 0;
+
+    batch->has_viewport = false;
+    batch->culled = 0;
+    batch->draw_calls = 0;
+}
+
+void ng_sprite_batch_destroy(ng_sprite_batch_t *batch)
+{
+    free(batch->quads);
+    free(batch->keys);
+    free(batch->sorted);
+    free(batch->scratch);
+    free(batch->textures);
+    free(batch->vertices);
+    free(batch->indices);
+
+    ng_sprite_batch_create(batch);
+}
+
+void ng_sprite_batch_set_viewport(ng_sprite_batch_t *batch, const SDL_FRect *viewport)
+{
+    batch->has_viewport = viewport != NULL;
+
+    if (viewport)
+        batch->viewport = *viewport;
+}
+
+void ng_sprite_batch_add(ng_sprite_batch_t *batch, ng_sprite_t *sprite, int layer)
+{
+    ng_sprite_batch_add_transformed(batch, sprite, &sprite->transform, layer, SDL_FLIP_NONE);
+}
+
+void ng_sprite_batch_add_transformed(ng_sprite_batch_t *batch, ng_sprite_t *sprite,
+                                     const SDL_FRect *transform, int layer, SDL_RendererFlip flip)
+{
+    SDL_FRect target;
+    ng_sprite_get_draw_rect(sprite, transform, flip, &target);
+
+    ng_sprite_batch_add_ex(batch, sprite->texture, &sprite->src, &target, layer, flip, no_tint);
+}
+
+static bool is_outside_viewport(ng_sprite_batch_t *batch, const SDL_FRect *transform)
+{
+    const SDL_FRect *viewport = &batch->viewport;
+
+    return transform->x >= viewport->x + viewport->w || transform->x + transform->w <= viewport->x ||
+           transform->y >= viewport->y + viewport->h || transform->y + transform->h <= viewport->y;
+}
+
+// Index of the texture among the ones added since the last flush
+static uint32_t texture_index(ng_sprite_batch_t *batch, SDL_Texture *texture)
+{
+    // Sprites sharing a texture tend to come one after the other, so it's usually the last one
+    for (int i = batch->texture_count - 1; i >= 0; i--)
+        if (batch->textures[i] == texture)
+            return i;
+
+    if (batch->texture_count == batch->texture_capacity)
+    {
+        batch->texture_capacity = MAX(16, batch->texture_capacity * 2);
+        batch->textures = realloc(batch->textures, batch->texture_capacity * sizeof(SDL_Texture*));
+
+        if (!batch->textures)
+            ng_die("ran out of memory while growing the sprite batch");
+    }
+
+    if (batch->texture_count > UINT16_MAX)
+        ng_die("a sprite batch can't hold more than %d textures", UINT16_MAX + 1);
+
+    batch->textures[batch->texture_count] = texture;
+    return batch->texture_count++;
+}
+
+void ng_sprite_batch_add_ex(ng_sprite_batch_t *batch, SDL_Texture *texture,
+                            const SDL_Rect *src, const SDL_FRect *transform,
+                            int layer, SDL_RendererFlip flip, SDL_Color tint)
+{
+    if (batch->has_viewport && is_outside_viewport(batch, transform))
+    {
+        batch->culled++;
+        return;
+    }
+
+    if (batch->count == batch->capacity)
+    {
+        batch->capacity = MAX(64, batch->capacity * 2);
+        batch->quads = realloc(batch->quads, batch->capacity * sizeof(ng_batch_quad_t));
+        batch->keys = realloc(batch->keys, batch->capacity * sizeof(uint32_t));
+        batch->sorted = realloc(batch->sorted, batch->capacity * sizeof(uint32_t));
+        batch->scratch = realloc(batch->scratch, batch->capacity * sizeof(uint32_t));
+
+        if (!batch->quads || !batch->keys || !batch->sorted || !batch->scratch)
+            ng_die("ran out of memory while growing the sprite batch");
+    }
+
+    ng_batch_quad_t *quad = &batch->quads[batch->count];
+    quad->texture = texture;
+    quad->transform = *transform;
+    quad->flip = flip;
+    quad->tint = tint;
+    quad->layer = layer;
+
+    // Layers are offset so that negative ones sort first, the texture index only
+    // groups equal textures together, any consistent order would do
+    uint32_t sort_layer = (uint32_t)(CLAMP(layer, INT16_MIN, INT16_MAX) - INT16_MIN);
+    batch->keys[batch->count++] = sort_layer << 16 | texture_index(batch, texture);
+
+    if (src)
+        quad->src = *src;
+    else
+    {
+        quad->src.x = quad->src.y = 0;
+        SDL_QueryTexture(texture, NULL, NULL, &quad->src.w, &quad->src.h);
+    }
+}
+
+// Least significant digit first, 8 bits at a time. Every pass is stable, which is
+// what keeps quads of the same layer and texture in the order they were added
+static void sort_quads(ng_sprite_batch_t *batch)
+{
+    int counts[4][256] = {{0}};
+    uint32_t *keys = batch->keys;
+
+    // One read of the keys is enough for the histograms of all four digits
+    for (int i = 0; i < batch->count; i++)
+    {
+        uint32_t key = keys[i];
+
+        counts[0][key & 0xff]++;
+        counts[1][(key >> 8) & 0xff]++;
+        counts[2][(key >> 16) & 0xff]++;
+        counts[3][key >> 24]++;
+    }
+
+    for (int i = 0; i < batch->count; i++)
+        batch->sorted[i] = i;
+
+    for (int digit = 0; digit < 4; digit++)
+    {
+        int shift = digit * 8;
+
+        // All keys share this digit (e.g. the high byte of the layer), nothing would move
+        if (counts[digit][(keys[0] >> shift) & 0xff] == batch->count)
+            continue;
+
+        int offsets[256];
+        int total = 0;
+
+        for (int bucket = 0; bucket < 256; bucket++)
+        {
+            offsets[bucket] = total;
+            total += counts[digit][bucket];
+        }
+
+        for (int i = 0; i < batch->count; i++)
+        {
+            uint32_t quad = batch->sorted[i];
+            batch->scratch[offsets[(keys[quad] >> shift) & 0xff]++] = quad;
+        }
+
+        uint32_t *swap = batch->sorted;
+        batch->sorted = batch->scratch;
+        batch->scratch = swap;
+    }
+}
+
+static void reserve_geometry(ng_sprite_batch_t *batch, int quad_count)
+{
+    if (quad_count <= batch->geometry_capacity)
+        return;
+
+    int capacity = MAX(quad_count, batch->geometry_capacity * 2);
+    batch->vertices = realloc(batch->vertices, capacity * 4 * sizeof(SDL_Vertex));
+    batch->indices = realloc(batch->indices, capacity * 6 * sizeof(int));
+
+    if (!batch->vertices || !batch->indices)
+        ng_die("ran out of memory while growing the sprite batch");
+
+    // The index pattern never changes, so it's only built when growing
+    // Every quad is made of two triangles: 0 1 2 and 2 3 0
+    for (int i = batch->geometry_capacity; i < capacity; i++)
+    {
+        int *index = &batch->indices[i * 6];
+        int first = i * 4;
+
+        index[0] = first;
+        index[1] = first + 1;
+        index[2] = first + 2;
+        index[3] = first + 2;
+        index[4] = first + 3;
+        index[5] = first;
+    }
+
+    batch->geometry_capacity = capacity;
+}
+
+static void write_quad_vertices(SDL_Vertex *vertex, ng_batch_quad_t *quad, float texture_w, float texture_h)
+{
+    float left = quad->transform.x, right = quad->transform.x + quad->transform.w;
+    float top = quad->transform.y, bottom = quad->transform.y + quad->transform.h;
+
+    float u0 = quad->src.x / texture_w, u1 = (quad->src.x + quad->src.w) / texture_w;
+    float v0 = quad->src.y / texture_h, v1 = (quad->src.y + quad->src.h) / texture_h;
+
+    // Flipping is nothing more than swapping the texture coordinates
+    if (quad->flip & SDL_FLIP_HORIZONTAL)
+    {
+        float temp = u0; u0 = u1; u1 = temp;
+    }
+
+    if (quad->flip & SDL_FLIP_VERTICAL)
+    {
+        float temp = v0; v0 = v1; v1 = temp;
+    }
+
+    // Clockwise, starting from the top left corner
+    vertex[0] = (SDL_Vertex) {{left, top}, quad->tint, {u0, v0}};
+    vertex[1] = (SDL_Vertex) {{right, top}, quad->tint, {u1, v0}};
+    vertex[2] = (SDL_Vertex) {{right, bottom}, quad->tint, {u1, v1}};
+    vertex[3] = (SDL_Vertex) {{left, bottom}, quad->tint, {u0, v1}};
+}
+
+void ng_sprite_batch_flush(ng_sprite_batch_t *batch, SDL_Renderer *renderer)
+{
+    batch->draw_calls = 0;
+
+    if (batch->count == 0)
+    {
+        ng_sprite_batch_clear(batch);
+        return;
+    }
+
+    NG_PROFILE_BEGIN("batch flush");
+    sort_quads(batch);
+
+    // Layers split runs too, so consecutive runs can share a texture
+    SDL_Texture *bound = NULL;
+
+    int run_start = 0;
+    while (run_start < batch->count)
+    {
+        ng_batch_quad_t *first = &batch->quads[batch->sorted[run_start]];
+        uint32_t run_key = batch->keys[batch->sorted[run_start]];
+
+        // Find where this texture's run ends, the key covers both the texture and the layer
+        int run_end = run_start + 1;
+        while (run_end < batch->count && batch->keys[batch->sorted[run_end]] == run_key)
+            run_end++;
+
+        int run_length = run_end - run_start;
+        reserve_geometry(batch, run_length);
+
+        int texture_w, texture_h;
+        SDL_QueryTexture(first->texture, NULL, NULL, &texture_w, &texture_h);
+
+        for (int i = 0; i < run_length; i++)
+            write_quad_vertices(&batch->vertices[i * 4], &batch->quads[batch->sorted[run_start + i]],
+                                texture_w, texture_h);
+
+        SDL_RenderGeometry(renderer, first->texture, batch->vertices, run_length * 4,
+                           batch->indices, run_length * 6);
+        batch->draw_calls++;
+        NG_PROFILE_COUNT(NG_COUNTER_DRAW_CALLS, 1);
+
+        if (first->texture != bound)
+        {
+            NG_PROFILE_COUNT(NG_COUNTER_TEXTURE_BINDS, 1);
+            bound = first->texture;
+        }
+
+        run_start = run_end;
+    }
+
+    ng_sprite_batch_clear(batch);
+    NG_PROFILE_END();
+}
+
+void ng_sprite_batch_clear(ng_sprite_batch_t *batch)
+{
+    batch->count = 0;
+    batch->texture_count = 0;
+    batch->culled = 0;
 }
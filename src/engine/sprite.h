@@ -3,8 +3,11 @@
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_ttf.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include "custom_math.h"
 #include "timers.h"
+#include "atlas.h"
 
 // Sprites are 2D entities that can be rendered using a simple texture
 typedef struct
@@ -15,12 +18,23 @@ typedef struct
 
     // Position and target screen size
     SDL_FRect transform;
+
+    // Set when the sprite comes from a texture atlas (NULL otherwise)
+    // The transform always covers the untrimmed frame, so sizes and collisions
+    // behave exactly as if the frame was never trimmed
+    const ng_atlas_region_t *region;
 } ng_sprite_t;
 
 void ng_sprite_create(ng_sprite_t *sprite, SDL_Texture *texture);
+void ng_sprite_create_from_region(ng_sprite_t *sprite, const ng_atlas_region_t *region);
 void ng_sprite_render(ng_sprite_t *sprite, SDL_Renderer *renderer);
 void ng_sprite_set_scale(ng_sprite_t *sprite, float scale);
 
+// Where the sprite's pixels actually land on screen for a given transform
+// Only differs from the transform for trimmed atlas frames
+void ng_sprite_get_draw_rect(ng_sprite_t *sprite, const SDL_FRect *transform,
+                             SDL_RendererFlip flip, SDL_FRect *result);
+
 typedef struct
 {
     // NOTE: Inheritance in C!
@@ -30,12 +44,94 @@ typedef struct
 
     int frame;
     int total_frames;
+
+    // Atlas frames, NULL when the texture is a horizontal strip of equal-width frames
+    const ng_atlas_region_t *frames;
 } ng_animated_sprite_t;
 
 // Some sprites will have a texture consisting of multiple frames inside a larger texture atlas
 void ng_animated_create(ng_animated_sprite_t *anim, SDL_Texture *texture,
                         unsigned int total_frames);
+// Same thing, but every frame points at its own region (see ng_atlas_get_frames)
+void ng_animated_create_from_atlas(ng_animated_sprite_t *anim, const ng_atlas_region_t *frames,
+                                   unsigned int total_frames);
 
 void ng_animated_set_frame(ng_animated_sprite_t *anim, int frame_index);
 
+// A single textured rectangle waiting inside a batch
+typedef struct
+{
+    SDL_Texture *texture;
+    SDL_Rect src;
+    SDL_FRect transform;
+
+    SDL_RendererFlip flip;
+    SDL_Color tint;
+    int layer;
+} ng_batch_quad_t;
+
+/*
+ * Collects quads during a frame and submits them all at once. Quads are sorted by
+ * layer, then by texture, and every run of the same texture becomes a single
+ * SDL_RenderGeometry() call instead of one SDL_RenderCopy() per sprite
+ *
+ * Every quad gets a sort key made of its layer and the texture's index among the
+ * ones seen this frame, and a radix sort orders the keys in a couple of linear
+ * passes. The quads themselves never move, only their indices do
+ *
+ * With a viewport set, quads that land entirely outside of it are culled right
+ * away, they take no memory and never reach the renderer
+ *
+ * NOTE: Lower layers are drawn first. Inside the same layer only quads sharing a
+ * texture keep their relative order, so put things that must overlap correctly
+ * on different layers. Layers have to fit in 16 bits (-32768 to 32767)
+ */
+typedef struct
+{
+    ng_batch_quad_t *quads;
+    int count, capacity;
+
+    // Sort key of every quad, and the order they get drawn in (the indices of the quads)
+    uint32_t *keys;
+    uint32_t *sorted, *scratch;
+
+    // Every texture added since the last flush, its index is part of the sort key
+    SDL_Texture **textures;
+    int texture_count, texture_capacity;
+
+    // Geometry of a single texture run, reused between flushes
+    SDL_Vertex *vertices;
+    int *indices;
+    int geometry_capacity;
+
+    bool has_viewport;
+    SDL_FRect viewport;
+
+    // Quads culled since the last flush
+    int culled;
+
+    // How many draw calls the last flush needed
+    int draw_calls;
+} ng_sprite_batch_t;
+
+void ng_sprite_batch_create(ng_sprite_batch_t *batch);
+void ng_sprite_batch_destroy(ng_sprite_batch_t *batch);
+
+// Quads outside of the viewport (usually the screen) get culled, NULL turns culling off
+void ng_sprite_batch_set_viewport(ng_sprite_batch_t *batch, const SDL_FRect *viewport);
+
+void ng_sprite_batch_add(ng_sprite_batch_t *batch, ng_sprite_t *sprite, int layer);
+// Draws the sprite somewhere else than its own transform (e.g. interpolated), optionally flipped
+void ng_sprite_batch_add_transformed(ng_sprite_batch_t *batch, ng_sprite_t *sprite,
+                                     const SDL_FRect *transform, int layer, SDL_RendererFlip flip);
+// NOTE: src can be NULL to use the whole texture
+void ng_sprite_batch_add_ex(ng_sprite_batch_t *batch, SDL_Texture *texture,
+                            const SDL_Rect *src, const SDL_FRect *transform,
+                            int layer, SDL_RendererFlip flip, SDL_Color tint);
+
+// Draws everything that was added since the last flush, then empties the batch
+void ng_sprite_batch_flush(ng_sprite_batch_t *batch, SDL_Renderer *renderer);
+// Empties the batch without drawing anything
+void ng_sprite_batch_clear(ng_sprite_batch_t *batch);
+
 #endif
@@ -1,25 +1,37 @@
 #include "timers.h"
 #include <SDL2/SDL.h>
 
+static ng_clock_t current_clock = SDL_GetTicks;
+
+void ng_timers_set_clock(ng_clock_t clock)
+{
+    current_clock = clock ? clock : SDL_GetTicks;
+}
+
+uint32_t ng_timers_get_time(void)
+{
+    return current_clock();
+}
+
 void ng_timer_start(ng_timer_t *timer)
 {
-    // Remember: SDL_GetTicks() returns milliseconds since SDL initialization
-    timer->starting_time = SDL_GetTicks();
+    // Remember: the clock returns milliseconds, by default since SDL initialization
+    timer->starting_time = current_clock();
     timer->is_active = true;
 }
 
 uint32_t ng_timer_get_elapsed(ng_timer_t *timer)
 {
-    return SDL_GetTicks() - timer->starting_time;
+    return current_clock() - timer->starting_time;
 }
 
 uint32_t ng_timer_restart(ng_timer_t *timer)
 {
-    uint32_t now = SDL_GetTicks();
+    uint32_t now = current_clock();
     uint32_t elapsed = now - timer->starting_time;
 
     // Restart the timer by making it count time since now
-    timer->starting_time = SDL_GetTicks();
+    timer->starting_time = current_clock();
 
     return elapsed;
 }
@@ -27,7 +39,7 @@ uint32_t ng_timer_restart(ng_timer_t *timer)
 void ng_interval_create(ng_interval_t *interval, uint32_t duration)
 {
     interval->duration = duration;
-    interval->starting_time = SDL_GetTicks();
+    interval->starting_time = current_clock();
 }
 
 // Returns true whenever the interval has completed,
@@ -35,10 +47,10 @@ void ng_interval_create(ng_interval_t *interval, uint32_t duration)
 // It's like a timer, but it repeats
 bool ng_interval_is_ready(ng_interval_t *interval)
 {
-    if (SDL_GetTicks() - interval->starting_time > interval->duration)
+    if (current_clock() - interval->starting_time > interval->duration)
     {
         // If the interval has been reached, restart the timer and return true
-        interval->starting_time = SDL_GetTicks();
+        interval->starting_time = current_clock();
 
         return true;
     }
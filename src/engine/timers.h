@@ -10,6 +10,15 @@
  * do not require delta time as input. You might want to change that depending
  * on your use case
  */
+// Anything that returns the current time in milliseconds
+typedef uint32_t (*ng_clock_t) (void);
+
+// Timers read SDL_GetTicks() by default. Replays and headless games swap in the
+// simulated game time so that sessions stay deterministic, NULL restores the default
+void ng_timers_set_clock(ng_clock_t clock);
+// The time of the clock timers read, for anything else that has to follow it
+uint32_t ng_timers_get_time(void);
+
 typedef struct
 {
     bool is_active;
@@ -1,27 +1,64 @@
 #include <SDL2/SDL_image.h>
+#include <stdio.h>
+#include <string.h>
 #include "engine/game.h"
 #include "engine/common.h"
 #include "engine/sprite.h"
 #include "engine/interface.h"
 #include "engine/timers.h"
 #include "engine/audio.h"
+#include "engine/replay.h"
+#include "engine/pack.h"
+#include "engine/assets.h"
+#include "engine/entities.h"
+#include "engine/collision.h"
+#include "engine/animation.h"
+#include "engine/profiler.h"
+#include "engine/layers.h"
+#include "engine/scene.h"
 
 #define WIDTH 640
 #define HEIGHT 480
 #define FLOOR HEIGHT - 59.0
 #define SPEED 480
 #define MAX_SNOWMEN 5
+#define FALL_SPEED 100
+
+//--stress starts with this many hazards and adds STRESS_GROWTH more every step,
+//until frames take longer than the 30 fps budget (or there are STRESS_MAX_OBJECTS)
+#define STRESS_START_OBJECTS 64
+#define STRESS_GROWTH 0.1f
+#define STRESS_STEP_SECONDS 0.5f
+#define STRESS_MAX_OBJECTS (1 << 20)
+//every STRESS_GHOST_RATIO-th hazard is a ghost, the rest are snowmen
+#define STRESS_GHOST_RATIO 8
 
 static SDL_Color white = {255, 255, 255, 255};
 static SDL_Color red = {255, 0, 0, 255};
 static SDL_Color green = {50, 200, 10, 255};
 
+//draw order of the sprite batch, lower layers are drawn first
+typedef enum {
+    LAYER_BACKGROUND,
+    LAYER_CAT,
+    LAYER_ENEMIES,
+    LAYER_HUD
+} Layer;
+
+//what every entity of the hazard store is
 typedef enum {
-    SCENE_START,
-    SCENE_PLAYING,
-    SCENE_GAME_OVER,
-    SCENE_DEATH
-} Scene;
+    KIND_SNOWMAN,
+    KIND_GHOST,
+    KIND_MOUSE
+} Kind;
+
+//collision layers, every collider is one of them and can be interested in several
+typedef enum {
+    HIT_PLAYER = 1 << 0,
+    HIT_PLAYER_ATTACK = 1 << 1,
+    HIT_HAZARD = 1 << 2,
+    HIT_ENEMY = 1 << 3
+} HitLayer;
 
 typedef enum {
     DIRECTION_RIGHT,
@@ -30,70 +67,204 @@ typedef enum {
 
 Direction cat_direction = DIRECTION_RIGHT;
 
+//how every animation plays, frame counts match the sprite sheets
+static const ng_animation_clip_t run_clip = {7, NG_ANIMATION_LOOP, 0.06f, NULL};
+static const ng_animation_clip_t jump_clip = {13, NG_ANIMATION_LOOP, 0.06f, NULL};
+static const ng_animation_clip_t idle_clip = {7, NG_ANIMATION_LOOP, 0.06f, NULL};
+static const ng_animation_clip_t attack_clip = {9, NG_ANIMATION_ONCE, 0.06f, NULL};
+static const ng_animation_clip_t sleep_clip = {3, NG_ANIMATION_LOOP, 0.3f, NULL};
+static const ng_animation_clip_t ghost_clip = {2, NG_ANIMATION_LOOP, 0.15f, NULL};
+
+//what every scene needs loaded, the enums are the indices of the assets inside scene.assets
+enum { START_FONT };
+static const ng_scene_asset_t start_assets[] = {
+    {NG_ASSET_FONT, "assets/free_mono.ttf", 20}
+};
+
+enum { PLAYING_BACKGROUND, PLAYING_RUN_SFX, PLAYING_HURT_SFX, PLAYING_ATTACK_SFX };
+static const ng_scene_asset_t playing_assets[] = {
+    {NG_ASSET_TEXTURE, "assets/bg.png", 0},
+    {NG_ASSET_CHUNK, "assets/audio/run.wav", 0},
+    {NG_ASSET_CHUNK, "assets/audio/hurt.wav", 0},
+    {NG_ASSET_CHUNK, "assets/audio/attack.wav", 0}
+};
+
+//the purr is long and only heard on this screen, no need to keep it uncompressed
+//the sleeping cat isn't in the atlas, nothing else needs it
+enum { GAME_OVER_BACKGROUND, GAME_OVER_SLEEP, GAME_OVER_PURR_SFX, GAME_OVER_FONT };
+static const ng_scene_asset_t game_over_assets[] = {
+    {NG_ASSET_TEXTURE, "assets/win_bg.png", 0},
+    {NG_ASSET_TEXTURE, "assets/cat/sleep.png", 0},
+    {NG_ASSET_CHUNK, "assets/audio/purr.wav", NG_AUDIO_STORE_COMPRESSED},
+    {NG_ASSET_FONT, "assets/free_mono.ttf", 32}
+};
+
+//same font as the game over screen, it stays loaded when the preloaded scene changes between them
+enum { DEATH_FONT };
+static const ng_scene_asset_t death_assets[] = {
+    {NG_ASSET_FONT, "assets/free_mono.ttf", 32}
+};
+
+//only needs the background, the sprites all come from the atlas
+enum { STRESS_BACKGROUND, STRESS_FONT };
+static const ng_scene_asset_t stress_assets[] = {
+    {NG_ASSET_TEXTURE, "assets/bg.png", 0},
+    {NG_ASSET_FONT, "assets/free_mono.ttf", 20}
+};
+
+//defined further down, along with their hooks
+static ng_scene_t start_scene, playing_scene, game_over_scene, death_scene, stress_scene;
+
 
 static struct
 {
     ng_game_t game;
-    ng_interval_t game_tick, ghost_tick, mouse_tick, snowman_tick, sleep_tick;
+    ng_replay_t replay;
 
-    // A collection of assets used by entities
-    // Ideally, they should have been automatically loaded
-    // by iterating over the res/ folder and filling in a hastable
-    SDL_Texture *run_texture, *jump_texture, *idle_texture, *attack_texture, *sleep_texture, *ghost_texture, *mouse_texture, *snowman_texture, *heart_texture, *background_texture, *win_bg_texture;
+    //every screen of the game is a scene, each one with the assets it needs (see the manifests below)
+    //only the current scene and the one coming next keep theirs loaded
+    ng_scene_stack_t scenes;
 
-    ng_animated_sprite_t run, jump, idle, attack, sleep, ghost, mouse, snowman[MAX_SNOWMEN];
+    //every sprite sheet is packed in here, so most sprites share a single texture
+    ng_atlas_t atlas;
+
+    ng_animated_sprite_t run, jump, idle, attack, sleep;
+    ng_animation_t run_animation, jump_animation, idle_animation, attack_animation, sleep_animation;
+
+    //everything that falls or walks towards the cat lives in here,
+    //the sprites are only templates that the entities are drawn with
+    ng_entity_store_t hazards;
+    ng_animated_sprite_t ghost_sprite, mouse_sprite, snowman_sprite;
+
+    //collider types of the cat and of every hazard kind
+    ng_collision_world_t collisions;
+    int cat_body_type, cat_attack_type;
+    int hazard_types[3];
 
     ng_sprite_t heart[4];
 
-    Mix_Music *SB_bm;
-    Mix_Chunk *run_sfx, *hurt_sfx, *attack_sfx, *purr_sfx;
+    //the background and the hearts barely ever change, so they're kept in textures of their own
+    //and only drawn again when what they show changes
+    ng_cached_layer_t backdrop, hud;
+    SDL_Texture *backdrop_texture;
+    int hud_health;
 
-    TTF_Font *main_font, *death_font, *win_font;
-    ng_label_t start_text, death_text, win_text, win2_text;
+    //the music keeps playing through every scene
+    ng_asset_t *SB_bm;
 
-    Scene current_scene;
+    ng_label_t start_text, death_text, win_text, win2_text, loading_text;
+
+    //false until the atlas has been built, along with everything drawn from it
+    bool is_loaded;
 
     bool is_jumping;
     bool is_running;
     bool is_attacking;
     bool run_sfx_playing;
-    int run_sfx_channel;
-    bool mau;
+    ng_voice_t run_sfx_voice;
 
     float jump_velocity;  
     float gravity;        
 
+    //cat position at the start of the last tick, used for render interpolation
+    ng_vec2 cat_previous;
+
     int ghost_count;
     int active_snowmen;
     int health;
 
+    //skip the menus and restart by itself, used by headless runs
+    bool autoplay;
+
+    //--stress: keeps adding hazards until the frame time crosses both budgets
+    ng_label_t stress_text;
+    float stress_step_time;
+    //frame times seen during the current step, and how many hazards the last frame had
+    double stress_frame_ms;
+    int stress_frames;
+    int stress_rendered_count;
+    //hazard counts at which the average frame crossed 16.6 and 33 ms (0 = not yet)
+    int stress_count_60, stress_count_30;
+
 } ctx;
 
 
-bool check_collision(ng_animated_sprite_t *a, ng_animated_sprite_t *b) {
+void create_collider_types() {
+    ng_collision_create(&ctx.collisions, 64.0f);
+
+    //the top of the cat's frames is empty, so it only gets hit below that
+    ctx.cat_body_type = ng_collision_register_type(&ctx.collisions, HIT_PLAYER, HIT_HAZARD, 0, 30, 0, 0);
+    ctx.cat_attack_type = ng_collision_register_type(&ctx.collisions, HIT_PLAYER_ATTACK, HIT_ENEMY, 0, 30, 0, 0);
+
+    ctx.hazard_types[KIND_SNOWMAN] = ng_collision_register_type(&ctx.collisions, HIT_HAZARD, 0, 0, 0, 0, 0);
+    ctx.hazard_types[KIND_GHOST] = ng_collision_register_type(&ctx.collisions, HIT_ENEMY, 0, 0, 0, 0, 0);
+    ctx.hazard_types[KIND_MOUSE] = ng_collision_register_type(&ctx.collisions, HIT_ENEMY, 0, 0, 0, 0, 0);
+}
+
+//puts a snowman or the ghost back at the top of the screen
+void respawn_at_top(int index) {
+    ctx.hazards.x[index] = ng_random_int_in_range(0, WIDTH - 64);  //random horizontal position
+    ctx.hazards.y[index] = -64;
+    ctx.hazards.vy[index] = FALL_SPEED;
+}
+
+//a new snowman or ghost somewhere along the top of the screen, returns its index
+int spawn_at_top(Kind kind) {
+    ng_animated_sprite_t *sprite = (kind == KIND_GHOST) ? &ctx.ghost_sprite : &ctx.snowman_sprite;
+    int index = ng_entities_index(&ctx.hazards,
+            ng_entities_add(&ctx.hazards, sprite, kind, LAYER_ENEMIES, 0, -64));
+    respawn_at_top(index);
+
+    if (kind == KIND_GHOST) {
+        ng_animation_start(&ctx.hazards.animation[index], &ghost_clip, NULL);
+    }
+    return index;
+}
+
+void spawn_hazards() {
+    ng_entities_clear(&ctx.hazards);
 
-    SDL_FRect rect_a = {
-        .x = a->sprite.transform.x,
-        .y = a->sprite.transform.y,
-        .w = a->sprite.transform.w,
-        .h = a->sprite.transform.h,
-    };
+    spawn_at_top(KIND_GHOST);
 
-    SDL_FRect rect_b = {
-        .x = b->sprite.transform.x,
-        .y = b->sprite.transform.y + 30,
-        .w = b->sprite.transform.w,
-        .h = b->sprite.transform.h - 30,
-    };
+    ng_entity_t mouse = ng_entities_add(&ctx.hazards, &ctx.mouse_sprite, KIND_MOUSE, LAYER_ENEMIES, -64.0f, FLOOR);
+    ctx.hazards.vx[ng_entities_index(&ctx.hazards, mouse)] = 50;
 
-    return SDL_HasIntersectionF(&rect_a, &rect_b);
+    //snowmen show up over time
+    ctx.active_snowmen = 0;
 }
 
-void render_cat(ng_sprite_t *sprite, SDL_Renderer *renderer, Direction direction) {
+void render_cat(ng_sprite_t *sprite, ng_sprite_batch_t *batch, Direction direction, float alpha) {
     SDL_RendererFlip flip = (direction == DIRECTION_LEFT) ? SDL_FLIP_HORIZONTAL : SDL_FLIP_NONE;
 
-    SDL_RenderCopyExF(renderer, sprite->texture, &sprite->src, &sprite->transform, 0, NULL, flip);
+    //the cat is the fastest thing on screen, draw it between the last two ticks so it doesn't stutter
+    SDL_FRect transform = sprite->transform;
+    transform.x = ng_lerp(ctx.cat_previous.x, transform.x, alpha);
+    if (sprite == &ctx.jump.sprite) {
+        transform.y = ng_lerp(ctx.cat_previous.y, transform.y, alpha);
+    }
+
+    ng_sprite_batch_add_transformed(batch, sprite, &transform, LAYER_CAT, flip);
+
+}
+
+//attacking wins over jumping, which wins over running, idle when doing no actions
+ng_animation_t *current_cat_animation() {
+    if (ctx.is_attacking) {
+        return &ctx.attack_animation;
+    }else if (ctx.is_jumping) {
+        return &ctx.jump_animation;
+    }else if (ctx.is_running) {
+        return &ctx.run_animation;
+    }
+    return &ctx.idle_animation;
+}
 
+//scheduler callback, it keeps running in every scene so it checks it first
+void add_snowman(void *data) {
+    if (ng_scenes_get_active(&ctx.scenes) == &playing_scene && ctx.active_snowmen < MAX_SNOWMEN) {
+        spawn_at_top(KIND_SNOWMAN);
+        ctx.active_snowmen++;
+    }
 }
 
 void reset_game_state() {
@@ -103,10 +274,10 @@ void reset_game_state() {
     ctx.is_jumping = false;
     ctx.is_running = false;
 
-    ng_animated_set_frame(&ctx.idle, 0);
-    ng_animated_set_frame(&ctx.run, 0);
-    ng_animated_set_frame(&ctx.jump, 0);
-    ng_animated_set_frame(&ctx.attack, 0);
+    ng_animation_restart(&ctx.idle_animation);
+    ng_animation_restart(&ctx.run_animation);
+    ng_animation_restart(&ctx.jump_animation);
+    ng_animation_restart(&ctx.attack_animation);
 
     ctx.jump.sprite.transform.x = 100.0f;
     ctx.jump.sprite.transform.y = FLOOR;
@@ -116,180 +287,152 @@ void reset_game_state() {
     ctx.attack.sprite.transform.y = FLOOR;
     ctx.idle.sprite.transform.x = 100.0f;
     ctx.idle.sprite.transform.y = FLOOR;
+    ctx.cat_previous.x = 100.0f;
+    ctx.cat_previous.y = FLOOR;
 
-    ctx.ghost.sprite.transform.x = ng_random_int_in_range(0, WIDTH - 64);
-    ctx.ghost.sprite.transform.y = -64;
-
-    ctx.active_snowmen = 0;
-    for (int i = 0; i < MAX_SNOWMEN; i++) {
-        ctx.snowman[i].sprite.transform.x = ng_random_int_in_range(0, WIDTH - 64);
-        ctx.snowman[i].sprite.transform.y = -64;
-    }
-
-    ctx.mau = true;
-    ctx.mouse.sprite.transform.x = -64;
+    spawn_hazards();
 
-    #ifndef NO_AUDIO
-
-        Mix_VolumeMusic(16);  //background music at lower volume
-
-    #endif
-
-    ctx.current_scene = SCENE_START;
+    ng_music_set_volume(16);  //background music at lower volume
 }
 
 
 
 static void create_actors(void)
 {
-    ng_game_create(&ctx.game, "Cat", WIDTH, HEIGHT); //creates window
+    //everything comes from assets.pack when it exists (make pack), otherwise from the loose files
+    ng_pack_mount("assets.pack");
 
-    ctx.main_font = TTF_OpenFont("assets/free_mono.ttf", 20);
-    ctx.death_font = TTF_OpenFont("assets/free_mono.ttf", 32);
-    ctx.win_font = TTF_OpenFont("assets/free_mono.ttf", 32);
+    ng_assets_init(ctx.game.renderer);
 
- 
     //load textures
-    ctx.run_texture = IMG_LoadTexture(ctx.game.renderer, "assets/cat/run.png");
-    ctx.jump_texture = IMG_LoadTexture(ctx.game.renderer, "assets/cat/jump.png");
-    ctx.idle_texture = IMG_LoadTexture(ctx.game.renderer, "assets/cat/idle.png");
-    ctx.attack_texture = IMG_LoadTexture(ctx.game.renderer, "assets/cat/attack.png");
-    ctx.sleep_texture = IMG_LoadTexture(ctx.game.renderer, "assets/cat/sleep.png");
-    ctx.ghost_texture = IMG_LoadTexture(ctx.game.renderer, "assets/characters/ghost.png");
-    ctx.mouse_texture = IMG_LoadTexture(ctx.game.renderer, "assets/characters/mouse.png");
-    ctx.snowman_texture = IMG_LoadTexture(ctx.game.renderer, "assets/characters/snowman.png");
-    ctx.heart_texture = IMG_LoadTexture(ctx.game.renderer, "assets/heart.png");
-    ctx.background_texture = IMG_LoadTexture(ctx.game.renderer, "assets/bg.png");
-    ctx.win_bg_texture = IMG_LoadTexture(ctx.game.renderer, "assets/win_bg.png");
+    //the sprite sheets of the gameplay, they keep decoding on the loader's threads while the start screen shows
+    ng_atlas_create(&ctx.atlas, 512);
+    ng_atlas_add_strip(&ctx.atlas, "assets/cat/run.png", 7);
+    ng_atlas_add_strip(&ctx.atlas, "assets/cat/jump.png", 13);
+    ng_atlas_add_strip(&ctx.atlas, "assets/cat/idle.png", 7);
+    ng_atlas_add_strip(&ctx.atlas, "assets/cat/attack.png", 9);
+    ng_atlas_add_strip(&ctx.atlas, "assets/characters/ghost.png", 2);
+    ng_atlas_add_strip(&ctx.atlas, "assets/characters/mouse.png", 4);
+    ng_atlas_add_strip(&ctx.atlas, "assets/characters/snowman.png", 5);
+    ng_atlas_add_strip(&ctx.atlas, "assets/heart.png", 1);
 
+    //load audio
+    ctx.SB_bm = ng_assets_acquire(NG_ASSET_MUSIC, "assets/audio/OST 1 - Silver Bells (Loopable).ogg", 0);
 
     //timers
-    ng_interval_create(&ctx.game_tick, 60);
-    ng_interval_create(&ctx.ghost_tick, 150);
-    ng_interval_create(&ctx.snowman_tick, 2000);
-    ng_interval_create(&ctx.sleep_tick, 300);
+    //runs on game time, so it follows replays and the tick rate
+    ng_scheduler_every(&ctx.game.scheduler, 2000, add_snowman, NULL);
+
+    ng_music_set_volume(16);  //background music at lower volume
+
+    ctx.is_jumping = false; 
+    ctx.is_running = false; 
+    ctx.is_attacking = false;
+    ctx.run_sfx_playing = false;
+    ctx.run_sfx_voice = NG_VOICE_NONE;
+
+    ctx.gravity = 1451.25f;      //pixels per second squared
+    ctx.jump_velocity = 0.0f;  //initially not moving
+    ctx.cat_previous.x = 100.0f;
+    ctx.cat_previous.y = FLOOR;
+
+    ctx.ghost_count = 0;
+    ctx.health = 3;
+
+    //start background music once looping it indefinitely
+    ng_music_play(ng_asset_music(ctx.SB_bm));
+
+    //everything else comes with the scenes
+    ng_scenes_create(&ctx.scenes, &ctx.game);
+}
+
+//runs once the atlas started by create_actors has been decoded,
+//or right away (blocking) if the player doesn't want to wait
+//it uploads textures, so it runs on the render thread (the simulation waits meanwhile)
+static void finish_loading(void *data)
+{
+    ng_atlas_build(&ctx.atlas, ctx.game.renderer);
     
     //create animations
-    ng_animated_create(&ctx.run, ctx.run_texture, 7);  //run
+    ng_animated_create_from_atlas(&ctx.run, ng_atlas_get_frames(&ctx.atlas, "assets/cat/run.png"), 7);  //run
     ng_sprite_set_scale(&ctx.run.sprite, 2.0f);
     ctx.run.sprite.transform.x = 100.0f;
     ctx.run.sprite.transform.y = FLOOR;
     
-    ng_animated_create(&ctx.jump, ctx.jump_texture, 13);  //jump
+    ng_animated_create_from_atlas(&ctx.jump, ng_atlas_get_frames(&ctx.atlas, "assets/cat/jump.png"), 13);  //jump
     ng_sprite_set_scale(&ctx.jump.sprite, 2.0f);
     ctx.jump.sprite.transform.x = 100.0f;
     ctx.jump.sprite.transform.y = FLOOR;
     
-    ng_animated_create(&ctx.idle, ctx.idle_texture, 7);  //idle
+    ng_animated_create_from_atlas(&ctx.idle, ng_atlas_get_frames(&ctx.atlas, "assets/cat/idle.png"), 7);  //idle
     ng_sprite_set_scale(&ctx.idle.sprite, 2.0f);
     ctx.idle.sprite.transform.x = 100.0f;
     ctx.idle.sprite.transform.y = FLOOR;
 
-    ng_animated_create(&ctx.attack, ctx.attack_texture, 9);  //attack
+    ng_animated_create_from_atlas(&ctx.attack, ng_atlas_get_frames(&ctx.atlas, "assets/cat/attack.png"), 9);  //attack
     ng_sprite_set_scale(&ctx.attack.sprite, 2.0f);
     ctx.attack.sprite.transform.x = 100.0f;
     ctx.attack.sprite.transform.y = FLOOR;
     
-    ng_animated_create(&ctx.sleep, ctx.sleep_texture, 3);  //sleep
-    ng_sprite_set_scale(&ctx.sleep.sprite, 4.0f);
-    ctx.sleep.sprite.transform.x = (WIDTH - ctx.sleep.sprite.transform.w) / 2.0f;
-    ctx.sleep.sprite.transform.y = HEIGHT - 150 ;
+    ng_animation_start(&ctx.run_animation, &run_clip, &ctx.run);
+    ng_animation_start(&ctx.jump_animation, &jump_clip, &ctx.jump);
+    ng_animation_start(&ctx.idle_animation, &idle_clip, &ctx.idle);
+    ng_animation_start(&ctx.attack_animation, &attack_clip, &ctx.attack);
 
-    ng_animated_create(&ctx.ghost, ctx.ghost_texture, 2);  //ghost
-    ng_sprite_set_scale(&ctx.ghost.sprite, 4.0f);
-    ctx.ghost.sprite.transform.x = ng_random_int_in_range(0, WIDTH - 64);
-    ctx.ghost.sprite.transform.y = -64;
+    ng_animated_create_from_atlas(&ctx.ghost_sprite, ng_atlas_get_frames(&ctx.atlas, "assets/characters/ghost.png"), 2);  //ghost
+    ng_sprite_set_scale(&ctx.ghost_sprite.sprite, 4.0f);
 
-    ng_animated_create(&ctx.mouse, ctx.mouse_texture, 4);  //mouse
-    ng_sprite_set_scale(&ctx.mouse.sprite, 2.0f);    
-    ctx.mouse.sprite.transform.x = -64.0f;
-    ctx.mouse.sprite.transform.y = FLOOR;
+    ng_animated_create_from_atlas(&ctx.mouse_sprite, ng_atlas_get_frames(&ctx.atlas, "assets/characters/mouse.png"), 4);  //mouse
+    ng_sprite_set_scale(&ctx.mouse_sprite.sprite, 2.0f);    
 
-    for (int i = 0; i < MAX_SNOWMEN; i++) {
-        ng_animated_create(&ctx.snowman[i], ctx.snowman_texture, 5);  //snowman
-        ng_sprite_set_scale(&ctx.snowman[i].sprite, 5.0f);
-        ctx.snowman[i].sprite.transform.x = ng_random_int_in_range(0, WIDTH - 64);
-        ctx.snowman[i].sprite.transform.y = -64;
-    }
+    ng_animated_create_from_atlas(&ctx.snowman_sprite, ng_atlas_get_frames(&ctx.atlas, "assets/characters/snowman.png"), 5);  //snowman
+    ng_sprite_set_scale(&ctx.snowman_sprite.sprite, 5.0f);
+
+    ng_entities_create(&ctx.hazards, MAX_SNOWMEN + 2);
+    create_collider_types();
+    spawn_hazards();
 
     for (int i = 0; i < 4; i++) {
-        ng_sprite_create(&ctx.heart[i], ctx.heart_texture);
+        ng_sprite_create_from_region(&ctx.heart[i], ng_atlas_get_frames(&ctx.atlas, "assets/heart.png"));
         ng_sprite_set_scale(&ctx.heart[i], 1.0f);
         ctx.heart[i].transform.x = i * 40;
     }
-    
-    //load audio
-    ctx.SB_bm = ng_music_load("assets/audio/OST 1 - Silver Bells (Loopable).ogg");
-    ctx.run_sfx = ng_audio_load("assets/audio/run.wav");
-    ctx.hurt_sfx = ng_audio_load("assets/audio/hurt.wav");
-    ctx.attack_sfx = ng_audio_load("assets/audio/attack.wav");
-    ctx.purr_sfx = ng_audio_load("assets/audio/purr.wav");
-
-
-    //load text
-    ng_label_create(&ctx.start_text, ctx.main_font, 500);
-    ng_label_set_content(&ctx.start_text, ctx.game.renderer,
-            "Help the little cat save Christmas\n"
-            "Dodge the falling snowmen \n"
-            "Attack the ghosts with \"space\" \n"
-            "Defeat 15 ghosts to win \n"
-            "press \"Enter\" to start or play again ",
-            white);
-    ctx.start_text.sprite.transform.x = (WIDTH - 450) / 2.0f;
-    ctx.start_text.sprite.transform.y = (HEIGHT - 150) / 2.0f;
-
-    ng_label_create(&ctx.death_text, ctx.death_font, 175);
-    ng_label_set_content(&ctx.death_text, ctx.game.renderer,
-            "Game Over",
-            red);
-    ctx.death_text.sprite.transform.x = (WIDTH - 175) / 2.0f;
-    ctx.death_text.sprite.transform.y = (HEIGHT - 125) / 2.0f;
-
-    ng_label_create(&ctx.win_text, ctx.win_font, 285);
-    ng_label_set_content(&ctx.win_text, ctx.game.renderer,
-            "Congratulations\n",
-            green);
-    ctx.win_text.sprite.transform.x = (WIDTH - 285) / 2.0f;
-    ctx.win_text.sprite.transform.y = (HEIGHT - 450) / 2.0f;
-    ng_label_create(&ctx.win2_text, ctx.win_font, 323);
-    ng_label_set_content(&ctx.win2_text, ctx.game.renderer,
-            "You saved Catmas\n",
-            green);
-    ctx.win2_text.sprite.transform.x = (WIDTH - 300) / 2.0f;
-    ctx.win2_text.sprite.transform.y = (HEIGHT - 350) / 2.0f;
-
-#ifndef NO_AUDIO
-
-    Mix_VolumeMusic(16);  //background music at lower volume
-    Mix_VolumeChunk(ctx.run_sfx, 128);  //running sound at full volume
-    Mix_VolumeChunk(ctx.hurt_sfx, 128);
-    Mix_VolumeChunk(ctx.attack_sfx, 128);
-    Mix_VolumeChunk(ctx.purr_sfx, 128);
 
-#endif
-
-    ctx.is_jumping = false; 
-    ctx.is_running = false; 
-    ctx.is_attacking = false;
-    ctx.run_sfx_playing = false;
-    ctx.mau = true;
-    ctx.run_sfx_channel = -1;
+    //nothing shows through the background, so its layer gets copied without any blending
+    SDL_Rect screen = {0, 0, WIDTH, HEIGHT};
+    ng_cached_layer_create(&ctx.backdrop, &ctx.game, &screen, LAYER_BACKGROUND, true);
+    ctx.backdrop_texture = NULL;
 
-    ctx.gravity = 1451.25f;      //pixels per second squared
-    ctx.jump_velocity = 0.0f;  //initially not moving
-
-    ctx.ghost_count = 0;
-    ctx.health = 3;
+    SDL_Rect hearts = {0, 0, 3 * 40 + (int)ctx.heart[3].transform.w, (int)ctx.heart[0].transform.h};
+    ng_cached_layer_create(&ctx.hud, &ctx.game, &hearts, LAYER_HUD, false);
+    ctx.hud_health = -1;
 
-    //start background music once looping it indefinitely
-    ng_music_play(ctx.SB_bm);
+    ctx.is_loaded = true;
 }
 
 static void handle_event(SDL_Event *event)
 {
+    //the rest of the keys only mean something during the gameplay, whose sounds may not even be loaded otherwise
+    bool is_playing = ng_scenes_get_active(&ctx.scenes) == &playing_scene;
+
     switch (event->type)
     {
     case SDL_KEYDOWN:
+        //profiler overlay and a trace of the last few seconds
+        if (event->key.keysym.sym == SDLK_F3) {
+            SDL_AtomicSet(&ctx.game.show_profiler, !SDL_AtomicGet(&ctx.game.show_profiler));
+        }
+
+        if (event->key.keysym.sym == SDLK_F4) {
+            if (ng_profiler_dump_trace("trace.json")) {
+                printf("wrote trace.json\n");
+            }
+        }
+
+        if (!is_playing) {
+            break;
+        }
+
         if (event->key.keysym.sym == SDLK_w || event->key.keysym.sym == SDLK_UP) {
             //only start the jump animation if it's not already jumping
             if (!ctx.is_jumping)
@@ -298,7 +441,7 @@ static void handle_event(SDL_Event *event)
 
                 ctx.jump_velocity = -304.76f;  //initial upward velocity
                 //reset the jump animation to the first frame
-                ng_animated_set_frame(&ctx.jump, 0);
+                ng_animation_restart(&ctx.jump_animation);
             }
         }
 
@@ -310,7 +453,7 @@ static void handle_event(SDL_Event *event)
             {
                 ctx.is_attacking = true;
                 //reset the attack animation to the first frame
-                ng_animated_set_frame(&ctx.attack, 0);
+                ng_animation_restart(&ctx.attack_animation);
             }
         }
         
@@ -320,11 +463,11 @@ static void handle_event(SDL_Event *event)
             {
                 ctx.is_running = true;
                 //reset the run animation to the first frame
-                ng_animated_set_frame(&ctx.run, 0);
+                ng_animation_restart(&ctx.run_animation);
             }
 
             if (!ctx.run_sfx_playing) {
-                ctx.run_sfx_channel = ng_return_channel(ctx.run_sfx, -1);
+                ctx.run_sfx_voice = ng_audio_play_looped(ng_asset_chunk(playing_scene.assets[PLAYING_RUN_SFX]), -1);
                 ctx.run_sfx_playing = true;   //mark that the sound has started
             }
         }
@@ -335,25 +478,27 @@ static void handle_event(SDL_Event *event)
             {
                 ctx.is_running = true;
                 //reset the run animation to the first frame
-                ng_animated_set_frame(&ctx.run, 0);
+                ng_animation_restart(&ctx.run_animation);
             }
 
             if (!ctx.run_sfx_playing) {
-                ctx.run_sfx_channel = ng_return_channel(ctx.run_sfx, -1);
+                ctx.run_sfx_voice = ng_audio_play_looped(ng_asset_chunk(playing_scene.assets[PLAYING_RUN_SFX]), -1);
                 ctx.run_sfx_playing = true;   //mark that the sound has started
             }
         }
         break;
 
     case SDL_KEYUP:
+        if (!is_playing) {
+            break;
+        }
+
         if (event->key.keysym.sym == SDLK_RIGHT || event->key.keysym.sym == SDLK_d) {
             //stop running animation when the right key is released
             ctx.is_running = false;
             if (ctx.run_sfx_playing) {
                 //stop the running sound when the key is released
-                #ifndef NO_AUDIO    
-                    Mix_HaltChannel(ctx.run_sfx_channel);  //halt the specific channel
-                #endif
+                ng_audio_stop(ctx.run_sfx_voice);  //halt only our own voice
                 ctx.run_sfx_playing = false;  //mark that the sound has stopped
             }            
         }
@@ -363,9 +508,7 @@ static void handle_event(SDL_Event *event)
             ctx.is_running = false;
             if (ctx.run_sfx_playing) {
                 //stop the running sound when the key is released
-                #ifndef NO_AUDIO    
-                    Mix_HaltChannel(ctx.run_sfx_channel);  //halt the specific channel
-                #endif
+                ng_audio_stop(ctx.run_sfx_voice);  //halt only our own voice
                 ctx.run_sfx_playing = false;  //mark that the sound has stopped
             }        
         }
@@ -374,13 +517,59 @@ static void handle_event(SDL_Event *event)
 }
 
 
-static void update_and_render_scene(float delta)
+//shared by the gameplay and the stress test
+static void move_hazards(float delta)
 {
+    ng_entity_store_t *hazards = &ctx.hazards;
+
+    for (int i = 0; i < hazards->count; i++) {
+        if (hazards->kind[i] == KIND_GHOST && hazards->y[i] >= FLOOR) {
+            hazards->vy[i] = 0.0f;  //the ghost waits on the floor
+        }else if (hazards->kind[i] == KIND_SNOWMAN && hazards->y[i] >= HEIGHT - 30) {
+            //once the snowman reaches the ground, reset its position to top
+            respawn_at_top(i);
+        }
+    }
+
+    //make everything fall (and the mouse walk)
+    ng_entities_integrate(hazards, delta);
+    ng_entities_animate(hazards, delta);
+}
+
+//fills ctx.collisions with the hits between the cat and the hazards during this tick
+static void detect_collisions(float delta)
+{
+    ng_entity_store_t *hazards = &ctx.hazards;
+
+    //everything is swept from where it was at the start of the tick,
+    //so nothing passes through the cat even at low tick rates
+    float cat_dx = ctx.run.sprite.transform.x - ctx.cat_previous.x;
 
-    SDL_RenderCopy(ctx.game.renderer, ctx.background_texture, NULL, NULL);
+    //the cat only attacks while the attack animation plays
+    ng_collision_clear(&ctx.collisions);
+    ng_collision_add_moving(&ctx.collisions, ctx.cat_body_type, &ctx.run.sprite.transform, cat_dx, 0, -1);
+    if (ctx.is_attacking) {
+        ng_collision_add_moving(&ctx.collisions, ctx.cat_attack_type, &ctx.attack.sprite.transform, cat_dx, 0, -1);
+    }
+
+    for (int i = 0; i < hazards->count; i++) {
+        SDL_FRect box;
+        ng_entities_get_box(hazards, i, &box);
+        ng_collision_add_moving(&ctx.collisions, ctx.hazard_types[hazards->kind[i]], &box,
+                hazards->vx[i] * delta, hazards->vy[i] * delta, i);
+    }
+
+    ng_collision_detect(&ctx.collisions);
+}
+
+static void update_scene(float delta)
+{
+    // Remember where the cat was, so that rendering can interpolate between ticks
+    ctx.cat_previous.x = ctx.run.sprite.transform.x;
+    ctx.cat_previous.y = ctx.jump.sprite.transform.y;
 
     // Handling "continuous" events, which are now repeatable
-    const Uint8* keys = SDL_GetKeyboardState(NULL);
+    const Uint8* keys = ng_game_get_keyboard_state(&ctx.game);
     
     if (keys[SDL_SCANCODE_LEFT] || keys[SDL_SCANCODE_A]){ //move left
         if (ctx.run.sprite.transform.x > 0) { //wall boundary
@@ -404,59 +593,50 @@ static void update_and_render_scene(float delta)
     }
 
 
-    if (ctx.ghost.sprite.transform.y < FLOOR) {
-        ctx.ghost.sprite.transform.y += 100 * delta;  //make the ghost fall
-    }
+    ng_entity_store_t *hazards = &ctx.hazards;
 
-    for (int i = 0; i < ctx.active_snowmen; i++) {
-        if (ctx.snowman[i].sprite.transform.y < HEIGHT - 30) {
-            ctx.snowman[i].sprite.transform.y += 100 * delta;  //make the snowman fall
-        }else {
-            //once the snowman reaches the ground, reset its position to top
-            ctx.snowman[i].sprite.transform.y = -64;  
-            ctx.snowman[i].sprite.transform.x = ng_random_int_in_range(0, WIDTH - 64);  //random horizontal position
-        }
-    }
+    move_hazards(delta);
 
-    //reset snowman to the top when it collides with the cat
-    for (int i = 0; i < ctx.active_snowmen; i++) {
-        if (check_collision(&ctx.snowman[i], &ctx.run)) {
-            ng_audio_play(ctx.hurt_sfx);
-            ctx.health--;
-            ctx.snowman[i].sprite.transform.y = -64; 
-            ctx.snowman[i].sprite.transform.x = ng_random_int_in_range(0, WIDTH - 64);
-        }
-    }
+    NG_PROFILE_BEGIN("collisions");
+    detect_collisions(delta);
 
-    //reset ghost to the top when cat attacks and collides with the ghost
-    if (ctx.is_attacking) {
-            if (check_collision(&ctx.ghost, &ctx.attack)) {
+    //removing right away would move the other hazards around, so it waits until the end
+    ng_entity_t caught_mouse = NG_ENTITY_NONE;
+
+    //earliest hits come first
+    for (int e = 0; e < ctx.collisions.event_count; e++) {
+        //the cat is always first, it's the one interested in the hazards
+        int i = ctx.collisions.colliders[ctx.collisions.events[e].second].id;
+
+        switch (hazards->kind[i]) {
+            case KIND_SNOWMAN:
+                //reset snowman to the top when it collides with the cat
+                ng_audio_play(ng_asset_chunk(playing_scene.assets[PLAYING_HURT_SFX]));
+                ctx.health--;
+                respawn_at_top(i);
+                break;
+            case KIND_GHOST:
+                //reset ghost to the top when cat attacks and collides with the ghost
                 ctx.ghost_count++;
-                ng_audio_play(ctx.attack_sfx);
-                ctx.ghost.sprite.transform.y = -64;  
-                ctx.ghost.sprite.transform.x = ng_random_int_in_range(0, WIDTH - 64);
-            }
-            if (check_collision(&ctx.mouse, &ctx.attack)) {
-                ng_audio_play(ctx.attack_sfx);
-                ctx.mouse.sprite.transform.x = -200;
+                ng_audio_play(ng_asset_chunk(playing_scene.assets[PLAYING_ATTACK_SFX]));
+                respawn_at_top(i);
+                break;
+            case KIND_MOUSE:
+                ng_audio_play(ng_asset_chunk(playing_scene.assets[PLAYING_ATTACK_SFX]));
                 ctx.health++;
-                ctx.mau = false;
-            }
+                caught_mouse = ng_entities_handle(hazards, i);
+                break;
+        }
     }
 
-    //add more snowmen
-    if (ng_interval_is_ready(&ctx.snowman_tick) && ctx.active_snowmen < MAX_SNOWMEN) {
-        ctx.active_snowmen++;
-    }
+    ng_entities_remove(hazards, caught_mouse);
+    NG_PROFILE_END();
 
-    //cat animations
-    if(ctx.is_attacking){
-        //move to the next frame of the attacking animation
-        if (ng_interval_is_ready(&ctx.game_tick)) {
-            ng_animated_set_frame(&ctx.attack, (ctx.attack.frame + 1) % ctx.attack.total_frames);
-        }
+    //cat animations, only the one that's showing moves on
+    ng_animation_advance(current_cat_animation(), delta);
 
-        if (ctx.attack.frame == ctx.attack.total_frames - 1) {
+    if(ctx.is_attacking){
+        if (ctx.attack_animation.is_finished) {
             ctx.is_attacking = false;  //animation has finished stop attacking
 
         }
@@ -477,136 +657,502 @@ static void update_and_render_scene(float delta)
             //transition to running if the right key is held
             if (keys[SDL_SCANCODE_RIGHT] || keys[SDL_SCANCODE_D]) {
                 ctx.is_running = true;
-                ng_animated_set_frame(&ctx.run, 0);  //reset running animation
+                ng_animation_restart(&ctx.run_animation);  //reset running animation
             }
             //transition to running if the left key is held
             if (keys[SDL_SCANCODE_LEFT] || keys[SDL_SCANCODE_A]) {
                 ctx.is_running = true;
-                ng_animated_set_frame(&ctx.run, 0);  //reset running animation
+                ng_animation_restart(&ctx.run_animation);  //reset running animation
             }
         }
+    }
 
-        //move to the next frame of the jump animation
-        if (ng_interval_is_ready(&ctx.game_tick)) {
-            ng_animated_set_frame(&ctx.jump, (ctx.jump.frame + 1) % ctx.jump.total_frames);
-        }
-    }else if(ctx.is_running){
-        //move to the next frame of the running animation
-        if (ng_interval_is_ready(&ctx.game_tick)) {
-            ng_animated_set_frame(&ctx.run, (ctx.run.frame + 1) % ctx.run.total_frames);
-        }
-    }else{
-        if (ng_interval_is_ready(&ctx.game_tick)) {
-            ng_animated_set_frame(&ctx.idle, (ctx.idle.frame + 1) % ctx.idle.total_frames);
-        }
+    if (ctx.health >= 4){
+        ctx.health = 4;
+    }else if(ctx.health <= 0) {
+       ng_scenes_switch(&ctx.scenes, &death_scene);
+    }
+    if(ctx.ghost_count == 15) {
+        ng_scenes_switch(&ctx.scenes, &game_over_scene);
     }
 
-    //ghost animation
-    if (ng_interval_is_ready(&ctx.ghost_tick)) {
-        ng_animated_set_frame(&ctx.ghost, (ctx.ghost.frame + 1) % ctx.ghost.total_frames);
+    //whichever screen is more likely to come next gets loaded in the background,
+    //the game over one only once the cat gets close to winning
+    ng_scenes_preload(&ctx.scenes, ctx.ghost_count >= 10 ? &game_over_scene : &death_scene);
+}
+
+//the background is only drawn again when it changes, every other frame it's a single copy
+static void render_backdrop(SDL_Texture *texture)
+{
+    if (texture != ctx.backdrop_texture) {
+        ctx.backdrop_texture = texture;
+        ng_cached_layer_invalidate(&ctx.backdrop);
     }
 
+    ng_sprite_batch_t *content = ng_cached_layer_draw(&ctx.backdrop);
+    if (content) {
+        SDL_FRect screen = {0, 0, WIDTH, HEIGHT};
+        ng_sprite_batch_add_ex(content, texture, NULL, &screen, LAYER_BACKGROUND, SDL_FLIP_NONE, white);
+    }
+}
 
+//same thing for the hearts, they only change along with the health
+static void render_hearts(void)
+{
+    if (ctx.health != ctx.hud_health) {
+        ctx.hud_health = ctx.health;
+        ng_cached_layer_invalidate(&ctx.hud);
+    }
+
+    ng_sprite_batch_t *content = ng_cached_layer_draw(&ctx.hud);
+    if (content) {
+        for (int i = 0; i < ctx.health; i++) {
+            ng_sprite_batch_add(content, &ctx.heart[i], LAYER_HUD);
+        }
+    }
+}
+
+//the background, the cat and everything around it
+static void render_world(SDL_Texture *background, float alpha)
+{
+    ng_sprite_batch_t *batch = ng_game_get_draw_list(&ctx.game);
+
+    render_backdrop(background);
 
     // Render animations
-    if (ctx.is_attacking){
-        render_cat(&ctx.attack.sprite, ctx.game.renderer, cat_direction);
-    }else if (ctx.is_jumping) {
-        render_cat(&ctx.jump.sprite, ctx.game.renderer, cat_direction);
-    } else if (ctx.is_running){
-        render_cat(&ctx.run.sprite, ctx.game.renderer, cat_direction);
-    }else {
-        render_cat(&ctx.idle.sprite, ctx.game.renderer, cat_direction); //show idle when doing no actions
+    render_cat(&current_cat_animation()->sprite->sprite, batch, cat_direction, alpha);
+
+    ng_entities_render(&ctx.hazards, batch);
+}
+
+static void render_scene(float alpha)
+{
+    render_world(ng_asset_texture(playing_scene.assets[PLAYING_BACKGROUND]), alpha);
+    render_hearts();
+}
+
+//start screen, the gameplay's assets and atlas keep loading in the background while it shows
+static void start_enter(void)
+{
+    TTF_Font *font = ng_asset_font(start_scene.assets[START_FONT]);
+
+    ng_label_create(&ctx.start_text, font, 500);
+    ng_label_set_content(&ctx.start_text, ctx.game.renderer,
+            "Help the little cat save Christmas\n"
+            "Dodge the falling snowmen \n"
+            "Attack the ghosts with \"space\" \n"
+            "Defeat 15 ghosts to win \n"
+            "press \"Enter\" to start or play again ",
+            white);
+    ctx.start_text.sprite.transform.x = (WIDTH - 450) / 2.0f;
+    ctx.start_text.sprite.transform.y = (HEIGHT - 150) / 2.0f;
+
+    ng_label_create(&ctx.loading_text, font, 0);
+
+    ng_scenes_preload(&ctx.scenes, &playing_scene);
+}
+
+static void start_exit(void)
+{
+    ng_label_destroy(&ctx.start_text);
+    ng_label_destroy(&ctx.loading_text);
+}
+
+static void start_update(float delta) {
+    const Uint8* keys = ng_game_get_keyboard_state(&ctx.game);
+
+    if (!ctx.is_loaded && ng_atlas_is_ready(&ctx.atlas)){
+        ng_game_call_on_render_thread(&ctx.game, finish_loading, NULL);
     }
 
-    ng_sprite_render(&ctx.ghost.sprite, ctx.game.renderer);
+    //the switch itself waits until the gameplay's assets are there
+    if (keys[SDL_SCANCODE_RETURN] || ctx.autoplay){
+        ng_scenes_switch(&ctx.scenes, &playing_scene);
+    }
+}
 
-    for (int i = 0; i < ctx.active_snowmen; i++) {
-        ng_sprite_render(&ctx.snowman[i].sprite, ctx.game.renderer);
+static void render_loading_progress(void)
+{
+    if (ctx.is_loaded && !ng_assets_is_loading()){
+        return;
     }
-    //SDL_Delay(2000);
-    if (ctx.mau){
-        ng_sprite_render(&ctx.mouse.sprite, ctx.game.renderer);
-        ctx.mouse.sprite.transform.x += 50* delta;
+
+    //labels are cheap to change now, no need to check if the number moved
+    //the font's glyphs were already uploaded by the start text, so this never touches the renderer
+    //the atlas decodes apart from the other assets, the bar is only full once both are
+    float progress = MIN(ng_assets_get_progress(), ng_atlas_get_progress(&ctx.atlas));
+
+    char content[32];
+    snprintf(content, sizeof(content), "Loading %d%%", (int)(progress * 100));
+
+    ng_label_set_content(&ctx.loading_text, ctx.game.renderer, content, white);
+    ctx.loading_text.sprite.transform.x = (WIDTH - ctx.loading_text.sprite.transform.w) / 2.0f;
+    ctx.loading_text.sprite.transform.y = HEIGHT - 60;
+
+    ng_label_render(&ctx.loading_text, ng_game_get_draw_list(&ctx.game), LAYER_HUD);
+}
+
+static void start_render(float alpha) {
+    ng_label_render(&ctx.start_text, ng_game_get_draw_list(&ctx.game), LAYER_HUD);
+    render_loading_progress();
+}
+
+static void playing_enter(void)
+{
+    //too early, wait for the rest of the atlas right now
+    if (!ctx.is_loaded){
+        finish_loading(NULL);
     }
 
-    if (ctx.health >= 4){
-        ctx.health = 4;
-        for (int i = 0; i < 4; i++) {
-            ng_sprite_render(&ctx.heart[i], ctx.game.renderer);
-        }
-    }else if(ctx.health == 3) {
-       for (int i = 0; i < 3; i++) {
-            ng_sprite_render(&ctx.heart[i], ctx.game.renderer);
-        }
-    }else if(ctx.health == 2) {
-        for (int i = 0; i < 2; i++) {
-            ng_sprite_render(&ctx.heart[i], ctx.game.renderer);
-        }
-    }else if(ctx.health == 1) {
-        ng_sprite_render(&ctx.heart[0], ctx.game.renderer);
-    }else if(ctx.health == 0) {
-       ctx.current_scene = SCENE_DEATH; 
+    //the backdrop's last texture may have been unloaded since, and its address reused
+    ctx.backdrop_texture = NULL;
+
+#ifndef NO_AUDIO
+
+    //the sounds are loaded again every time the scene comes back, along with their settings
+    Mix_VolumeChunk(ng_asset_chunk(playing_scene.assets[PLAYING_RUN_SFX]), 128);  //running sound at full volume
+    Mix_VolumeChunk(ng_asset_chunk(playing_scene.assets[PLAYING_HURT_SFX]), 128);
+    Mix_VolumeChunk(ng_asset_chunk(playing_scene.assets[PLAYING_ATTACK_SFX]), 128);
+
+    //limits per sound, nothing may steal the footsteps
+    ng_audio_configure(ng_asset_chunk(playing_scene.assets[PLAYING_RUN_SFX]), 1, 3, 0);
+    ng_audio_configure(ng_asset_chunk(playing_scene.assets[PLAYING_HURT_SFX]), 2, 2, 100);
+    ng_audio_configure(ng_asset_chunk(playing_scene.assets[PLAYING_ATTACK_SFX]), 3, 1, 50);
+
+#endif
+}
+
+static void playing_exit(void)
+{
+    //the key may only be released on another screen, where nobody stops the footsteps
+    if (ctx.run_sfx_playing) {
+        ng_audio_stop(ctx.run_sfx_voice);
+        ctx.run_sfx_playing = false;
     }
-    if(ctx.ghost_count == 15) {
-        ctx.current_scene = SCENE_GAME_OVER;
+    ctx.is_running = false;
+}
+
+static void game_over_enter(void)
+{
+    ng_animated_create(&ctx.sleep, ng_asset_texture(game_over_scene.assets[GAME_OVER_SLEEP]), 3);  //sleep
+    ng_sprite_set_scale(&ctx.sleep.sprite, 4.0f);
+    ctx.sleep.sprite.transform.x = (WIDTH - ctx.sleep.sprite.transform.w) / 2.0f;
+    ctx.sleep.sprite.transform.y = HEIGHT - 150 ;
+    ng_animation_start(&ctx.sleep_animation, &sleep_clip, &ctx.sleep);
+
+    TTF_Font *font = ng_asset_font(game_over_scene.assets[GAME_OVER_FONT]);
+
+    ng_label_create(&ctx.win_text, font, 285);
+    ng_label_set_content(&ctx.win_text, ctx.game.renderer,
+            "Congratulations\n",
+            green);
+    ctx.win_text.sprite.transform.x = (WIDTH - 285) / 2.0f;
+    ctx.win_text.sprite.transform.y = (HEIGHT - 450) / 2.0f;
+    ng_label_create(&ctx.win2_text, font, 323);
+    ng_label_set_content(&ctx.win2_text, ctx.game.renderer,
+            "You saved Catmas\n",
+            green);
+    ctx.win2_text.sprite.transform.x = (WIDTH - 300) / 2.0f;
+    ctx.win2_text.sprite.transform.y = (HEIGHT - 350) / 2.0f;
+
+#ifndef NO_AUDIO
+
+    //the purr is requested every frame, so it only ever plays once at a time
+    Mix_VolumeChunk(ng_asset_chunk(game_over_scene.assets[GAME_OVER_PURR_SFX]), 128);
+    ng_audio_configure(ng_asset_chunk(game_over_scene.assets[GAME_OVER_PURR_SFX]), 1, 0, 0);
+
+#endif
+
+    ng_music_set_volume(5);  //background music at lower volume
+    ctx.backdrop_texture = NULL;
+
+    ng_scenes_preload(&ctx.scenes, &start_scene);
+}
+
+static void game_over_exit(void)
+{
+    ng_label_destroy(&ctx.win_text);
+    ng_label_destroy(&ctx.win2_text);
+}
+
+static void game_over_update(float delta) {
+    const Uint8* keys = ng_game_get_keyboard_state(&ctx.game);
+
+    ng_animation_advance(&ctx.sleep_animation, delta);
+
+    ng_audio_play(ng_asset_chunk(game_over_scene.assets[GAME_OVER_PURR_SFX]));
+
+    if (keys[SDL_SCANCODE_RETURN] || ctx.autoplay){
+        reset_game_state();
+        ng_scenes_switch(&ctx.scenes, &start_scene);
     }
 }
 
-static void game_loop(float delta) {
-    const Uint8* keys = SDL_GetKeyboardState(NULL);
-    switch (ctx.current_scene) {
-        case SCENE_START:
-            ng_sprite_render(&ctx.start_text.sprite, ctx.game.renderer);
+static void game_over_render(float alpha) {
+    ng_sprite_batch_t *batch = ng_game_get_draw_list(&ctx.game);
 
-            if (keys[SDL_SCANCODE_RETURN]){
-                ctx.current_scene = SCENE_PLAYING;
-            }
-            break;
-        case SCENE_PLAYING:
-            update_and_render_scene(delta);
-            break;
-        case SCENE_GAME_OVER:
+    render_backdrop(ng_asset_texture(game_over_scene.assets[GAME_OVER_BACKGROUND]));
+
+    ng_label_render(&ctx.win_text, batch, LAYER_HUD);
+    ng_label_render(&ctx.win2_text, batch, LAYER_HUD);
+    ng_sprite_batch_add(batch, &ctx.sleep.sprite, LAYER_CAT);
+}
 
-            #ifndef NO_AUDIO
+static void death_enter(void)
+{
+    ng_label_create(&ctx.death_text, ng_asset_font(death_scene.assets[DEATH_FONT]), 175);
+    ng_label_set_content(&ctx.death_text, ctx.game.renderer,
+            "Game Over",
+            red);
+    ctx.death_text.sprite.transform.x = (WIDTH - 175) / 2.0f;
+    ctx.death_text.sprite.transform.y = (HEIGHT - 125) / 2.0f;
 
-                Mix_VolumeMusic(5);  //background music at lower volum
+    ng_scenes_preload(&ctx.scenes, &start_scene);
+}
 
-            #endif
+static void death_exit(void)
+{
+    ng_label_destroy(&ctx.death_text);
+}
 
-            SDL_RenderCopy(ctx.game.renderer, ctx.win_bg_texture, NULL, NULL);
+static void death_update(float delta) {
+    const Uint8* keys = ng_game_get_keyboard_state(&ctx.game);
 
-            ng_sprite_render(&ctx.win_text.sprite, ctx.game.renderer);
-            ng_sprite_render(&ctx.win2_text.sprite, ctx.game.renderer);
+    if (keys[SDL_SCANCODE_RETURN] || ctx.autoplay){
+        reset_game_state();
+        ng_scenes_switch(&ctx.scenes, &start_scene);
+    }
+}
 
-            if (ng_interval_is_ready(&ctx.sleep_tick)) {
-                ng_animated_set_frame(&ctx.sleep, (ctx.sleep.frame + 1) % ctx.sleep.total_frames);
-            }
+static void death_render(float alpha) {
+    ng_label_render(&ctx.death_text, ng_game_get_draw_list(&ctx.game), LAYER_HUD);
+}
 
-            ng_sprite_render(&ctx.sleep.sprite, ctx.game.renderer);
+//stress test: the gameplay's hazards without the gameplay, more of them every step
+//until the frames get too slow, the counts where they crossed each budget are the engine's limits
+static void stress_add(int amount)
+{
+    for (int i = 0; i < amount; i++) {
+        Kind kind = (ctx.hazards.count % STRESS_GHOST_RATIO == 0) ? KIND_GHOST : KIND_SNOWMAN;
+        int index = spawn_at_top(kind);
 
-            ng_audio_play(ctx.purr_sfx);
+        //spread all over the screen right away instead of falling in a single wave
+        ctx.hazards.y[index] = ng_random_int_in_range(-64, FLOOR);
+    }
+}
 
-            if (keys[SDL_SCANCODE_RETURN]){
-                reset_game_state();
-            }
+static void stress_enter(void)
+{
+    if (!ctx.is_loaded){
+        finish_loading(NULL);
+    }
+    ctx.backdrop_texture = NULL;
 
-            break;
-        case SCENE_DEATH:
-            ng_sprite_render(&ctx.death_text.sprite, ctx.game.renderer);
+    ng_label_create(&ctx.stress_text, ng_asset_font(stress_scene.assets[STRESS_FONT]), 0);
+    //nothing else has used this font yet when --stress skips the start screen, the first
+    //content uploads its glyphs, which only this thread may do (stress_render runs on the simulation)
+    ng_label_set_content(&ctx.stress_text, ctx.game.renderer, "0 objects", white);
 
-            if (keys[SDL_SCANCODE_RETURN]){
-                reset_game_state();
-            }
-            break;
+    ng_entities_clear(&ctx.hazards);
+    stress_add(STRESS_START_OBJECTS);
+
+    ctx.stress_step_time = 0.0f;
+    ctx.stress_frame_ms = 0.0;
+    ctx.stress_frames = 0;
+    ctx.stress_rendered_count = 0;
+    ctx.stress_count_60 = ctx.stress_count_30 = 0;
+
+    printf("stress: starting with %d objects, %d%% more every %.1f seconds\n",
+           STRESS_START_OBJECTS, (int)(STRESS_GROWTH * 100), STRESS_STEP_SECONDS);
+}
+
+static void stress_exit(void)
+{
+    ng_label_destroy(&ctx.stress_text);
+}
+
+static void stress_report(const char *budget, int count)
+{
+    if (count > 0) {
+        printf("stress: frames went over %s with %d objects\n", budget, count);
+    }else {
+        printf("stress: frames never went over %s, up to %d objects\n", budget, ctx.hazards.count);
     }
 }
 
-int main()
+static void stress_update(float delta)
 {
+    //the cat stays put, it's only there for the collisions
+    ctx.cat_previous.x = ctx.run.sprite.transform.x;
+    ctx.cat_previous.y = ctx.jump.sprite.transform.y;
+    ng_animation_advance(current_cat_animation(), delta);
+
+    move_hazards(delta);
+
+    NG_PROFILE_BEGIN("collisions");
+    detect_collisions(delta);
+
+    //whatever hits the cat simply starts over
+    for (int e = 0; e < ctx.collisions.event_count; e++) {
+        respawn_at_top(ctx.collisions.colliders[ctx.collisions.events[e].second].id);
+    }
+    NG_PROFILE_END();
+
+    //already reported, the rest of this frame's ticks may still run
+    if (!ctx.game.is_running) {
+        return;
+    }
+
+    ctx.stress_step_time += delta;
+    if (ctx.stress_step_time < STRESS_STEP_SECONDS || ctx.stress_frames == 0) {
+        return;
+    }
+
+    double average = ctx.stress_frame_ms / ctx.stress_frames;
+    int count = ctx.hazards.count;
+
+    if (ctx.stress_count_60 == 0 && average > 1000.0 / 60.0) {
+        ctx.stress_count_60 = count;
+        printf("stress: %.2f ms per frame with %d objects, over the 60 fps budget\n", average, count);
+    }
+    if (ctx.stress_count_30 == 0 && average > 1000.0 / 30.0) {
+        ctx.stress_count_30 = count;
+        printf("stress: %.2f ms per frame with %d objects, over the 30 fps budget\n", average, count);
+    }
+
+    if (ctx.stress_count_30 > 0 || count >= STRESS_MAX_OBJECTS) {
+        stress_report("16.6 ms", ctx.stress_count_60);
+        stress_report("33.3 ms", ctx.stress_count_30);
+        ctx.game.is_running = false;
+        return;
+    }
+
+    ctx.stress_step_time = 0.0f;
+    ctx.stress_frame_ms = 0.0;
+    ctx.stress_frames = 0;
+
+    stress_add(MIN(MAX((int)(count * STRESS_GROWTH), 1), STRESS_MAX_OBJECTS - count));
+}
+
+static void stress_render(float alpha)
+{
+    //the frame that just ended, unless it still had fewer objects than there are now
+    if (ctx.hazards.count == ctx.stress_rendered_count) {
+        ctx.stress_frame_ms += ng_game_get_frame_ms(&ctx.game);
+        ctx.stress_frames++;
+    }
+    ctx.stress_rendered_count = ctx.hazards.count;
+
+    render_world(ng_asset_texture(stress_scene.assets[STRESS_BACKGROUND]), alpha);
+
+    char content[64];
+    snprintf(content, sizeof(content), "%d objects, %.1f ms", ctx.hazards.count, ng_game_get_frame_ms(&ctx.game));
+
+    ng_label_set_content(&ctx.stress_text, ctx.game.renderer, content, white);
+    ctx.stress_text.sprite.transform.x = 8;
+    ctx.stress_text.sprite.transform.y = HEIGHT - 28;
+    ng_label_render(&ctx.stress_text, ng_game_get_draw_list(&ctx.game), LAYER_HUD);
+}
+
+static ng_scene_t start_scene = {"start", start_assets, ARRAY_LENGTH(start_assets),
+        start_enter, start_exit, start_update, start_render, NULL, 0};
+static ng_scene_t playing_scene = {"playing", playing_assets, ARRAY_LENGTH(playing_assets),
+        playing_enter, playing_exit, update_scene, render_scene, NULL, 0};
+static ng_scene_t game_over_scene = {"game over", game_over_assets, ARRAY_LENGTH(game_over_assets),
+        game_over_enter, game_over_exit, game_over_update, game_over_render, NULL, 0};
+static ng_scene_t death_scene = {"death", death_assets, ARRAY_LENGTH(death_assets),
+        death_enter, death_exit, death_update, death_render, NULL, 0};
+static ng_scene_t stress_scene = {"stress", stress_assets, ARRAY_LENGTH(stress_assets),
+        stress_enter, stress_exit, stress_update, stress_render, NULL, 0};
+
+// Runs at the fixed tick rate, all of the gameplay logic lives in the scenes
+static void game_update(float delta) {
+    ng_scenes_update(&ctx.scenes, delta);
+}
+
+// Runs once per displayed frame, only draws the current state
+// Everything goes into the game's draw list, the engine draws it (maybe on another thread)
+static void game_render(float alpha) {
+    ng_scenes_render(&ctx.scenes, alpha);
+}
+
+static void print_usage(const char *program)
+{
+    printf("usage: %s [--headless] [--frames N] [--tick-rate HZ] [--single-thread] [--stress]\n"
+           "          [--record FILE | --replay FILE]\n"
+           "  --headless       run without a window or GPU, as fast as possible\n"
+           "  --frames N       quit after N frames and print the throughput\n"
+           "  --tick-rate HZ   gameplay updates per second (60 by default, 30 for weak hardware)\n"
+           "  --single-thread  update and draw on the same thread, one after the other\n"
+           "  --stress         keep adding hazards and report how many it takes to go\n"
+           "                   over 16.6 and 33.3 ms per frame\n"
+           "  --record FILE    save the session's input so it can be replayed\n"
+           "  --replay FILE    play a recorded session back and report frame times\n",
+           program);
+}
+
+int main(int argc, char *argv[])
+{
+    bool headless = false;
+    bool single_thread = false;
+    bool stress = false;
+    uint64_t max_frames = 0;
+    unsigned int tick_rate = 0;
+    const char *record_path = NULL, *replay_path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        }else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            max_frames = strtoull(argv[++i], NULL, 10);
+        }else if (strcmp(argv[i], "--tick-rate") == 0 && i + 1 < argc) {
+            tick_rate = strtoul(argv[++i], NULL, 10);
+        }else if (strcmp(argv[i], "--single-thread") == 0) {
+            single_thread = true;
+        }else if (strcmp(argv[i], "--stress") == 0) {
+            stress = true;
+        }else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_path = argv[++i];
+        }else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_path = argv[++i];
+        }else {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    //a replay plays its own input back, there's nothing of the player's to record
+    if (record_path && replay_path) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (headless) {
+        ng_game_create_headless(&ctx.game, WIDTH, HEIGHT);
+    }else {
+        ng_game_create(&ctx.game, "Cat", WIDTH, HEIGHT); //creates window
+    }
+    ng_game_set_max_frames(&ctx.game, max_frames);
+    if (single_thread) {
+        ng_game_set_threaded(&ctx.game, false);
+    }
+    //before the replay, recordings save it and replays bring back their own
+    if (tick_rate > 0) {
+        ng_game_set_tick_rate(&ctx.game, tick_rate);
+    }
+
+    //replays drive the menus themselves, through the recorded key presses
+    if (replay_path) {
+        ng_replay_play(&ctx.replay, &ctx.game, replay_path);
+    }else if (record_path) {
+        ng_replay_record(&ctx.replay, &ctx.game, record_path);
+    }
+    ctx.autoplay = headless && !replay_path && !record_path;
+
     create_actors();
-    ctx.current_scene = SCENE_START;
+    //whichever scene comes first shows up on the first update
+    ng_scenes_push(&ctx.scenes, stress ? &stress_scene : &start_scene);
     
-    ng_game_start_loop(&ctx.game,
-            handle_event, game_loop);
-}
\ No newline at end of file
+    ng_game_start_fixed_loop(&ctx.game,
+            handle_event, game_update, game_render);
+}
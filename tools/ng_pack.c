@@ -0,0 +1,235 @@
+/*
+ * Offline asset pack builder, see src/engine/pack.h for the runtime side
+ *
+ * Bakes every file under a directory into a single indexed archive, so that the
+ * game does one open + mmap at startup instead of a dozen small file reads
+ *
+ * Layout (everything little endian):
+ *   header   magic "NGPK", version, entry count, flags
+ *   entries  one per file, sorted by name so the game can binary search them
+ *   names    the entries' paths, back to back (not null terminated)
+ *   data     every file's bytes, each one starting on a DATA_ALIGNMENT boundary
+ *
+ * Build with -D NG_PACK_LZ4 -llz4 to enable --lz4, which compresses the entries
+ * that actually shrink (already compressed formats like png or ogg won't)
+ */
+#define _XOPEN_SOURCE 700
+#include <ftw.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef NG_PACK_LZ4
+#include <lz4.h>
+#endif
+
+#define PACK_MAGIC 0x4b50474eu
+#define PACK_VERSION 1
+#define HEADER_SIZE 16
+#define ENTRY_SIZE 32
+#define DATA_ALIGNMENT 16
+
+#define ENTRY_LZ4 0x1
+
+typedef struct
+{
+    char *name;
+    uint8_t *data;
+    uint32_t stored_size, original_size;
+    uint32_t flags;
+    uint64_t data_offset;
+} entry_t;
+
+static entry_t *entries;
+static size_t entry_count, entry_capacity;
+
+static void die(const char *message, const char *detail)
+{
+    fprintf(stderr, "ng_pack: %s %s\n", message, detail ? detail : "");
+    exit(EXIT_FAILURE);
+}
+
+static uint8_t* read_file(const char *path, uint32_t *size)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        die("couldn't open", path);
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    uint8_t *data = malloc(length > 0 ? length : 1);
+    if (!data || fread(data, 1, length, file) != (size_t)length)
+        die("couldn't read", path);
+
+    fclose(file);
+    *size = length;
+
+    return data;
+}
+
+static int collect_file(const char *path, const struct stat *info, int type, struct FTW *ftw)
+{
+    (void)info;
+    (void)ftw;
+
+    if (type != FTW_F)
+        return 0;
+
+    if (entry_count == entry_capacity)
+    {
+        entry_capacity = entry_capacity ? entry_capacity * 2 : 64;
+        entries = realloc(entries, entry_capacity * sizeof(entry_t));
+
+        if (!entries)
+            die("ran out of memory", NULL);
+    }
+
+    entry_t *entry = &entries[entry_count++];
+    entry->name = strdup(path);
+    entry->data = read_file(path, &entry->original_size);
+    entry->stored_size = entry->original_size;
+    entry->flags = 0;
+
+    return 0;
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+    return strcmp(((const entry_t*)a)->name, ((const entry_t*)b)->name);
+}
+
+#ifdef NG_PACK_LZ4
+static void compress_entry(entry_t *entry)
+{
+    int bound = LZ4_compressBound(entry->original_size);
+    uint8_t *compressed = malloc(bound);
+
+    if (!compressed)
+        die("ran out of memory", NULL);
+
+    int size = LZ4_compress_default((const char*)entry->data, (char*)compressed,
+                                    entry->original_size, bound);
+
+    // Decompressing costs a copy at load time, only worth it if it saves at least an eighth
+    if (size > 0 && (uint32_t)size < entry->original_size - entry->original_size / 8)
+    {
+        free(entry->data);
+        entry->data = compressed;
+        entry->stored_size = size;
+        entry->flags |= ENTRY_LZ4;
+    }
+    else
+        free(compressed);
+}
+#endif
+
+static void write_u32(FILE *file, uint32_t value)
+{
+    uint8_t bytes[4] = {value, value >> 8, value >> 16, value >> 24};
+    fwrite(bytes, 1, sizeof(bytes), file);
+}
+
+static void write_u64(FILE *file, uint64_t value)
+{
+    write_u32(file, (uint32_t)value);
+    write_u32(file, (uint32_t)(value >> 32));
+}
+
+static void pad_to(FILE *file, uint64_t offset)
+{
+    while ((uint64_t)ftell(file) < offset)
+        fputc(0, file);
+}
+
+int main(int argc, char *argv[])
+{
+    bool use_lz4 = argc == 4 && strcmp(argv[3], "--lz4") == 0;
+
+    if (argc != 3 && !use_lz4)
+    {
+        fprintf(stderr, "usage: %s <asset directory> <output pack> [--lz4]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+#ifndef NG_PACK_LZ4
+    if (use_lz4)
+        die("this build has no LZ4 support, rebuild it with -D NG_PACK_LZ4 -llz4", NULL);
+#endif
+
+    // Stored names are the paths as given, e.g. "assets/cat/run.png", same as the game uses
+    if (nftw(argv[1], collect_file, 16, FTW_PHYS) != 0)
+        die("couldn't walk", argv[1]);
+
+    qsort(entries, entry_count, sizeof(entry_t), compare_entries);
+
+#ifdef NG_PACK_LZ4
+    if (use_lz4)
+        for (size_t i = 0; i < entry_count; i++)
+            compress_entry(&entries[i]);
+#endif
+
+    // Figure out where everything goes before writing anything
+    uint64_t names_offset = HEADER_SIZE + entry_count * ENTRY_SIZE;
+    uint64_t names_size = 0;
+
+    for (size_t i = 0; i < entry_count; i++)
+        names_size += strlen(entries[i].name);
+
+    uint64_t data_offset = names_offset + names_size;
+    for (size_t i = 0; i < entry_count; i++)
+    {
+        data_offset = (data_offset + DATA_ALIGNMENT - 1) / DATA_ALIGNMENT * DATA_ALIGNMENT;
+        entries[i].data_offset = data_offset;
+        data_offset += entries[i].stored_size;
+    }
+
+    FILE *pack = fopen(argv[2], "wb");
+    if (!pack)
+        die("couldn't create", argv[2]);
+
+    write_u32(pack, PACK_MAGIC);
+    write_u32(pack, PACK_VERSION);
+    write_u32(pack, entry_count);
+    write_u32(pack, 0);
+
+    uint32_t name_offset = names_offset;
+    for (size_t i = 0; i < entry_count; i++)
+    {
+        uint32_t name_length = strlen(entries[i].name);
+
+        write_u64(pack, entries[i].data_offset);
+        write_u32(pack, entries[i].stored_size);
+        write_u32(pack, entries[i].original_size);
+        write_u32(pack, name_offset);
+        write_u32(pack, name_length);
+        write_u32(pack, entries[i].flags);
+        write_u32(pack, 0);
+
+        name_offset += name_length;
+    }
+
+    for (size_t i = 0; i < entry_count; i++)
+        fwrite(entries[i].name, 1, strlen(entries[i].name), pack);
+
+    uint64_t total_original = 0, total_stored = 0;
+    for (size_t i = 0; i < entry_count; i++)
+    {
+        pad_to(pack, entries[i].data_offset);
+        fwrite(entries[i].data, 1, entries[i].stored_size, pack);
+
+        total_original += entries[i].original_size;
+        total_stored += entries[i].stored_size;
+    }
+
+    if (fclose(pack) != 0)
+        die("couldn't finish writing", argv[2]);
+
+    printf("packed %zu files into %s (%llu -> %llu bytes of data)\n", entry_count, argv[2],
+           (unsigned long long)total_original, (unsigned long long)total_stored);
+
+    return EXIT_SUCCESS;
+}